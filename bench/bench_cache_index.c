@@ -0,0 +1,86 @@
+#include "pch.h"
+#include "cache_index.h"
+#include "bench_common.h"
+
+/*
+ * bench_cache_index.c
+ *
+ * Measures indexing cached pages, and querying an index of tens of thousands
+ * of them (for a word that's on a few pages, for words that are on every
+ * page, and for both).  The pages are slices of the gemtext corpus
+ */
+
+// Pages in the index that's queried, and the size of each
+#define BENCH_PAGES 20000
+#define BENCH_PAGE_SIZE 2048
+
+// Pages indexed in each run of the indexing benchmark
+#define BENCH_ADD_PAGES 1000
+
+struct bench_index
+{
+    const struct bench_corpus *c;
+    struct cache_index index;
+    const char *query;
+};
+
+/* Add pages to an index, each a slice of the corpus */
+static void
+bench_index_pages(struct cache_index *x, const struct bench_corpus *c, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        char uri[64];
+        snprintf(uri, sizeof(uri), "gemini://bench.example/page/%d", i);
+
+        const size_t offset =
+            ((size_t)i * 7919 * 64) % (c->size - BENCH_PAGE_SIZE);
+        cache_index_add(x, uri, MIME_GEMTEXT,
+            c->b + offset, BENCH_PAGE_SIZE, "", false);
+    }
+}
+
+static void
+bench_index_add(void *data)
+{
+    struct bench_index *const b = data;
+    struct cache_index x = { 0 };
+    bench_index_pages(&x, b->c, BENCH_ADD_PAGES);
+    cache_index_free(&x);
+}
+
+static void
+bench_index_query(void *data)
+{
+    struct bench_index *const b = data;
+    uint32_t *docs;
+    cache_index_query(&b->index, b->query, &docs);
+    free(docs);
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_corpus_load("doc.gmi");
+    struct bench_index b = { .c = &c };
+
+    bench_run("index_add", bench_index_add, &b,
+        BENCH_ADD_PAGES, BENCH_ADD_PAGES * BENCH_PAGE_SIZE);
+
+    bench_index_pages(&b.index, &c, BENCH_PAGES);
+
+    b.query = "needle";
+    bench_run("index_query_sparse", bench_index_query, &b, 1, 0);
+    b.query = "gemini capsule";
+    bench_run("index_query_dense", bench_index_query, &b, 1, 0);
+    b.query = "capsule needle";
+    bench_run("index_query_mixed", bench_index_query, &b, 1, 0);
+
+    cache_index_free(&b.index);
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
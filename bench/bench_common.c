@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "pager.h"
+#include "state.h"
+#include "tui.h"
+#include "bench_common.h"
+
+struct state g_state;
+struct recv_buffer *g_recv;
+
+void program_exited(void) {}
+
+/* Set up just enough of the program to load and typeset pages */
+void
+bench_init(void)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    g_recv = &g_state.recv_buffer;
+    g_recv->capacity = 4096;
+    g_recv->b = malloc(g_recv->capacity);
+    g_recv->size = 0;
+    g_recv->b_alt = NULL;
+
+    pager_init();
+
+    // Nothing is drawn, but the pager still wants a terminal size
+    tui_init_headless(BENCH_WIDTH, 24);
+}
+
+void
+bench_deinit(void)
+{
+    tui_cleanup();
+    pager_deinit();
+    free(g_recv->b);
+}
+
+/* Read a file from the corpus directory */
+struct bench_corpus
+bench_corpus_load(const char *name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", BENCH_CORPUS_DIR, name);
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        exit(-1);
+    }
+
+    struct bench_corpus c = { NULL, 0 };
+    fseek(fp, 0, SEEK_END);
+    c.size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    c.b = malloc(c.size + 1);
+    if (!c.b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    if (fread(c.b, 1, c.size, fp) != c.size)
+    {
+        fprintf(stderr, "failed to read %s\n", path);
+        exit(-1);
+    }
+    c.b[c.size] = '\0';
+
+    fclose(fp);
+    return c;
+}
+
+void
+bench_corpus_free(struct bench_corpus *c)
+{
+    free(c->b);
+    c->b = NULL;
+    c->size = 0;
+}
+
+/* Make the corpus file the current page, as if it were just received */
+void
+bench_set_page(const struct bench_corpus *c, const char *mime)
+{
+    recv_buffer_check_size(c->size);
+    memcpy(g_recv->b, c->b, c->size);
+    g_recv->size = c->size;
+    mime_parse(&g_recv->mime, mime, strlen(mime));
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Call func repeatedly (doubling the number of calls each round) until it
+ * has taken at least BENCH_MIN_SECS, and report the time per operation.  Each
+ * call performs ops_per_call operations over bytes_per_call bytes
+ */
+void
+bench_run(
+    const char *name,
+    void (*func)(void *),
+    void *data,
+    size_t ops_per_call,
+    size_t bytes_per_call)
+{
+    // Warm up caches (and anything lazily initialised)
+    func(data);
+
+    size_t calls = 1;
+    double secs;
+    for (;; calls *= 2)
+    {
+        const double t0 = bench_now();
+        for (size_t i = 0; i < calls; ++i) func(data);
+        secs = bench_now() - t0;
+
+        if (secs >= BENCH_MIN_SECS) break;
+    }
+
+    const size_t ops = calls * ops_per_call;
+    printf("%-28s %10zu %14.1f ns/op %14.0f B/s\n",
+        name,
+        ops,
+        secs * 1e9 / ops,
+        bytes_per_call * calls / secs);
+    fflush(stdout);
+}
@@ -0,0 +1,46 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+/*
+ * bench_common.h
+ *
+ * Shared setup and reporting for the benchmarks.  Each benchmark is its own
+ * binary, linked against the real object files, and runs over the synthetic
+ * corpus in bench/corpus (see tools/gen_bench_corpus.py).  Run them all with
+ * 'make bench', from the top of the tree.
+ *
+ * Results are printed one per line, so they are easy to diff or feed to other
+ * tools:
+ *
+ *   <name> <ops> <ns> ns/op <bytes> B/s
+ */
+
+#define BENCH_CORPUS_DIR "bench/corpus"
+
+// Content width that pages are typeset to
+#define BENCH_WIDTH 80
+
+// Each benchmark is repeated until it has run for at least this long
+#define BENCH_MIN_SECS 0.5
+
+struct bench_corpus
+{
+    char *b;
+    size_t size;
+};
+
+void bench_init(void);
+void bench_deinit(void);
+
+struct bench_corpus bench_corpus_load(const char *);
+void bench_corpus_free(struct bench_corpus *);
+void bench_set_page(const struct bench_corpus *, const char *);
+
+void bench_run(
+    const char *,
+    void (*)(void *),
+    void *,
+    size_t,
+    size_t);
+
+#endif
@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "line_break_alg.h"
+#include "bench_common.h"
+
+/*
+ * bench_line_break.c
+ *
+ * Compares the Knuth-Plass and greedy line breaking algorithms on the
+ * paragraphs of the gemtext corpus
+ */
+
+struct bench_paragraphs
+{
+    struct lb_prepare_args *args;
+    int count;
+    void (*compute)(void);
+};
+
+static char s_out[64 * 1024];
+
+static void
+bench_line_break(void *data)
+{
+    const struct bench_paragraphs *const p = data;
+    for (int i = 0; i < p->count; ++i)
+    {
+        line_break_prepare(&p->args[i]);
+        p->compute();
+        for (; line_break_has_data();)
+        {
+            line_break_get(s_out, sizeof(s_out));
+        }
+    }
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_corpus_load("doc.gmi");
+
+    // Plain paragraph lines only; everything else is barely wrapped
+    struct bench_paragraphs p = { NULL, 0, NULL };
+    size_t bytes = 0;
+    p.args = malloc(sizeof(struct lb_prepare_args) * (c.size / 2 + 1));
+    if (!p.args)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    bool verbatim = false;
+    for (char *line = c.b, *end; line < c.b + c.size; line = end + 1)
+    {
+        if (!(end = memchr(line, '\n', c.b + c.size - line)))
+        {
+            end = c.b + c.size;
+        }
+        if (strncmp(line, "```", 3) == 0) verbatim = !verbatim;
+        if (verbatim || end - line < 2 || strchr("#=*>`", *line)) continue;
+
+        p.args[p.count++] = (struct lb_prepare_args)
+        {
+            .line = line,
+            .line_end = end,
+            .length = BENCH_WIDTH,
+        };
+        bytes += end - line;
+    }
+
+    p.compute = line_break_compute_knuth_plass;
+    bench_run("line_break_knuth_plass", bench_line_break, &p, p.count, bytes);
+
+    p.compute = line_break_compute_greedy;
+    bench_run("line_break_greedy", bench_line_break, &p, p.count, bytes);
+
+    free(p.args);
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
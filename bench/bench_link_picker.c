@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "link_picker.h"
+#include "pager.h"
+#include "state.h"
+#include "typesetter.h"
+#include "bench_common.h"
+
+/*
+ * bench_link_picker.c
+ *
+ * Measures loading a gophermap with a hundred thousand links, opening
+ * the link picker on it (which fills its arena), and matching queries
+ * against its links: typed from scratch, typed a character at a time (so
+ * each query narrows the one before it), and a single character that
+ * matches nearly everything
+ */
+
+// Links in the gophermap
+#define BENCH_LINKS 100000
+
+/* Make a gophermap of nothing but links, with a few different labels */
+static struct bench_corpus
+bench_picker_page(void)
+{
+    static const char *const LABELS[] =
+    {
+        "Phlog entry", "Directory of files", "Search the archives",
+        "README", "Gemini mirror", "Recipes",
+    };
+    const int label_count = sizeof(LABELS) / sizeof(LABELS[0]);
+
+    struct bench_corpus c = { NULL, 0 };
+    const size_t capacity = BENCH_LINKS * 96;
+    c.b = malloc(capacity);
+    if (!c.b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < BENCH_LINKS; ++i)
+    {
+        c.size += snprintf(c.b + c.size, capacity - c.size,
+            "1%s %d\t/%d/item/%d\tbench%d.example\t70\r\n",
+            LABELS[i % label_count], i, i % 97, i, i % 13);
+    }
+    return c;
+}
+
+static void
+bench_picker_typeset(void *data)
+{
+    (void)data;
+    typesetter_reinit(&g_pager->typeset);
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH, &g_recv->mime);
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+}
+
+/* Rank every link with the arena empty, as when the picker is first opened */
+static void
+bench_picker_open(void *data)
+{
+    (void)data;
+    g_pager->link_text_len = 0;
+    link_picker_reset();
+    link_picker_rank("", 0);
+}
+
+static void
+bench_picker_query(void *data)
+{
+    const char *const query = data;
+    link_picker_reset();
+    link_picker_rank(query, strlen(query));
+}
+
+/* Type the query one character at a time */
+static void
+bench_picker_typed(void *data)
+{
+    const char *const query = data;
+    link_picker_reset();
+    for (size_t i = 0; i <= strlen(query); ++i) link_picker_rank(query, i);
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_picker_page();
+    bench_set_page(&c, MIME_GOPHERMAP);
+
+    bench_run("picker_typeset", bench_picker_typeset, NULL, 1, c.size);
+    bench_run("picker_open", bench_picker_open, NULL, 1, c.size);
+
+    static const char QUERY[] = "recipes 4242";
+    bench_run("picker_query", bench_picker_query, (void *)QUERY,
+        1, g_pager->link_text_len);
+    bench_run("picker_query_typed", bench_picker_typed, (void *)QUERY,
+        strlen(QUERY) + 1, g_pager->link_text_len);
+    bench_run("picker_query_dense", bench_picker_query, "e",
+        1, g_pager->link_text_len);
+
+    link_picker_reset();
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
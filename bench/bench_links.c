@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "pager.h"
+#include "state.h"
+#include "typesetter.h"
+#include "bench_common.h"
+
+/*
+ * bench_links.c
+ *
+ * Measures selecting the first and last visible links, and painting, at
+ * positions all through a gophermap with a hundred thousand links.  Both
+ * should only cost as much as what's on the screen, not the whole page
+ */
+
+// Links in the gophermap
+#define BENCH_LINKS 100000
+
+// Scroll positions visited in each run
+#define BENCH_STEPS 1000
+
+/* Make a gophermap of nothing but links */
+static struct bench_corpus
+bench_links_page(void)
+{
+    struct bench_corpus c = { NULL, 0 };
+    const size_t capacity = BENCH_LINKS * 64;
+    c.b = malloc(capacity);
+    if (!c.b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < BENCH_LINKS; ++i)
+    {
+        c.size += snprintf(c.b + c.size, capacity - c.size,
+            "1Directory %d\t/dir/%d\tbench.example\t70\r\n", i, i);
+    }
+    return c;
+}
+
+static void
+bench_links_select(void *data)
+{
+    (void)data;
+    const int lines = g_pager->buffer.line_count;
+    for (int i = 0; i < BENCH_STEPS; ++i)
+    {
+        g_pager->scroll = (int)((long)i * lines / BENCH_STEPS);
+        pager_select_first_link_visible();
+        pager_select_last_link_visible();
+    }
+}
+
+static void
+bench_links_paint(void *data)
+{
+    (void)data;
+    const int lines = g_pager->buffer.line_count;
+    for (int i = 0; i < BENCH_STEPS; ++i)
+    {
+        g_pager->scroll = (int)((long)i * lines / BENCH_STEPS);
+        g_pager->link_index = i;
+        pager_paint(true);
+    }
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_links_page();
+    bench_set_page(&c, MIME_GOPHERMAP);
+
+    typesetter_reinit(&g_pager->typeset);
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH, &g_recv->mime);
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+
+    bench_run("links_select_visible", bench_links_select, NULL,
+        BENCH_STEPS, 0);
+    bench_run("links_paint", bench_links_paint, NULL, BENCH_STEPS, 0);
+
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
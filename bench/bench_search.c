@@ -0,0 +1,85 @@
+#include "pch.h"
+#include "pager.h"
+#include "search.h"
+#include "state.h"
+#include "typesetter.h"
+#include "bench_common.h"
+
+/*
+ * bench_search.c
+ *
+ * Measures searching through a gemtext page, for a word that appears a few
+ * times, for one that doesn't appear at all, for a letter that appears
+ * everywhere, and for a regular expression.  Only the raw text is searched,
+ * so the page needs typesetting just to know what kind of document it is.
+ *
+ * Also searches a single long line of a's for regular expressions that could
+ * match on past every a (but never do), which would take time quadratic in
+ * the length of the line if each match was looked for from scratch
+ */
+
+// Length of the line of a's
+#define BENCH_LONG_LINE 40000
+
+static void
+bench_search(void *data)
+{
+    (void)data;
+    search_perform();
+}
+
+static void
+bench_search_query(const char *name, const char *query, size_t bytes)
+{
+    struct search *const s = &g_pager->search;
+    s->query_len = strlen(query);
+    memcpy(s->query, query, s->query_len + 1);
+
+    bench_run(name, bench_search, NULL, 1, bytes);
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_corpus_load("doc.gmi");
+    bench_set_page(&c, MIME_GEMTEXT);
+
+    typesetter_reinit(&g_pager->typeset);
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH, &g_recv->mime);
+
+    bench_search_query("search_sparse", "needle", c.size);
+    bench_search_query("search_none", "haystack", c.size);
+    bench_search_query("search_dense", "e", c.size);
+    bench_search_query("search_regex",
+        SEARCH_REGEX_PREFIX "ne+dle|hay[a-z]+", c.size);
+
+    bench_corpus_free(&c);
+
+    c.size = BENCH_LONG_LINE + 1;
+    c.b = malloc(c.size);
+    if (!c.b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    memset(c.b, 'a', BENCH_LONG_LINE);
+    c.b[BENCH_LONG_LINE] = '\n';
+    bench_set_page(&c, MIME_PLAINTEXT);
+
+    typesetter_reinit(&g_pager->typeset);
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH, &g_recv->mime);
+
+    bench_search_query("search_regex_long_line",
+        SEARCH_REGEX_PREFIX "a|a.*b", c.size);
+    bench_search_query("search_regex_long_empty",
+        SEARCH_REGEX_PREFIX "(a*b)?", c.size);
+
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
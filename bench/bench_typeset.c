@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "pager.h"
+#include "state.h"
+#include "typesetter.h"
+#include "bench_common.h"
+
+/*
+ * bench_typeset.c
+ *
+ * Measures typesetting of whole gemtext, gophermap and plaintext pages, both
+ * as they're loaded and again at another width (as when the terminal is
+ * resized)
+ */
+
+static void
+bench_typeset_page(void *data)
+{
+    (void)data;
+
+    g_pager->link_count = 0;
+    typesetter_reinit(&g_pager->typeset);
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH, &g_recv->mime);
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+}
+
+/* Typeset the page that's already loaded again, at alternating widths */
+static void
+bench_retypeset_page(void *data)
+{
+    static int n = 0;
+    (void)data;
+
+    typeset_page(&g_pager->typeset,
+        &g_pager->buffer, BENCH_WIDTH - (n++ & 1), &g_recv->mime);
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    static const struct
+    {
+        const char *name, *retypeset_name, *file, *mime;
+    } PAGES[] =
+    {
+        { "typeset_gemtext", "retypeset_gemtext",
+            "doc.gmi", MIME_GEMTEXT },
+        { "typeset_gophermap", "retypeset_gophermap",
+            "doc.gophermap", MIME_GOPHERMAP },
+        { "typeset_plaintext", "retypeset_plaintext",
+            "doc.txt", MIME_PLAINTEXT },
+    };
+
+    for (int i = 0; i < sizeof(PAGES) / sizeof(PAGES[0]); ++i)
+    {
+        struct bench_corpus c = bench_corpus_load(PAGES[i].file);
+        bench_set_page(&c, PAGES[i].mime);
+        bench_run(PAGES[i].name, bench_typeset_page, NULL, 1, c.size);
+        bench_run(PAGES[i].retypeset_name, bench_retypeset_page, NULL,
+            1, c.size);
+        bench_corpus_free(&c);
+    }
+
+    bench_deinit();
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "uri.h"
+#include "bench_common.h"
+
+/*
+ * bench_uri.c
+ *
+ * Measures parsing URIs, and resolving links relative to the page they are
+ * on.  The corpus has a base URI and a link on each line, separated by a tab
+ */
+
+struct bench_uris
+{
+    // Strings from the corpus
+    const char **strs;
+    int *lens;
+    int str_count;
+
+    // Parsed base/link pairs
+    struct uri *base, *link;
+    int pair_count;
+};
+
+static void
+bench_uri_parse(void *data)
+{
+    const struct bench_uris *const u = data;
+    for (int i = 0; i < u->str_count; ++i)
+    {
+        struct uri uri = uri_parse(u->strs[i], u->lens[i]);
+        (void)uri;
+    }
+}
+
+static void
+bench_uri_abs(void *data)
+{
+    const struct bench_uris *const u = data;
+    for (int i = 0; i < u->pair_count; ++i)
+    {
+        struct uri link = u->link[i];
+        uri_abs(&u->base[i], &link);
+    }
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_corpus_load("uris.txt");
+
+    struct bench_uris u = { 0 };
+    int lines = 0;
+    for (size_t i = 0; i < c.size; ++i) lines += c.b[i] == '\n';
+
+    u.strs = malloc(sizeof(const char *) * lines * 2);
+    u.lens = malloc(sizeof(int) * lines * 2);
+    u.base = malloc(sizeof(struct uri) * lines);
+    u.link = malloc(sizeof(struct uri) * lines);
+    if (!u.strs || !u.lens || !u.base || !u.link)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for (char *line = c.b, *end; line < c.b + c.size; line = end + 1)
+    {
+        if (!(end = memchr(line, '\n', c.b + c.size - line)))
+        {
+            end = c.b + c.size;
+        }
+        char *tab = memchr(line, '\t', end - line);
+        if (!tab) continue;
+
+        u.strs[u.str_count] = line;
+        u.lens[u.str_count++] = tab - line;
+        u.strs[u.str_count] = tab + 1;
+        u.lens[u.str_count++] = end - tab - 1;
+
+        u.base[u.pair_count] = uri_parse(line, tab - line);
+        u.link[u.pair_count++] = uri_parse(tab + 1, end - tab - 1);
+    }
+
+    bench_run("uri_parse", bench_uri_parse, &u, u.str_count, c.size);
+    bench_run("uri_abs", bench_uri_abs, &u, u.pair_count, c.size / 2);
+
+    free(u.strs);
+    free(u.lens);
+    free(u.base);
+    free(u.link);
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
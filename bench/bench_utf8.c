@@ -0,0 +1,44 @@
+#include "pch.h"
+#include "bench_common.h"
+
+/*
+ * bench_utf8.c
+ *
+ * Measures utf8_width over every line of the gemtext corpus (mostly ASCII,
+ * with some accented, CJK and punctuation characters mixed in)
+ */
+
+static void
+bench_utf8_width(void *data)
+{
+    const struct bench_corpus *const c = data;
+    const char *end = c->b + c->size, *nl;
+
+    size_t total = 0;
+    for (const char *line = c->b; line < end; line = nl + 1)
+    {
+        if (!(nl = memchr(line, '\n', end - line))) nl = end;
+        total += utf8_width(line, nl - line);
+    }
+
+    // Don't let the calls be optimised away
+    if (!total) printf("(no width?)\n");
+}
+
+int
+main(void)
+{
+    bench_init();
+
+    struct bench_corpus c = bench_corpus_load("doc.gmi");
+
+    int lines = 0;
+    for (size_t i = 0; i < c.size; ++i) lines += c.b[i] == '\n';
+
+    bench_run("utf8_width", bench_utf8_width, &c, lines, c.size);
+
+    bench_corpus_free(&c);
+    bench_deinit();
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "cache.h"
+#include "cache_index.h"
 #include "paths.h"
 #include "state.h"
 #include "tui.h"
@@ -101,7 +102,7 @@ cache_gen_filepath(
 
         // Check if this resource name is already used by a directory; if so
         // then this needs to become an 'index' file.
-        static struct stat path_stat;
+        struct stat path_stat;
         if (stat(canon_path, &path_stat) < 0)
         {
             // Path doesn't exist; all fine
@@ -170,13 +171,102 @@ cache_file_to_dir(const char *fpath)
 
 static struct cached_item *cache_get_next_item(void);
 
+/* Set the URI of a cached item */
+static void
+cache_item_set_uri(struct cached_item *item, const struct uri *uri)
+{
+    item->uri_strings.len = 0;
+    uri_pack(&item->uri, uri, &item->uri_strings);
+}
+
+/* Get the URI of a cached item */
+static inline struct uri *
+cache_item_uri(const struct cached_item *item, struct uri *uri)
+{
+    uri_unpack(uri, &item->uri, &item->uri_strings);
+    return uri;
+}
+
+#if CACHE_USE_DISK
+/* Get the path of a page in the disk cache (which may not be there) */
+void
+cache_item_path(const struct uri *uri, char *path, size_t path_size)
+{
+    cache_gen_filepath(uri, path, path_size, true);
+}
+#endif // CACHE_USE_DISK
+
+/*
+ * Read the content of a cached page (given as its URI string in the cache)
+ * without loading it, from memory or else from disk.  Returns a copy that the
+ * caller must free, or NULL if the page isn't cached
+ */
+char *
+cache_read(const char *uristr, size_t *size)
+{
+    char *data = NULL;
+
+    for (int i = 0; i < s_cache.count; ++i)
+    {
+        const struct cached_item *const item = &s_cache.items[i];
+#if CACHE_USE_DISK
+        if (item->uri.query_len || strcmp(item->uristr, uristr) != 0) continue;
+#else
+        struct uri item_uri;
+        char item_uristr[URI_STRING_MAX];
+        uri_str(cache_item_uri(item, &item_uri),
+            item_uristr, sizeof(item_uristr),
+            URI_FLAGS_NO_PORT_BIT |
+                URI_FLAGS_NO_TRAILING_SLASH_BIT |
+                URI_FLAGS_NO_GOPHER_ITEM_BIT |
+                URI_FLAGS_NO_QUERY_BIT);
+        if (item->uri.query_len || strcmp(item_uristr, uristr) != 0) continue;
+#endif
+
+        if (!(data = malloc(max(item->data_size, 1))))
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        memcpy(data, item->data, item->data_size);
+        *size = item->data_size;
+        return data;
+    }
+
+#if CACHE_USE_DISK
+    const struct uri uri = uri_parse(uristr, strlen(uristr));
+    char path[FILENAME_MAX];
+    cache_item_path(&uri, path, sizeof(path));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    long file_size;
+    if (fseek(fp, 0, SEEK_END) == 0 &&
+        (file_size = ftell(fp)) >= 0 &&
+        fseek(fp, 0, SEEK_SET) == 0 &&
+        (data = malloc(max(file_size, 1))) &&
+        fread(data, 1, file_size, fp) == (size_t)file_size)
+    {
+        *size = file_size;
+    }
+    else
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+#endif // CACHE_USE_DISK
+
+    return data;
+}
+
 int
 cache_init(void)
 {
     // Allocate in-memory cache
     s_cache.capacity = CACHE_ITEM_CAPACITY_INITIAL;
-    s_cache.items = malloc(
-        sizeof(struct cached_item) * s_cache.capacity);
+    s_cache.items = calloc(s_cache.capacity, sizeof(struct cached_item));
     s_cache.count = 0;
     s_cache.total_size = 0;
 
@@ -195,6 +285,10 @@ cache_init(void)
 
     if (cache_create_gem() != 0) return -1;
     if (cache_create_ph() != 0) return -1;
+
+    // Load the index of the disk cache and bring it up to date (which happens
+    // in the background)
+    cache_index_init();
 #endif // CACHE_USE_DISK
 
     return 0;
@@ -212,6 +306,10 @@ cache_deinit(void)
     FILE *fp, *fp_meta, *fp_meta_tmp;
     char path[FILENAME_MAX];
 
+    // Stop indexing before the cache files are written (the index has every
+    // page pushed to the cache by now)
+    cache_index_deinit();
+
     /* Open the temporary metadata file for writing */
     if (!(fp_meta_tmp = fopen(path_get(PATH_ID_CACHE_META_TMP), "w")))
         goto abort_flush;
@@ -226,7 +324,7 @@ cache_deinit(void)
     {
         const struct cached_item *const item = &s_cache.items[i];
 
-        if (*item->uri.query)
+        if (item->uri.query_len)
         {
             // Skip if the item has a query--we don't cache these pages
             continue;
@@ -239,7 +337,8 @@ cache_deinit(void)
         snprintf(path, sizeof(path),
             "%s/", path_get(CACHE_PATH_IDS[item->uri.protocol]));
         char *path_rel = path + strlen(path);
-        cache_gen_filepath(&item->uri,
+        struct uri item_uri;
+        cache_gen_filepath(cache_item_uri(item, &item_uri),
             path_rel, sizeof(path) - (path_rel - path), false);
 
         for (char *x = path_rel; *x; ++x)
@@ -373,8 +472,9 @@ abort_flush:
     /* Free everything */
     for (i = 0; i < s_cache.count; ++i)
     {
-        const struct cached_item *const item = &s_cache.items[i];
+        struct cached_item *const item = &s_cache.items[i];
         free(item->data);
+        uri_strings_free(&item->uri_strings);
     }
 
     // Deallocate
@@ -396,10 +496,12 @@ cache_find(
         !*uri->query) return false;
 
     // See if we have the URI cached in memory already
+    const uint32_t hash = uri_hash(uri);
     for (int i = 0; i < s_cache.count; ++i)
     {
         struct cached_item *item = &s_cache.items[i];
-        if (uri_cmp_notrailing(&item->uri, uri) != 0) continue;
+        if (uri_packed_cmp_notrailing(
+            &item->uri, &item->uri_strings, uri, hash) != 0) continue;
 
         // Page is cached; set it as the alternative recv buffer (instead of
         // memcpy'ing directly into the recv buffer)
@@ -445,6 +547,7 @@ cache_find(
 
     // Item which will be added to memory pretty soon
     struct cached_item item;
+    struct uri item_uri;
     item.data_size = 0;
     item.session.last_sel = -1;
     item.session.last_scroll = 0;
@@ -468,7 +571,7 @@ cache_find(
         enum cache_meta_info_id meta_id = CACHE_META_URI + 1;
 
         // Copy URI
-        item.uri = uri_parse(uri_string, uri_len);
+        item_uri = uri_parse(uri_string, uri_len);
         item.uristr_len = uri_len;
         strncpy(item.uristr, uri_string, uri_len);
 
@@ -553,7 +656,10 @@ cache_find(
         free(item.data);
         return false;
     }
+    // The slot keeps its string buffer for the URI
+    item.uri_strings = item_real->uri_strings;
     *item_real = item;
+    cache_item_set_uri(item_real, &item_uri);
     *o = item_real;
     return true;
 #endif // CACHE_USE_DISK
@@ -574,10 +680,12 @@ cache_push_current(void)
         g_state.uri.protocol == PROTOCOL_INTERNAL) return NULL;
 
     // Check if the URI is in the cache already; so we can update it
+    const uint32_t hash = uri_hash(&g_state.uri);
     for (int i = 0; i < s_cache.count; ++i)
     {
         struct cached_item *m = &s_cache.items[i];
-        if (uri_cmp_notrailing(&m->uri, &g_state.uri) != 0) continue;
+        if (uri_packed_cmp_notrailing(
+            &m->uri, &m->uri_strings, &g_state.uri, hash) != 0) continue;
 
         item = m;
         s_cache.total_size -= m->data_size;
@@ -597,7 +705,7 @@ cache_push_current(void)
         return NULL;
     }
 
-    item->uri = g_state.uri;
+    cache_item_set_uri(item, &g_state.uri);
     item->timestamp = time(NULL);
     item->mime = g_recv->mime;
     item->data_size = g_recv->size;
@@ -609,11 +717,11 @@ cache_push_current(void)
 #if CACHE_USE_DISK
     // Disk-cache only stuff.  Not applied to items which have queries as we
     // don't store them on-disk
-    if (!*item->uri.query)
+    if (!item->uri.query_len)
     {
         // Write URI string
         item->uristr_len = uri_str(
-            &item->uri,
+            &g_state.uri,
             item->uristr,
             sizeof(item->uristr),
             URI_FLAGS_NO_PORT_BIT |
@@ -630,6 +738,10 @@ cache_push_current(void)
         EVP_DigestUpdate(ctx, item->data, item->data_size);
         EVP_DigestFinal_ex(ctx, item->hash, &item->hash_len);
         EVP_MD_CTX_free(ctx);
+
+        // Index the page so it can be found in internal:search
+        cache_index_push(item->uristr, item->data, item->data_size,
+            &item->mime, item->hash, item->hash_len);
     }
 #endif // CACHE_USE_DISK
 
@@ -31,6 +31,8 @@
  *   type, etc.)
  * + Perhaps "versions" of cached items can be kept?
  * + May possibly look into compression of local cache? (lz4 or gzip should do)
+ * + Cached pages are indexed so they can be searched through while offline
+ *   (see cache_index.h)
  * + We may also consider caching some status codes, namely INPUT ones, this
  *   will allow users to run search queries basically immediately.
  * + URIs with queries are not cached at all at the moment due mainly to
@@ -47,8 +49,9 @@
 // Represents and in-memory cached item
 struct cached_item
 {
-    // The URI of the cached item
-    struct uri uri;
+    // The URI of the cached item, packed into the item's own strings
+    struct uri_packed uri;
+    struct uri_strings uri_strings;
 
 #if CACHE_USE_DISK
     // A string of the URI, so we don't have to keep re-writing it (only used
@@ -100,5 +103,9 @@ struct cached_item *cache_push_current(void);
 bool cache_find(
     const struct uri *restrict const,
     struct cached_item **restrict const);
+char *cache_read(const char *, size_t *);
+#if CACHE_USE_DISK
+void cache_item_path(const struct uri *, char *, size_t);
+#endif
 
 #endif
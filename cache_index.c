@@ -0,0 +1,1228 @@
+#include "pch.h"
+#include "cache.h"
+#include "cache_index.h"
+#include "paths.h"
+#include "state.h"
+#include "tui.h"
+#include "tui_input_prompt.h"
+#include "uri.h"
+
+// First line of the index file, so older (or foreign) files are ignored
+#define CACHE_INDEX_MAGIC "sr71 index 1\n"
+
+// The terms and title of a page, worked out before it's added to the index
+struct cache_index_page
+{
+    char (*terms)[CACHE_INDEX_TERM_MAX + 1];
+    uint32_t term_count, term_capacity;
+
+    char title[CACHE_INDEX_TITLE_MAX + 1];
+};
+
+// A page waiting to be indexed by the worker thread
+struct cache_index_job
+{
+    char *uri, *data;
+    size_t size;
+    char mime[MIME_TYPE_MAX];
+    char hash[EVP_MAX_MD_SIZE * 2 + 1];
+
+    struct cache_index_job *next;
+};
+
+static struct
+{
+    // The index, which is locked while the worker adds to it
+    struct cache_index index;
+    pthread_mutex_t lock;
+
+    // Pages waiting to be indexed, and whether the worker should stop once
+    // they're done
+    struct cache_index_job *head, *tail;
+    bool quit;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;
+
+    // Whether the worker is running, whether it has loaded the index from
+    // disk, and whether it's still indexing pages that were already in the
+    // disk cache
+    pthread_t thread;
+    bool running, loaded, catching_up;
+    pthread_cond_t loaded_cond;
+} s_index =
+{
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .queue_lock = PTHREAD_MUTEX_INITIALIZER,
+    .queue_cond = PTHREAD_COND_INITIALIZER,
+    .loaded_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Make sure an array has room for the given number of elements */
+static void
+cache_index_reserve(void **p, uint32_t *capacity, uint32_t count, size_t size)
+{
+    if (*capacity >= count) return;
+
+    uint32_t new_capacity = max(*capacity * 2, 16);
+    for (; new_capacity < count; new_capacity *= 2);
+
+    void *const tmp = realloc(*p, new_capacity * size);
+    if (!tmp)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    *p = tmp;
+    *capacity = new_capacity;
+}
+
+/* Add a string to the pool, returning its offset */
+static uint32_t
+cache_index_pool_add(struct cache_index *x, const char *s)
+{
+    const uint32_t len = strlen(s) + 1, offset = x->pool_len;
+    cache_index_reserve((void **)&x->pool,
+        &x->pool_capacity, x->pool_len + len, 1);
+    memcpy(x->pool + offset, s, len);
+    x->pool_len += len;
+    return offset;
+}
+
+/*
+ * Find the slot of a string in one of the hash tables; either the one that
+ * has it, or the empty one where it would go
+ */
+static uint32_t *
+cache_index_slot(
+    const struct cache_index *x,
+    uint32_t *table,
+    uint32_t capacity,
+    bool docs,
+    const char *s)
+{
+    for (uint32_t i = fnv1a(FNV1A_BASIS, s, strlen(s)) & (capacity - 1);;
+        i = (i + 1) & (capacity - 1))
+    {
+        if (!table[i]) return &table[i];
+
+        const uint32_t offset = docs
+            ? x->docs[table[i] - 1].uri
+            : x->terms[table[i] - 1].name;
+        if (strcmp(x->pool + offset, s) == 0) return &table[i];
+    }
+}
+
+/* Build the hash tables again, with room for at least the given counts */
+static void
+cache_index_rehash(struct cache_index *x, uint32_t docs, uint32_t terms)
+{
+    if (docs * 2 > x->doc_table_capacity)
+    {
+        for (x->doc_table_capacity = max(x->doc_table_capacity, 64);
+            docs * 2 > x->doc_table_capacity;
+            x->doc_table_capacity *= 2);
+        free(x->doc_table);
+        x->doc_table = calloc(x->doc_table_capacity, sizeof(uint32_t));
+        if (!x->doc_table)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+
+        for (uint32_t i = 0; i < x->doc_count; ++i)
+        {
+            if (!x->docs[i].alive) continue;
+            *cache_index_slot(x, x->doc_table, x->doc_table_capacity, true,
+                x->pool + x->docs[i].uri) = i + 1;
+        }
+    }
+
+    if (terms * 2 > x->term_table_capacity)
+    {
+        for (x->term_table_capacity = max(x->term_table_capacity, 64);
+            terms * 2 > x->term_table_capacity;
+            x->term_table_capacity *= 2);
+        free(x->term_table);
+        x->term_table = calloc(x->term_table_capacity, sizeof(uint32_t));
+        if (!x->term_table)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+
+        for (uint32_t i = 0; i < x->term_count; ++i)
+        {
+            *cache_index_slot(x, x->term_table, x->term_table_capacity, false,
+                x->pool + x->terms[i].name) = i + 1;
+        }
+    }
+}
+
+/* Find a page by URI, or -1 */
+static int64_t
+cache_index_find_doc(const struct cache_index *x, const char *uri)
+{
+    if (!x->doc_table) return -1;
+    const uint32_t *const slot = cache_index_slot(
+        x, x->doc_table, x->doc_table_capacity, true, uri);
+    return *slot ? (int64_t)*slot - 1 : -1;
+}
+
+/* Find a term, or -1 */
+static int64_t
+cache_index_find_term(const struct cache_index *x, const char *name)
+{
+    if (!x->term_table) return -1;
+    const uint32_t *const slot = cache_index_slot(
+        x, x->term_table, x->term_table_capacity, false, name);
+    return *slot ? (int64_t)*slot - 1 : -1;
+}
+
+/* Add a page, marking any older number of the same page as dead */
+static uint32_t
+cache_index_new_doc(
+    struct cache_index *x,
+    const char *uri,
+    const char *mime,
+    const char *hash,
+    const char *title,
+    bool fresh)
+{
+    cache_index_rehash(x,
+        x->doc_count - x->dead_count + 1, x->term_count);
+
+    uint32_t *const slot = cache_index_slot(
+        x, x->doc_table, x->doc_table_capacity, true, uri);
+    if (*slot)
+    {
+        x->docs[*slot - 1].alive = false;
+        ++x->dead_count;
+    }
+
+    cache_index_reserve((void **)&x->docs,
+        &x->doc_capacity, x->doc_count + 1, sizeof(struct cache_index_doc));
+    struct cache_index_doc *const doc = &x->docs[x->doc_count];
+    doc->uri = cache_index_pool_add(x, uri);
+    doc->hash = cache_index_pool_add(x, hash);
+    doc->mime = cache_index_pool_add(x, mime);
+    doc->title = cache_index_pool_add(x, title);
+    doc->alive = true;
+    doc->fresh = fresh;
+
+    *slot = ++x->doc_count;
+    return x->doc_count - 1;
+}
+
+/* Find a term, adding it if it's new */
+static struct cache_index_term *
+cache_index_get_term(struct cache_index *x, const char *name)
+{
+    cache_index_rehash(x,
+        x->doc_count - x->dead_count, x->term_count + 1);
+
+    uint32_t *const slot = cache_index_slot(
+        x, x->term_table, x->term_table_capacity, false, name);
+    if (*slot) return &x->terms[*slot - 1];
+
+    cache_index_reserve((void **)&x->terms, &x->term_capacity,
+        x->term_count + 1, sizeof(struct cache_index_term));
+    struct cache_index_term *const t = &x->terms[x->term_count];
+    memset(t, 0, sizeof(struct cache_index_term));
+    t->name = cache_index_pool_add(x, name);
+
+    *slot = ++x->term_count;
+    return t;
+}
+
+/* Add a page to a term's postings (pages have to be added in order) */
+static void
+cache_index_post(struct cache_index_term *t, uint32_t doc)
+{
+    cache_index_reserve((void **)&t->postings,
+        &t->postings_capacity, t->postings_len + 5, 1);
+
+    uint32_t delta = t->doc_count ? doc - t->last_doc : doc;
+    for (; delta >= 0x80; delta >>= 7)
+    {
+        t->postings[t->postings_len++] = (delta & 0x7f) | 0x80;
+    }
+    t->postings[t->postings_len++] = delta;
+
+    t->last_doc = doc;
+    ++t->doc_count;
+}
+
+/* Read a varint from postings, or NULL if it runs past end */
+static const uint8_t *
+cache_index_varint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; p < end && shift < 32; shift += 7)
+    {
+        *v |= (uint32_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) return p;
+    }
+    return NULL;
+}
+
+void
+cache_index_free(struct cache_index *x)
+{
+    for (uint32_t i = 0; i < x->term_count; ++i) free(x->terms[i].postings);
+    free(x->terms);
+    free(x->docs);
+    free(x->pool);
+    free(x->doc_table);
+    free(x->term_table);
+    memset(x, 0, sizeof(struct cache_index));
+}
+
+/*
+ * Find the next term in the text from *p, lowercased and cut to
+ * CACHE_INDEX_TERM_MAX bytes.  Terms are runs of letters, digits and
+ * non-ASCII characters.  Returns where it begins (moving *p past it), or NULL
+ * if there are no more
+ */
+static const char *
+cache_index_next_term(const char **p, const char *end, char *term)
+{
+#define IS_TERM_BYTE(c) \
+    (isalnum((unsigned char)(c)) || (unsigned char)(c) >= 0x80)
+    const char *c = *p;
+    for (; c < end && !IS_TERM_BYTE(*c); ++c);
+    if (c >= end)
+    {
+        *p = end;
+        return NULL;
+    }
+
+    const char *const begin = c;
+    size_t len = 0;
+    for (; c < end && IS_TERM_BYTE(*c); ++c)
+    {
+        if (len < CACHE_INDEX_TERM_MAX) term[len++] = tolower(*c);
+    }
+    term[len] = '\0';
+    *p = c;
+    return begin;
+#undef IS_TERM_BYTE
+}
+
+/*
+ * Get the part of a line of a page that is shown, which is all that is indexed
+ * (only the display strings of gophermaps are)
+ */
+static const char *
+cache_index_shown(
+    const char *line,
+    const char *line_end,
+    bool gophermap,
+    const char **end)
+{
+    *end = line_end;
+    if (!gophermap) return line;
+
+    if (line >= line_end) return line_end;
+    const char *const tab = memchr(line, '\t', line_end - line);
+    if (tab) *end = tab;
+    return line + 1;
+}
+
+/* Copy text, cut to fit, with control characters replaced by spaces */
+static void
+cache_index_copy_text(char *o, size_t size, const char *s, const char *end)
+{
+    size_t len = min((size_t)(end - s), size - 1);
+
+    // Don't cut a character in half
+    if (s + len < end) for (; len && (s[len] & 0xc0) == 0x80; --len);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        o[i] = (unsigned char)s[i] < 0x20 || s[i] == 0x7f ? ' ' : s[i];
+    }
+    o[len] = '\0';
+}
+
+static int
+cache_index_compare_terms(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/* Work out the terms (each once) and title of a page */
+static void
+cache_index_page_read(
+    struct cache_index_page *page,
+    const char *mime,
+    const char *data,
+    size_t size)
+{
+    const bool gophermap = strcmp(mime, MIME_GOPHERMAP) == 0,
+        gemtext = strcmp(mime, MIME_GEMTEXT) == 0;
+    const char *const data_end = data + size;
+
+    page->term_count = 0;
+    page->title[0] = '\0';
+
+    for (const char *line = data, *line_end; line < data_end;
+        line = line_end + 1)
+    {
+        line_end = memchr(line, '\n', data_end - line);
+        if (!line_end) line_end = data_end;
+
+        const char *end, *p = cache_index_shown(
+            line, line_end, gophermap, &end);
+
+        // The title is the first heading of gemtext, or else the first line
+        // with something on it
+        if (!page->title[0] && (!gemtext || *line == '#'))
+        {
+            const char *title = p;
+            if (gemtext) for (; title < end && *title == '#'; ++title);
+            for (; title < end && isspace((unsigned char)*title); ++title);
+            cache_index_copy_text(page->title, sizeof(page->title),
+                title, end);
+        }
+
+        char term[CACHE_INDEX_TERM_MAX + 1];
+        while (cache_index_next_term(&p, end, term))
+        {
+            cache_index_reserve((void **)&page->terms,
+                &page->term_capacity,
+                page->term_count + 1,
+                sizeof(*page->terms));
+            memcpy(page->terms[page->term_count++], term, sizeof(term));
+        }
+    }
+
+    // Each term only needs to be posted once
+    qsort(page->terms, page->term_count,
+        sizeof(*page->terms), cache_index_compare_terms);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < page->term_count; ++i)
+    {
+        if (unique && strcmp(page->terms[unique - 1], page->terms[i]) == 0)
+        {
+            continue;
+        }
+        if (unique != i)
+        {
+            memcpy(page->terms[unique], page->terms[i], sizeof(*page->terms));
+        }
+        ++unique;
+    }
+    page->term_count = unique;
+}
+
+/* Add a page whose terms have been worked out to the index */
+static void
+cache_index_page_add(
+    struct cache_index *x,
+    const char *uri,
+    const char *mime,
+    const char *hash,
+    const struct cache_index_page *page,
+    bool fresh)
+{
+    const uint32_t doc = cache_index_new_doc(
+        x, uri, mime, hash, page->title, fresh);
+
+    for (uint32_t i = 0; i < page->term_count; ++i)
+    {
+        cache_index_post(cache_index_get_term(x, page->terms[i]), doc);
+    }
+}
+
+/* Index a page; fresh if it was pushed to the cache this session */
+void
+cache_index_add(
+    struct cache_index *x,
+    const char *uri,
+    const char *mime,
+    const char *data,
+    size_t size,
+    const char *hash,
+    bool fresh)
+{
+    struct cache_index_page page = { 0 };
+    cache_index_page_read(&page, mime, data, size);
+    cache_index_page_add(x, uri, mime, hash, &page, fresh);
+    free(page.terms);
+}
+
+/* Get the (unique) terms of a query, returning how many there are */
+static int
+cache_index_query_terms(
+    const char *query,
+    char terms[CACHE_INDEX_QUERY_TERMS_MAX][CACHE_INDEX_TERM_MAX + 1])
+{
+    int count = 0;
+    const char *const end = query + strlen(query);
+    char term[CACHE_INDEX_TERM_MAX + 1];
+    while (count < CACHE_INDEX_QUERY_TERMS_MAX &&
+        cache_index_next_term(&query, end, term))
+    {
+        int i = 0;
+        for (; i < count && strcmp(terms[i], term) != 0; ++i);
+        if (i == count) strcpy(terms[count++], term);
+    }
+    return count;
+}
+
+/*
+ * Find the pages that mention every term of a query.  Their numbers are put
+ * (in order, so the most recently indexed is last) in a new array at *docs,
+ * which the caller must free; returns how many there are
+ */
+uint32_t
+cache_index_query(
+    const struct cache_index *x,
+    const char *query,
+    uint32_t **docs)
+{
+    *docs = NULL;
+
+    char names[CACHE_INDEX_QUERY_TERMS_MAX][CACHE_INDEX_TERM_MAX + 1];
+    const int term_count = cache_index_query_terms(query, names);
+    if (!term_count) return 0;
+
+    // Terms that are in the fewest pages go first, so there's as little as
+    // possible to check against the rest
+    const struct cache_index_term *terms[CACHE_INDEX_QUERY_TERMS_MAX];
+    for (int i = 0; i < term_count; ++i)
+    {
+        const int64_t t = cache_index_find_term(x, names[i]);
+        if (t < 0) return 0;
+
+        int j = i;
+        for (; j > 0 && terms[j - 1]->doc_count > x->terms[t].doc_count; --j)
+        {
+            terms[j] = terms[j - 1];
+        }
+        terms[j] = &x->terms[t];
+    }
+
+    uint32_t *const result = malloc(terms[0]->doc_count * sizeof(uint32_t));
+    if (!result)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    uint32_t count = 0;
+    const uint8_t *p = terms[0]->postings,
+        *end = p + terms[0]->postings_len;
+    for (uint32_t i = 0, doc = 0, delta;
+        i < terms[0]->doc_count &&
+            (p = cache_index_varint(p, end, &delta));
+        ++i)
+    {
+        doc += delta;
+        if (x->docs[doc].alive) result[count++] = doc;
+    }
+
+    // Keep just the pages that are in the other terms' postings too
+    for (int i = 1; i < term_count && count; ++i)
+    {
+        const struct cache_index_term *const t = terms[i];
+        p = t->postings;
+        end = p + t->postings_len;
+
+        uint32_t kept = 0, doc = 0, delta;
+        for (uint32_t j = 0, k = 0;
+            j < t->doc_count && k < count &&
+                (p = cache_index_varint(p, end, &delta));
+            ++j)
+        {
+            doc += delta;
+            for (; k < count && result[k] < doc; ++k);
+            if (k < count && result[k] == doc) result[kept++] = result[k++];
+        }
+        count = kept;
+    }
+
+    if (!count)
+    {
+        free(result);
+        return 0;
+    }
+    *docs = result;
+    return count;
+}
+
+/* Drop the dead pages, numbering the rest again */
+static void
+cache_index_compact(struct cache_index *x)
+{
+    struct cache_index c = { 0 };
+
+    uint32_t *const map = malloc(x->doc_count * sizeof(uint32_t));
+    if (!map)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    for (uint32_t i = 0; i < x->doc_count; ++i)
+    {
+        const struct cache_index_doc *const doc = &x->docs[i];
+        map[i] = doc->alive
+            ? cache_index_new_doc(&c,
+                x->pool + doc->uri,
+                x->pool + doc->mime,
+                x->pool + doc->hash,
+                x->pool + doc->title,
+                doc->fresh)
+            : UINT32_MAX;
+    }
+
+    for (uint32_t i = 0; i < x->term_count; ++i)
+    {
+        const struct cache_index_term *const t = &x->terms[i];
+        struct cache_index_term *new_term = NULL;
+
+        const uint8_t *p = t->postings, *const end = p + t->postings_len;
+        for (uint32_t j = 0, doc = 0, delta;
+            j < t->doc_count && (p = cache_index_varint(p, end, &delta));
+            ++j)
+        {
+            doc += delta;
+            if (map[doc] == UINT32_MAX) continue;
+
+            // Terms that were only in dead pages are dropped
+            if (!new_term)
+            {
+                new_term = cache_index_get_term(&c, x->pool + t->name);
+            }
+            cache_index_post(new_term, map[doc]);
+        }
+    }
+
+    free(map);
+    cache_index_free(x);
+    *x = c;
+}
+
+static void
+cache_index_write_u32(FILE *fp, uint32_t v)
+{
+    fwrite(&v, sizeof(uint32_t), 1, fp);
+}
+
+/* Write the index to disk (via a temporary file, so it's never half-done) */
+static void
+cache_index_save(struct cache_index *x)
+{
+    // Only worth rewriting everything when there are a fair few dead pages
+    if (x->dead_count && x->dead_count * 4 >= x->doc_count)
+    {
+        cache_index_compact(x);
+    }
+
+    FILE *fp = fopen(path_get(PATH_ID_CACHE_INDEX_TMP), "wb");
+    if (!fp) return;
+
+    fputs(CACHE_INDEX_MAGIC, fp);
+    cache_index_write_u32(fp, x->doc_count);
+    cache_index_write_u32(fp, x->term_count);
+    cache_index_write_u32(fp, x->pool_len);
+    fwrite(x->pool, 1, x->pool_len, fp);
+
+    for (uint32_t i = 0; i < x->doc_count; ++i)
+    {
+        const struct cache_index_doc *const doc = &x->docs[i];
+        cache_index_write_u32(fp, doc->uri);
+        cache_index_write_u32(fp, doc->hash);
+        cache_index_write_u32(fp, doc->mime);
+        cache_index_write_u32(fp, doc->title);
+        fputc(doc->alive, fp);
+    }
+
+    for (uint32_t i = 0; i < x->term_count; ++i)
+    {
+        const struct cache_index_term *const t = &x->terms[i];
+        cache_index_write_u32(fp, t->name);
+        cache_index_write_u32(fp, t->doc_count);
+        cache_index_write_u32(fp, t->last_doc);
+        cache_index_write_u32(fp, t->postings_len);
+        fwrite(t->postings, 1, t->postings_len, fp);
+    }
+
+    const bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed ||
+        rename(path_get(PATH_ID_CACHE_INDEX_TMP),
+            path_get(PATH_ID_CACHE_INDEX)) != 0)
+    {
+        remove(path_get(PATH_ID_CACHE_INDEX_TMP));
+    }
+}
+
+/* Read bytes from the loaded file, failing if it runs out */
+static bool
+cache_index_read(const char **p, const char *end, void *o, size_t n)
+{
+    if ((size_t)(end - *p) < n) return false;
+    memcpy(o, *p, n);
+    *p += n;
+    return true;
+}
+
+/* Check that a string is in the pool */
+static bool
+cache_index_valid_string(const struct cache_index *x, uint32_t offset)
+{
+    return offset < x->pool_len;
+}
+
+/*
+ * Read the index from disk.  If it's missing or doesn't make sense then the
+ * index is left empty, and will be built again from the disk cache
+ */
+static void
+cache_index_load(struct cache_index *x)
+{
+    FILE *fp = fopen(path_get(PATH_ID_CACHE_INDEX), "rb");
+    if (!fp) return;
+
+    char *buf = NULL;
+    long size;
+    if (fseek(fp, 0, SEEK_END) != 0 ||
+        (size = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) != 0 ||
+        !(buf = malloc(size + 1)) ||
+        fread(buf, 1, size, fp) != (size_t)size)
+    {
+        free(buf);
+        fclose(fp);
+        return;
+    }
+    fclose(fp);
+
+    const char *p = buf, *const end = buf + size;
+    uint32_t doc_count, term_count;
+    if ((size_t)size < strlen(CACHE_INDEX_MAGIC) ||
+        memcmp(p, CACHE_INDEX_MAGIC, strlen(CACHE_INDEX_MAGIC)) != 0)
+    {
+        goto fail;
+    }
+    p += strlen(CACHE_INDEX_MAGIC);
+
+    if (!cache_index_read(&p, end, &doc_count, sizeof(uint32_t)) ||
+        !cache_index_read(&p, end, &term_count, sizeof(uint32_t)) ||
+        !cache_index_read(&p, end, &x->pool_len, sizeof(uint32_t)) ||
+        (size_t)(end - p) < x->pool_len ||
+        (x->pool_len && p[x->pool_len - 1] != '\0'))
+    {
+        goto fail;
+    }
+    cache_index_reserve((void **)&x->pool,
+        &x->pool_capacity, x->pool_len, 1);
+    cache_index_read(&p, end, x->pool, x->pool_len);
+
+    for (uint32_t i = 0; i < doc_count; ++i)
+    {
+        struct cache_index_doc doc = { 0 };
+        uint8_t alive;
+        if (!cache_index_read(&p, end, &doc.uri, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &doc.hash, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &doc.mime, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &doc.title, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &alive, 1) ||
+            !cache_index_valid_string(x, doc.uri) ||
+            !cache_index_valid_string(x, doc.hash) ||
+            !cache_index_valid_string(x, doc.mime) ||
+            !cache_index_valid_string(x, doc.title))
+        {
+            goto fail;
+        }
+        doc.alive = alive;
+        x->dead_count += !alive;
+
+        cache_index_reserve((void **)&x->docs, &x->doc_capacity,
+            x->doc_count + 1, sizeof(struct cache_index_doc));
+        x->docs[x->doc_count++] = doc;
+    }
+
+    for (uint32_t i = 0; i < term_count; ++i)
+    {
+        struct cache_index_term t = { 0 };
+        if (!cache_index_read(&p, end, &t.name, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &t.doc_count, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &t.last_doc, sizeof(uint32_t)) ||
+            !cache_index_read(&p, end, &t.postings_len, sizeof(uint32_t)) ||
+            !cache_index_valid_string(x, t.name) ||
+            (size_t)(end - p) < t.postings_len)
+        {
+            goto fail;
+        }
+
+        // Make sure the postings can be walked without going astray
+        const uint8_t *q = (const uint8_t *)p,
+            *const q_end = q + t.postings_len;
+        uint32_t doc = 0, delta;
+        for (uint32_t j = 0; j < t.doc_count; ++j)
+        {
+            if (!(q = cache_index_varint(q, q_end, &delta)) ||
+                (j && !delta) ||
+                (doc += delta) >= x->doc_count)
+            {
+                goto fail;
+            }
+        }
+        if (q != q_end || (t.doc_count && doc != t.last_doc)) goto fail;
+
+        t.postings = malloc(max(t.postings_len, 1));
+        if (!t.postings)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        t.postings_capacity = max(t.postings_len, 1);
+        cache_index_read(&p, end, t.postings, t.postings_len);
+
+        cache_index_reserve((void **)&x->terms, &x->term_capacity,
+            x->term_count + 1, sizeof(struct cache_index_term));
+        x->terms[x->term_count++] = t;
+    }
+
+    cache_index_rehash(x, x->doc_count - x->dead_count, x->term_count);
+    free(buf);
+    return;
+
+fail:
+    free(buf);
+    cache_index_free(x);
+}
+
+/* Whether the worker has been told to stop */
+static bool
+cache_index_quitting(void)
+{
+    pthread_mutex_lock(&s_index.queue_lock);
+    const bool quit = s_index.quit;
+    pthread_mutex_unlock(&s_index.queue_lock);
+    return quit;
+}
+
+/* Index a page (on the worker thread) */
+static void
+cache_index_worker_add(
+    struct cache_index_page *page,
+    const char *uri,
+    const char *mime,
+    const char *data,
+    size_t size,
+    const char *hash,
+    bool fresh)
+{
+    // Only adding to the index needs it locked
+    cache_index_page_read(page, mime, data, size);
+
+    pthread_mutex_lock(&s_index.lock);
+    cache_index_page_add(&s_index.index, uri, mime, hash, page, fresh);
+    pthread_mutex_unlock(&s_index.lock);
+}
+
+/* Index the pages that are waiting (on the worker thread) */
+static void
+cache_index_worker_run_jobs(struct cache_index_page *page)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&s_index.queue_lock);
+        struct cache_index_job *const job = s_index.head;
+        if (job && !(s_index.head = job->next)) s_index.tail = NULL;
+        pthread_mutex_unlock(&s_index.queue_lock);
+
+        if (!job) return;
+
+        cache_index_worker_add(page,
+            job->uri, job->mime, job->data, job->size, job->hash, true);
+
+        free(job->uri);
+        free(job->data);
+        free(job);
+    }
+}
+
+/*
+ * Index any pages in the disk cache that the index hasn't got, or that have
+ * changed since they were indexed (on the worker thread)
+ */
+static void
+cache_index_worker_catch_up(struct cache_index_page *page)
+{
+    FILE *fp = fopen(path_get(PATH_ID_CACHE_META), "r");
+    if (!fp) return;
+
+    char *line = NULL, *data = NULL;
+    size_t line_size = 0, data_size = 0;
+    for (ssize_t len; (len = getline(&line, &line_size, fp)) != -1;)
+    {
+        // Pages pushed to the cache are more important
+        cache_index_worker_run_jobs(page);
+        if (cache_index_quitting()) break;
+
+        // URI, size, MIME type, timestamp and checksum, separated by tabs
+        if (len && line[len - 1] == '\n') line[--len] = '\0';
+        char *fields[5], *save;
+        int field_count = 0;
+        for (char *f = strtok_r(line, "\t", &save);
+            f && field_count < 5;
+            f = strtok_r(NULL, "\t", &save))
+        {
+            fields[field_count++] = f;
+        }
+        if (field_count < 5 || strncmp(fields[2], "text/", 5) != 0) continue;
+
+        pthread_mutex_lock(&s_index.lock);
+        const int64_t doc = cache_index_find_doc(&s_index.index, fields[0]);
+        const bool indexed = doc >= 0 &&
+            (s_index.index.docs[doc].fresh ||
+            strcmp(s_index.index.pool + s_index.index.docs[doc].hash,
+                fields[4]) == 0);
+        pthread_mutex_unlock(&s_index.lock);
+        if (indexed) continue;
+
+        // Read the page from the disk cache
+        const struct uri uri = uri_parse(fields[0], strlen(fields[0]));
+        char path[FILENAME_MAX];
+        cache_item_path(&uri, path, sizeof(path));
+
+        FILE *page_fp = fopen(path, "rb");
+        if (!page_fp) continue;
+        const size_t size = strtoul(fields[1], NULL, 10);
+        if (size > data_size)
+        {
+            free(data);
+            data_size = size;
+            data = malloc(data_size);
+            if (!data)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(-1);
+            }
+        }
+        const bool read = fread(data, 1, size, page_fp) == size;
+        fclose(page_fp);
+        if (!read) continue;
+
+        cache_index_worker_add(page,
+            fields[0], fields[2], data, size, fields[4], false);
+    }
+
+    free(line);
+    free(data);
+    fclose(fp);
+}
+
+static void *
+cache_index_worker(void *arg)
+{
+    (void)arg;
+    struct cache_index_page page = { 0 };
+
+    pthread_mutex_lock(&s_index.lock);
+    cache_index_load(&s_index.index);
+    pthread_mutex_unlock(&s_index.lock);
+
+    pthread_mutex_lock(&s_index.queue_lock);
+    s_index.loaded = true;
+    pthread_cond_broadcast(&s_index.loaded_cond);
+    pthread_mutex_unlock(&s_index.queue_lock);
+
+    cache_index_worker_catch_up(&page);
+
+    pthread_mutex_lock(&s_index.queue_lock);
+    s_index.catching_up = false;
+    for (;;)
+    {
+        while (!s_index.head && !s_index.quit)
+        {
+            pthread_cond_wait(&s_index.queue_cond, &s_index.queue_lock);
+        }
+        if (!s_index.head) break;
+
+        pthread_mutex_unlock(&s_index.queue_lock);
+        cache_index_worker_run_jobs(&page);
+        pthread_mutex_lock(&s_index.queue_lock);
+    }
+    pthread_mutex_unlock(&s_index.queue_lock);
+
+    free(page.terms);
+    return NULL;
+}
+
+/* Start the worker, which loads the index and catches up with the cache */
+void
+cache_index_init(void)
+{
+    s_index.quit = false;
+    s_index.loaded = false;
+    s_index.catching_up = true;
+
+    // Signals are for the main thread (and its event loop) to handle, so the
+    // worker starts with them all blocked
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    s_index.running = pthread_create(
+        &s_index.thread, NULL, cache_index_worker, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* Finish indexing the pages that are waiting, and write the index to disk */
+void
+cache_index_deinit(void)
+{
+    if (!s_index.running) return;
+
+    pthread_mutex_lock(&s_index.queue_lock);
+    s_index.quit = true;
+    pthread_cond_signal(&s_index.queue_cond);
+    pthread_mutex_unlock(&s_index.queue_lock);
+
+    pthread_join(s_index.thread, NULL);
+    s_index.running = false;
+
+    cache_index_save(&s_index.index);
+    cache_index_free(&s_index.index);
+}
+
+/* Queue a page that was pushed to the cache to be indexed */
+void
+cache_index_push(
+    const char *uri,
+    const char *data,
+    size_t size,
+    const struct mime *mime,
+    const unsigned char *hash,
+    unsigned hash_len)
+{
+    if (!s_index.running || strncmp(mime->str, "text/", 5) != 0) return;
+
+    struct cache_index_job *const job = malloc(
+        sizeof(struct cache_index_job));
+    if (!job ||
+        !(job->uri = strdup(uri)) ||
+        !(job->data = malloc(max(size, 1))))
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    memcpy(job->data, data, size);
+    job->size = size;
+    strcpy(job->mime, mime->str);
+    for (unsigned i = 0; i < hash_len; ++i)
+    {
+        sprintf(job->hash + i * 2, "%02x", hash[i]);
+    }
+    job->hash[hash_len * 2] = '\0';
+    job->next = NULL;
+
+    pthread_mutex_lock(&s_index.queue_lock);
+    if (s_index.tail) s_index.tail->next = job;
+    else s_index.head = job;
+    s_index.tail = job;
+    pthread_cond_signal(&s_index.queue_cond);
+    pthread_mutex_unlock(&s_index.queue_lock);
+}
+
+/* Append formatted text to the receive buffer */
+static void
+cache_index_say(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    const int bytes = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    recv_buffer_check_size(g_recv->size + bytes + 1);
+    va_start(args, fmt);
+    vsnprintf(g_recv->b + g_recv->size, bytes + 1, fmt, args);
+    va_end(args);
+    g_recv->size += bytes;
+}
+
+/*
+ * Show the line of a page where any of the terms is first mentioned, cut
+ * down around it if it's long
+ */
+static void
+cache_index_say_snippet(
+    const char *mime,
+    const char *data,
+    size_t size,
+    char terms[CACHE_INDEX_QUERY_TERMS_MAX][CACHE_INDEX_TERM_MAX + 1],
+    int term_count)
+{
+    const bool gophermap = strcmp(mime, MIME_GOPHERMAP) == 0;
+    const char *const data_end = data + size;
+
+    for (const char *line = data, *line_end; line < data_end;
+        line = line_end + 1)
+    {
+        line_end = memchr(line, '\n', data_end - line);
+        if (!line_end) line_end = data_end;
+
+        const char *end, *const shown = cache_index_shown(
+            line, line_end, gophermap, &end);
+
+        const char *p = shown, *word;
+        char term[CACHE_INDEX_TERM_MAX + 1];
+        while ((word = cache_index_next_term(&p, end, term)))
+        {
+            int i = 0;
+            for (; i < term_count && strcmp(terms[i], term) != 0; ++i);
+            if (i < term_count) break;
+        }
+        if (!word) continue;
+
+        // Leave out the line type of gemtext
+        const char *begin = shown;
+        if (!gophermap)
+        {
+            for (; begin < word && strchr("#*>=", *begin); ++begin);
+            for (; begin < word && isspace((unsigned char)*begin); ++begin);
+        }
+
+        const char *s = begin;
+        if (end - begin > CACHE_INDEX_SNIPPET_MAX)
+        {
+            s = word - begin > CACHE_INDEX_SNIPPET_MAX / 3
+                ? word - CACHE_INDEX_SNIPPET_MAX / 3
+                : begin;
+            for (; s > begin && (*s & 0xc0) == 0x80; --s);
+        }
+
+        char text[CACHE_INDEX_SNIPPET_MAX + 1];
+        cache_index_copy_text(text, sizeof(text), s, end);
+        cache_index_say("> %s%s%s\n",
+            s > begin ? "…" : "",
+            text,
+            s + strlen(text) < end ? "…" : "");
+        return;
+    }
+}
+
+/* Prompt completion callback for internal:search */
+static void
+cache_index_prompt_complete(void)
+{
+    struct uri uri = uri_parse(
+        URI_INTERNAL_SEARCH,
+        strlen(URI_INTERNAL_SEARCH));
+    uri_set_query(&uri, g_in->buffer);
+    tui_go_to_uri(&uri, true, true);
+}
+
+/*
+ * Displays the cached pages that mention every word of a query (as in the
+ * query component of internal:search?query) in a buffer
+ */
+int
+cache_index_display(const char *query_encoded)
+{
+    char query[URI_QUERY_MAX];
+    uri_decode(query, query_encoded, sizeof(query));
+
+    // Ask for a query if there isn't one
+    if (!*query)
+    {
+        tui_input_prompt_begin(
+            TUI_MODE_INPUT,
+            "Search cached pages: ", 0,
+            NULL,
+            cache_index_prompt_complete);
+        return -1;
+    }
+
+    if (!s_index.running)
+    {
+        tui_status_say("The cache isn't indexed");
+        return -1;
+    }
+
+    // Searching as the index is being loaded (just after starting) would
+    // find nothing, and it doesn't take long
+    pthread_mutex_lock(&s_index.queue_lock);
+    while (!s_index.loaded)
+    {
+        pthread_cond_wait(&s_index.loaded_cond, &s_index.queue_lock);
+    }
+    pthread_mutex_unlock(&s_index.queue_lock);
+
+    // The results are copied out, so the index doesn't need to stay locked
+    // while their pages are read for snippets
+    struct cache_index_result
+    {
+        char uri[URI_STRING_MAX];
+        char mime[MIME_TYPE_MAX];
+        char title[CACHE_INDEX_TITLE_MAX + 1];
+    } *results;
+
+    pthread_mutex_lock(&s_index.lock);
+    const struct cache_index *const x = &s_index.index;
+    uint32_t *docs;
+    const uint32_t count = cache_index_query(x, query, &docs);
+    const uint32_t shown = min(count, CACHE_INDEX_RESULTS_MAX);
+
+    results = malloc(max(shown, 1) * sizeof(struct cache_index_result));
+    if (!results)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    for (uint32_t i = 0; i < shown; ++i)
+    {
+        // Most recently indexed first
+        const struct cache_index_doc *const doc = &x->docs[docs[count - 1 - i]];
+        snprintf(results[i].uri, URI_STRING_MAX, "%s", x->pool + doc->uri);
+        snprintf(results[i].mime, MIME_TYPE_MAX, "%s", x->pool + doc->mime);
+        snprintf(results[i].title,
+            CACHE_INDEX_TITLE_MAX + 1, "%s", x->pool + doc->title);
+    }
+    free(docs);
+    pthread_mutex_unlock(&s_index.lock);
+
+    pthread_mutex_lock(&s_index.queue_lock);
+    const bool pending = s_index.catching_up || s_index.head;
+    pthread_mutex_unlock(&s_index.queue_lock);
+
+    g_recv->size = 0;
+    cache_index_say("# Cached pages mentioning \"%s\"\n\n", query);
+    if (!count) cache_index_say("No cached pages mention all of that.\n");
+    else if (count == 1) cache_index_say("1 cached page.\n");
+    else if (shown < count)
+    {
+        cache_index_say("%u cached pages; here are the %u most recently "
+            "cached.\n", count, shown);
+    }
+    else cache_index_say("%u cached pages, most recently cached first.\n",
+        count);
+    if (pending)
+    {
+        cache_index_say("The cache is still being indexed, so there may be "
+            "more.\n");
+    }
+
+    char terms[CACHE_INDEX_QUERY_TERMS_MAX][CACHE_INDEX_TERM_MAX + 1];
+    const int term_count = cache_index_query_terms(query, terms);
+    for (uint32_t i = 0; i < shown; ++i)
+    {
+        const struct cache_index_result *const r = &results[i];
+        cache_index_say("\n=> %s %s\n", r->uri, r->title);
+
+        size_t size;
+        char *const data = cache_read(r->uri, &size);
+        if (!data) continue;
+        cache_index_say_snippet(r->mime, data, size, terms, term_count);
+        free(data);
+    }
+    free(results);
+
+    mime_parse(&g_recv->mime, MIME_GEMTEXT, strlen(MIME_GEMTEXT));
+    tui_status_clear();
+    return 0;
+}
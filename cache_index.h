@@ -0,0 +1,112 @@
+#ifndef CACHE_INDEX_H
+#define CACHE_INDEX_H
+
+#include "mime.h"
+
+/*
+ * cache_index.h
+ *
+ * Full-text index of the disk cache, so that cached pages can be searched
+ * while offline (see internal:search).
+ *
+ * It's an inverted index: each term (a word, lowercased) has a postings list
+ * of the pages that it appears in, stored as varints of the difference from
+ * the previous page's number, so common words cost about a byte per page.
+ * Finding the pages that mention all the terms of a query is then just a
+ * matter of walking their lists together.
+ *
+ * Pages are indexed by a worker thread as they're pushed to the cache, and
+ * when the program starts, any pages in the disk cache that the index hasn't
+ * got (or that have changed since) are indexed too.  A page that's indexed
+ * again is given a new number, and its old one is just marked dead; dead pages
+ * are dropped when there are enough of them to be worth rewriting the index.
+ * The index is written to disk on exit.
+ */
+
+// Terms are cut to this many bytes
+#define CACHE_INDEX_TERM_MAX 32
+
+// Titles of pages are cut to this many bytes
+#define CACHE_INDEX_TITLE_MAX 80
+
+// Longest snippet of a page shown with a result, in bytes
+#define CACHE_INDEX_SNIPPET_MAX 100
+
+// Most terms in a query (the rest are ignored)
+#define CACHE_INDEX_QUERY_TERMS_MAX 16
+
+// A page in the index
+struct cache_index_doc
+{
+    // Offsets of its URI, checksum (in hex), MIME type and title in the
+    // string pool
+    uint32_t uri, hash, mime, title;
+
+    // Whether this is the page's current number; i.e. it hasn't been indexed
+    // again since
+    bool alive;
+
+    // Whether it was indexed this session (not saved); pages in the disk cache
+    // are older than these
+    bool fresh;
+};
+
+// A term in the index
+struct cache_index_term
+{
+    // Offset of the term in the string pool
+    uint32_t name;
+
+    // Number of each page that the term appears in, as varints of the
+    // difference from the previous number (the first is just the number)
+    uint8_t *postings;
+    uint32_t postings_len, postings_capacity;
+
+    // Number of pages in the list, and the last of them
+    uint32_t doc_count, last_doc;
+};
+
+struct cache_index
+{
+    struct cache_index_doc *docs;
+    uint32_t doc_count, doc_capacity, dead_count;
+
+    struct cache_index_term *terms;
+    uint32_t term_count, term_capacity;
+
+    // Strings of the documents and terms, each null-terminated
+    char *pool;
+    uint32_t pool_len, pool_capacity;
+
+    // Hash tables of the numbers (plus one, so zero is empty) of the pages by
+    // URI and of the terms by name
+    uint32_t *doc_table, *term_table;
+    uint32_t doc_table_capacity, term_table_capacity;
+};
+
+void cache_index_free(struct cache_index *);
+void cache_index_add(
+    struct cache_index *,
+    const char *,
+    const char *,
+    const char *,
+    size_t,
+    const char *,
+    bool);
+uint32_t cache_index_query(
+    const struct cache_index *,
+    const char *,
+    uint32_t **);
+
+void cache_index_init(void);
+void cache_index_deinit(void);
+void cache_index_push(
+    const char *,
+    const char *,
+    size_t,
+    const struct mime *,
+    const unsigned char *,
+    unsigned);
+int cache_index_display(const char *);
+
+#endif
@@ -41,6 +41,10 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 // hostname in a brighter colour, and will highlight gopher item type.
 #define STATUS_LINE_FANCY_URI_FORMAT 1
 
+// Show how long the last paint, typeset and line breaking took (and bytes
+// written for the last frame) in the status line.  See also internal:perf
+#define STATUS_LINE_PERF 0
+
 #define LIST_BULLET_CHAR "\u2022 "
 #define LIST_BULLET_CHAR_LEN strlen(LIST_BULLET_CHAR)
 #define BLOCKQUOTE_PREFIX "> "
@@ -52,6 +56,9 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 #define GEMTEXT_INDENT_BLOCKQUOTE 2
 #define GEMTEXT_INDENT_LIST 3
 
+/* Offset of each level of heading in the outline (table of contents) */
+#define OUTLINE_INDENT_LEVEL 2
+
 /* Fancy indent looks like this:
  *   This is a paragraph which has been indented.  By default we only indent
  * paragraphs which are not directly after a heading.  Set to 'always' to always
@@ -65,6 +72,77 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 #define VI_EMPTY_CHAR_STR "\x1b[2m~\x1b[0m"
 #define VI_EMPTY_CHAR_STR_LEN 1
 
+/*
+ * Terminal output
+ */
+
+/*
+ * Wrap each frame in synchronized update escapes (DEC private mode 2026), so
+ * that terminals which support them display the frame all at once
+ */
+#define TUI_SYNCHRONIZED_UPDATE 1
+
+/*
+ * Keep a copy of what's on the terminal, and only send the cells that change
+ * in each frame.  Scrolled content is moved with scroll regions
+ */
+#define TUI_SCREEN_DIFF 1
+#define TUI_SCREEN_SCROLL 1
+
+/*
+ * Scroll the pager with a scroll region when moving by less than a page, and
+ * only paint the rows that come into view
+ */
+#define PAGER_SCROLL_REGION 1
+
+/*
+ * Window resizes are handled once the size hasn't changed for this many
+ * milliseconds (e.g. while the window is being dragged), or at most this long
+ * after the first one
+ */
+#define TUI_RESIZE_SETTLE_MS 50
+#define TUI_RESIZE_MAX_DELAY_MS 250
+
+/* Print output statistics (write syscalls and bytes per frame) on exit */
+#define TUI_OUTPUT_STATS 0
+
+/*
+ * Content width used by --render when --width isn't given, and the height of
+ * the pretend terminal that pages are loaded into
+ */
+#define RENDER_WIDTH_DEFAULT 80
+#define RENDER_HEIGHT 24
+
+/*
+ * Searching as the query is typed is done in slices of at most this many
+ * microseconds, with input handled in between, so that typing doesn't stall on
+ * large pages
+ */
+#define SEARCH_INCREMENTAL_SLICE_US 5000
+
+/*
+ * Searches are for plain text unless the query begins with this, in which case
+ * the rest of it is a regular expression (see dfa.h), like Vim's "very magic"
+ * patterns
+ */
+#define SEARCH_REGEX_PREFIX "\\v"
+
+/*
+ * Most states that are kept of the DFAs of a regular expression search (each
+ * takes about 1KiB).  Patterns that need more than this (which is rare) still
+ * work, but states have to be built again as they're needed
+ */
+#define SEARCH_DFA_STATES_MAX 1024
+
+/*
+ * Tabs keep their typeset pages, so switching between them is just a repaint.
+ * Once the tabs in the background hold more than this much typeset data, it
+ * is dropped from the least recently used ones (and they are typeset again
+ * when next shown)
+ */
+#define TABS_MAX 16
+#define TABS_TYPESET_MEM_MAX (32 * 1024 * 1024)
+
 /*
  * Cache
  */
@@ -72,11 +150,21 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 // Build with persistent disk caching
 #define CACHE_USE_DISK 1
 
+// Most pages listed by internal:search (the most recently cached are listed)
+#define CACHE_INDEX_RESULTS_MAX 50
+
 /*
  * History
  */
 #define HISTORY_LOG_ENABLED 1
 
+/*
+ * Number of recently left pages that are kept typeset (with their links,
+ * scroll and selection), so going back or forward to them doesn't need to
+ * load or typeset anything.  Set to 0 to disable
+ */
+#define HISTORY_PAGES_KEPT 8
+
 /*
  * Paths
  */
@@ -98,6 +186,13 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 /* Set to 1 to disable hyphenation algorithm */
 #define TYPESET_NO_HYPHENATION 0
 
+/*
+ * Hyphenation patterns to use for pages that don't specify a language; one of
+ * the sets in hyphenation/.  Pages in languages that have no pattern set are
+ * not hyphenated
+ */
+#define TYPESET_HYPHENATION_LANG "en-us"
+
 /*
  * Force double spaces after sentences.  For now we disable this for
  * non-justified text in hopes that it will reduce the number of spaces; though
@@ -116,6 +211,15 @@ static const float CONTENT_MARGIN_BIAS = 0.5f;
 #define TYPESET_LB_PENALTY_END_OF_SENTENCE_BONUS -15
 #define TYPESET_LB_PENALTY_CONSECUTIVE_HYPHENS 150
 
+/*
+ * Typeset large documents lazily; i.e. only as far as has been viewed, in
+ * blocks of raw lines.  Documents smaller than the threshold (in bytes) are
+ * always typeset in full
+ */
+#define TYPESET_LAZY 1
+#define TYPESET_LAZY_THRESHOLD (256 * 1024)
+#define TYPESET_LAZY_BLOCK_LINES 512
+
 /*
  * Protocols
  */
@@ -0,0 +1,1034 @@
+#include "pch.h"
+#include "dfa.h"
+
+// Most NFA states that a pattern can compile to (repeats are written out in
+// full, so this is what stops e.g. "(a{100}){100}" from getting out of hand)
+#define DFA_NFA_MAX 20000
+
+// Largest count that can be given in a {n,m} repeat, and deepest that groups
+// can be nested
+#define DFA_REPEAT_MAX 255
+#define DFA_DEPTH_MAX 64
+
+/* A node of a parsed pattern */
+struct dfa_node
+{
+    enum dfa_node_type
+    {
+        DFA_NODE_EMPTY = 0,
+        DFA_NODE_CLASS,
+        DFA_NODE_BOL,
+        DFA_NODE_EOL,
+        DFA_NODE_CAT,
+        DFA_NODE_ALT,
+        DFA_NODE_REPEAT,
+    } type;
+
+    // Child nodes (a is the only child of a repeat)
+    int a, b;
+
+    // Least and most times to repeat (most is -1 for any number of times)
+    int min, max;
+
+    int cls;
+};
+
+struct dfa_parser
+{
+    struct dfa *d;
+
+    // Where the pattern is up to
+    const char *c;
+
+    struct dfa_node *nodes;
+    int node_count, node_capacity;
+
+    // How deeply groups are nested
+    int depth;
+
+    const char *error;
+};
+
+// Input bytes with their case folded
+static unsigned char s_fold[256];
+
+static int dfa_parse_alt(struct dfa_parser *);
+
+/* Add a node to the parsed pattern */
+static int
+dfa_node_new(struct dfa_parser *p, enum dfa_node_type type, int a, int b)
+{
+    if (p->node_count >= p->node_capacity)
+    {
+        p->node_capacity = max(p->node_capacity * 2, 64);
+        void *tmp =
+            realloc(p->nodes, p->node_capacity * sizeof(struct dfa_node));
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        p->nodes = tmp;
+    }
+
+    p->nodes[p->node_count] = (struct dfa_node)
+    {
+        .type = type,
+        .a = a,
+        .b = b,
+        .cls = -1,
+    };
+    return p->node_count++;
+}
+
+/* Add an empty character class */
+static int
+dfa_class_new(struct dfa *d)
+{
+    if (d->class_count >= d->class_capacity)
+    {
+        d->class_capacity = max(d->class_capacity * 2, 16);
+        void *tmp =
+            realloc(d->classes, d->class_capacity * sizeof(*d->classes));
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        d->classes = tmp;
+    }
+
+    memset(d->classes[d->class_count], 0, sizeof(*d->classes));
+    return d->class_count++;
+}
+
+static inline void
+dfa_class_set(struct dfa *d, int cls, int lo, int hi)
+{
+    for (int x = lo; x <= hi; ++x)
+    {
+        d->classes[cls][x / 64] |= 1ull << (x % 64);
+    }
+}
+
+static inline bool
+dfa_class_has(const struct dfa *d, int cls, int x)
+{
+    return (d->classes[cls][x / 64] >> (x % 64)) & 1;
+}
+
+/* Add a node matching any byte in the given range */
+static int
+dfa_node_range(struct dfa_parser *p, int lo, int hi)
+{
+    const int n = dfa_node_new(p, DFA_NODE_CLASS, -1, -1);
+    p->nodes[n].cls = dfa_class_new(p->d);
+    dfa_class_set(p->d, p->nodes[n].cls, lo, hi);
+    return n;
+}
+
+static int
+dfa_node_cat(struct dfa_parser *p, int a, int b)
+{
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return dfa_node_new(p, DFA_NODE_CAT, a, b);
+}
+
+static int
+dfa_node_repeat(struct dfa_parser *p, int a, int min, int max)
+{
+    const int n = dfa_node_new(p, DFA_NODE_REPEAT, a, -1);
+    p->nodes[n].min = min;
+    p->nodes[n].max = max;
+    return n;
+}
+
+/* Add a node matching any single multi-byte UTF-8 character */
+static int
+dfa_node_multibyte(struct dfa_parser *p)
+{
+    int n = dfa_node_cat(p,
+        dfa_node_range(p, 0xc0, 0xdf),
+        dfa_node_range(p, 0x80, 0xbf));
+
+    int n3 = dfa_node_range(p, 0xe0, 0xef);
+    for (int i = 0; i < 2; ++i)
+    {
+        n3 = dfa_node_cat(p, n3, dfa_node_range(p, 0x80, 0xbf));
+    }
+    n = dfa_node_new(p, DFA_NODE_ALT, n, n3);
+
+    int n4 = dfa_node_range(p, 0xf0, 0xf7);
+    for (int i = 0; i < 3; ++i)
+    {
+        n4 = dfa_node_cat(p, n4, dfa_node_range(p, 0x80, 0xbf));
+    }
+    return dfa_node_new(p, DFA_NODE_ALT, n, n4);
+}
+
+/*
+ * Add a node for a class of ASCII characters (which has been filled in
+ * already), or any character but those if negated
+ */
+static int
+dfa_node_class(struct dfa_parser *p, int cls, bool negated)
+{
+    struct dfa *const d = p->d;
+
+    // Input is folded to lower case, so upper case letters have to be looked
+    // for as lower case ones
+    for (int x = 'A'; x <= 'Z'; ++x)
+    {
+        if (!dfa_class_has(d, cls, x)) continue;
+        dfa_class_set(d, cls, tolower(x), tolower(x));
+    }
+
+    int n = dfa_node_new(p, DFA_NODE_CLASS, -1, -1);
+    p->nodes[n].cls = cls;
+    if (!negated) return n;
+
+    // Any character but those; the class itself needs to be for ASCII
+    // characters only as the rest are matched whole
+    const int neg = dfa_class_new(d);
+    for (int x = 0; x < 0x80; ++x)
+    {
+        if (!dfa_class_has(d, cls, x)) dfa_class_set(d, neg, x, x);
+    }
+    p->nodes[n].cls = neg;
+    return dfa_node_new(p, DFA_NODE_ALT, n, dfa_node_multibyte(p));
+}
+
+/*
+ * Fill in a class for a backslash escape like \d, returning whether it's
+ * negated, or -1 if the escape isn't a class
+ */
+static int
+dfa_class_escape(struct dfa *d, int cls, unsigned char c)
+{
+    switch (tolower(c))
+    {
+    case 'd':
+        dfa_class_set(d, cls, '0', '9');
+        break;
+    case 'w':
+        dfa_class_set(d, cls, '0', '9');
+        dfa_class_set(d, cls, 'a', 'z');
+        dfa_class_set(d, cls, 'A', 'Z');
+        dfa_class_set(d, cls, '_', '_');
+        break;
+    case 's':
+        dfa_class_set(d, cls, ' ', ' ');
+        dfa_class_set(d, cls, '\t', '\r');
+        break;
+    default: return -1;
+    }
+    return isupper(c) ? 1 : 0;
+}
+
+/* Parse a bracket expression, e.g. "[a-z_]" (after the opening bracket) */
+static int
+dfa_parse_bracket(struct dfa_parser *p)
+{
+    struct dfa *const d = p->d;
+    const int cls = dfa_class_new(d);
+
+    const bool negated = *p->c == '^';
+    if (negated) ++p->c;
+
+    // A closing bracket straight away is taken literally
+    for (bool first = true; first || *p->c != ']'; first = false)
+    {
+        int lo = (unsigned char)*p->c;
+        if (!lo)
+        {
+            p->error = "missing ]";
+            return -1;
+        }
+        ++p->c;
+
+        if (lo == '\\')
+        {
+            if (!*p->c)
+            {
+                p->error = "trailing \\";
+                return -1;
+            }
+
+            // Classes within brackets can't be negated
+            const int sub = dfa_class_new(d);
+            if (dfa_class_escape(d, sub, *p->c) == 0)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    d->classes[cls][i] |= d->classes[sub][i];
+                }
+                --d->class_count;
+                ++p->c;
+                continue;
+            }
+            --d->class_count;
+            lo = (unsigned char)*p->c++;
+        }
+
+        int hi = lo;
+        if (p->c[0] == '-' && p->c[1] && p->c[1] != ']')
+        {
+            hi = (unsigned char)p->c[1];
+            p->c += 2;
+            if (hi == '\\' && *p->c) hi = (unsigned char)*p->c++;
+        }
+
+        if (lo >= 0x80 || hi >= 0x80)
+        {
+            p->error = "only ASCII characters can be put in []";
+            return -1;
+        }
+        if (lo > hi)
+        {
+            p->error = "backwards range in []";
+            return -1;
+        }
+        dfa_class_set(d, cls, lo, hi);
+    }
+    ++p->c;
+
+    return dfa_node_class(p, cls, negated);
+}
+
+/* Parse a single character (which may be several bytes), group, or class */
+static int
+dfa_parse_atom(struct dfa_parser *p)
+{
+    unsigned char c = *p->c++;
+    switch (c)
+    {
+    case '(':
+    {
+        if (++p->depth > DFA_DEPTH_MAX)
+        {
+            p->error = "groups nested too deeply";
+            return -1;
+        }
+        const int n = dfa_parse_alt(p);
+        if (p->error) return -1;
+        if (*p->c != ')')
+        {
+            p->error = "missing )";
+            return -1;
+        }
+        ++p->c;
+        --p->depth;
+        return n < 0 ? dfa_node_new(p, DFA_NODE_EMPTY, -1, -1) : n;
+    }
+
+    case '[':
+        return dfa_parse_bracket(p);
+
+    case '.':
+        return dfa_node_new(p, DFA_NODE_ALT,
+            dfa_node_range(p, 0x00, 0x7f),
+            dfa_node_multibyte(p));
+
+    case '^': return dfa_node_new(p, DFA_NODE_BOL, -1, -1);
+    case '$': return dfa_node_new(p, DFA_NODE_EOL, -1, -1);
+
+    // A space matches any amount of whitespace, like in plain searches
+    case ' ':
+    {
+        const int n = dfa_node_range(p, ' ', ' ');
+        dfa_class_set(p->d, p->nodes[n].cls, '\t', '\t');
+        for (; *p->c == ' '; ++p->c);
+        return dfa_node_repeat(p, n, 0, -1);
+    }
+
+    case '\\':
+    {
+        if (!*p->c)
+        {
+            p->error = "trailing \\";
+            return -1;
+        }
+        const int cls = dfa_class_new(p->d);
+        const int negated = dfa_class_escape(p->d, cls, *p->c);
+        if (negated >= 0)
+        {
+            ++p->c;
+            return dfa_node_class(p, cls, negated);
+        }
+        --p->d->class_count;
+
+        // Anything else is just the character itself
+        c = *p->c++;
+        break;
+    }
+
+    default: break;
+    }
+
+    // A character, with all of its bytes
+    int n = dfa_node_range(p, s_fold[c], s_fold[c]);
+    if (c >= 0xc0)
+    {
+        for (; ((unsigned char)*p->c & 0xc0) == 0x80; ++p->c)
+        {
+            const unsigned char b = *p->c;
+            n = dfa_node_cat(p, n, dfa_node_range(p, b, b));
+        }
+    }
+    return n;
+}
+
+/* Parse a number for a {n,m} repeat, or -1 if there isn't one */
+static int
+dfa_parse_count(struct dfa_parser *p)
+{
+    if (!isdigit((unsigned char)*p->c)) return -1;
+
+    int n = 0;
+    for (; isdigit((unsigned char)*p->c); ++p->c)
+    {
+        n = min(n * 10 + (*p->c - '0'), DFA_REPEAT_MAX + 1);
+    }
+    return n;
+}
+
+/* Parse an atom, and any repeats that follow it */
+static int
+dfa_parse_repeat(struct dfa_parser *p)
+{
+    int n = dfa_parse_atom(p);
+    if (p->error) return -1;
+
+    for (;;)
+    {
+        switch (*p->c)
+        {
+        case '*': n = dfa_node_repeat(p, n, 0, -1); break;
+        case '+': n = dfa_node_repeat(p, n, 1, -1); break;
+        case '?': n = dfa_node_repeat(p, n, 0, 1); break;
+
+        case '{':
+        {
+            // A brace that doesn't begin a proper repeat is taken literally
+            const char *const brace = p->c++;
+            const int lo = dfa_parse_count(p);
+            int hi = lo;
+            if (lo >= 0 && *p->c == ',')
+            {
+                ++p->c;
+                hi = dfa_parse_count(p);
+            }
+            if (lo < 0 || *p->c != '}')
+            {
+                p->c = brace;
+                return n;
+            }
+            if (lo > DFA_REPEAT_MAX || hi > DFA_REPEAT_MAX)
+            {
+                p->error = "repeat count too large";
+                return -1;
+            }
+            if (hi >= 0 && lo > hi)
+            {
+                p->error = "backwards repeat count";
+                return -1;
+            }
+            n = dfa_node_repeat(p, n, lo, hi);
+            break;
+        }
+
+        default: return n;
+        }
+        ++p->c;
+    }
+}
+
+/* Parse a sequence of repeats, up to the end of an alternative */
+static int
+dfa_parse_cat(struct dfa_parser *p)
+{
+    int n = -1;
+
+    // Repeat operators at the start are taken literally
+    if (*p->c && strchr("*+?", *p->c))
+    {
+        n = dfa_node_range(p, *p->c, *p->c);
+        ++p->c;
+    }
+
+    for (; *p->c && *p->c != '|' && *p->c != ')';)
+    {
+        n = dfa_node_cat(p, n, dfa_parse_repeat(p));
+        if (p->error) return -1;
+    }
+    return n;
+}
+
+/* Parse alternatives, up to the end of the pattern or group */
+static int
+dfa_parse_alt(struct dfa_parser *p)
+{
+    int n = dfa_parse_cat(p);
+    for (; !p->error && *p->c == '|';)
+    {
+        ++p->c;
+        const int a = n < 0 ? dfa_node_new(p, DFA_NODE_EMPTY, -1, -1) : n;
+        int b = dfa_parse_cat(p);
+        if (b < 0) b = dfa_node_new(p, DFA_NODE_EMPTY, -1, -1);
+        n = dfa_node_new(p, DFA_NODE_ALT, a, b);
+    }
+    return n;
+}
+
+/* Add an NFA state */
+static int
+dfa_nfa_new(struct dfa *d, enum dfa_nfa_type type, int out, int out1, int cls)
+{
+    if (d->nfa_count >= d->nfa_capacity)
+    {
+        d->nfa_capacity = max(d->nfa_capacity * 2, 64);
+        void *tmp =
+            realloc(d->nfa, d->nfa_capacity * sizeof(struct dfa_nfa_state));
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        d->nfa = tmp;
+    }
+
+    d->nfa[d->nfa_count] = (struct dfa_nfa_state)
+    {
+        .type = type,
+        .out = out,
+        .out1 = out1,
+        .cls = cls,
+    };
+    return d->nfa_count++;
+}
+
+/*
+ * Build the NFA states for a node, which carry on to the given state once it
+ * has been matched, returning the state to begin in.  If reversed, the NFA
+ * matches the text of the node backwards
+ */
+static int
+dfa_nfa_build(
+    struct dfa *d,
+    const struct dfa_node *nodes,
+    int n,
+    int next,
+    bool reversed)
+{
+    // Give up once the pattern has gotten too big
+    if (n < 0 || d->nfa_count > DFA_NFA_MAX) return next;
+
+    const struct dfa_node *const node = &nodes[n];
+    switch (node->type)
+    {
+    case DFA_NODE_EMPTY: return next;
+
+    case DFA_NODE_CLASS:
+        return dfa_nfa_new(d, DFA_NFA_CLASS, next, -1, node->cls);
+
+    case DFA_NODE_BOL: return dfa_nfa_new(d, DFA_NFA_BOL, next, -1, -1);
+    case DFA_NODE_EOL: return dfa_nfa_new(d, DFA_NFA_EOL, next, -1, -1);
+
+    case DFA_NODE_CAT:
+        if (reversed)
+        {
+            return dfa_nfa_build(d, nodes, node->b,
+                dfa_nfa_build(d, nodes, node->a, next, reversed), reversed);
+        }
+        return dfa_nfa_build(d, nodes, node->a,
+            dfa_nfa_build(d, nodes, node->b, next, reversed), reversed);
+
+    case DFA_NODE_ALT:
+    {
+        const int a = dfa_nfa_build(d, nodes, node->a, next, reversed);
+        const int b = dfa_nfa_build(d, nodes, node->b, next, reversed);
+        return dfa_nfa_new(d, DFA_NFA_SPLIT, a, b, -1);
+    }
+
+    case DFA_NODE_REPEAT:
+    {
+        int s = next;
+        if (node->max < 0)
+        {
+            // Loop back around for any number of times
+            // (building the node may move the states around)
+            s = dfa_nfa_new(d, DFA_NFA_SPLIT, -1, next, -1);
+            const int body = dfa_nfa_build(d, nodes, node->a, s, reversed);
+            d->nfa[s].out = body;
+        }
+        else
+        {
+            // Each optional repeat can skip straight to the end
+            for (int i = node->min; i < node->max; ++i)
+            {
+                s = dfa_nfa_new(d, DFA_NFA_SPLIT,
+                    dfa_nfa_build(d, nodes, node->a, s, reversed),
+                    next,
+                    -1);
+            }
+        }
+        for (int i = 0; i < node->min; ++i)
+        {
+            s = dfa_nfa_build(d, nodes, node->a, s, reversed);
+        }
+        return s;
+    }
+    }
+
+    return next;
+}
+
+static void
+dfa_automaton_init(struct dfa_automaton *a, int nfa_start, bool unanchored)
+{
+    memset(a, 0, sizeof(struct dfa_automaton));
+    a->nfa_start = nfa_start;
+    a->unanchored = unanchored;
+    a->start = -1;
+
+    // The table is never more than half full
+    for (a->table_capacity = 64;
+        a->table_capacity < SEARCH_DFA_STATES_MAX * 2;
+        a->table_capacity *= 2);
+    a->table = malloc(a->table_capacity * sizeof(int));
+    if (!a->table)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    memset(a->table, -1, a->table_capacity * sizeof(int));
+}
+
+static void
+dfa_automaton_free(struct dfa_automaton *a)
+{
+    free(a->states);
+    free(a->pool);
+    free(a->table);
+    memset(a, 0, sizeof(struct dfa_automaton));
+}
+
+/* Forget all of the DFA states that have been built, to begin again */
+static void
+dfa_automaton_flush(struct dfa_automaton *a)
+{
+    a->state_count = 0;
+    a->pool_len = 0;
+    a->start = -1;
+    memset(a->table, -1, a->table_capacity * sizeof(int));
+    ++a->flushes;
+}
+
+/* Begin working out a set of NFA states */
+static inline void
+dfa_set_begin(struct dfa *d)
+{
+    // Marks are only reset once the generation counter wraps around
+    if (++d->mark == 0)
+    {
+        memset(d->marks, 0, d->nfa_count * sizeof(unsigned));
+        d->mark = 1;
+    }
+}
+
+/* Add an NFA state to the set being worked out, and all that it leads to */
+static void
+dfa_set_add(struct dfa *d, int s)
+{
+    int top = 0;
+    d->stack[top++] = s;
+    while (top)
+    {
+        const int x = d->stack[--top];
+        if (x < 0 || d->marks[x] == d->mark) continue;
+        d->marks[x] = d->mark;
+
+        if (d->nfa[x].type == DFA_NFA_SPLIT)
+        {
+            d->stack[top++] = d->nfa[x].out1;
+            d->stack[top++] = d->nfa[x].out;
+        }
+    }
+}
+
+/* Finish the set being worked out, putting it in the scratch space, sorted */
+static int
+dfa_set_end(struct dfa *d)
+{
+    int len = 0;
+    for (int x = 0; x < d->nfa_count; ++x)
+    {
+        if (d->marks[x] == d->mark && d->nfa[x].type != DFA_NFA_SPLIT)
+        {
+            d->scratch[len++] = x;
+        }
+    }
+    return len;
+}
+
+/* Get the DFA state for the set of NFA states in the scratch space */
+static int
+dfa_state_get(struct dfa *d, struct dfa_automaton *a, int len, bool *flushed)
+{
+    const uint32_t hash = fnv1a(FNV1A_BASIS, d->scratch, len * sizeof(int));
+
+    // Look for it in the table
+    const int mask = a->table_capacity - 1;
+    int slot = hash & mask;
+    for (; a->table[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        const struct dfa_state *const s = &a->states[a->table[slot]];
+        if (s->set_len == len &&
+            memcmp(a->pool + s->set, d->scratch, len * sizeof(int)) == 0)
+        {
+            return a->table[slot];
+        }
+    }
+
+    // Not built yet; make room for it (starting over if there's too many)
+    if (a->state_count >= SEARCH_DFA_STATES_MAX)
+    {
+        dfa_automaton_flush(a);
+        *flushed = true;
+        for (slot = hash & mask; a->table[slot] >= 0; slot = (slot + 1) & mask);
+    }
+    if (a->state_count >= a->state_capacity)
+    {
+        a->state_capacity = min(max(a->state_capacity * 2, 16),
+            SEARCH_DFA_STATES_MAX);
+        void *tmp =
+            realloc(a->states, a->state_capacity * sizeof(struct dfa_state));
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        a->states = tmp;
+    }
+    if (a->pool_len + len > a->pool_capacity)
+    {
+        a->pool_capacity = max(a->pool_capacity * 2, a->pool_len + len + 256);
+        void *tmp = realloc(a->pool, a->pool_capacity * sizeof(int));
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        a->pool = tmp;
+    }
+
+    struct dfa_state *const s = &a->states[a->state_count];
+    s->set = a->pool_len;
+    s->set_len = len;
+    s->match = false;
+    memcpy(a->pool + a->pool_len, d->scratch, len * sizeof(int));
+    a->pool_len += len;
+    for (int i = 0; i < len; ++i)
+    {
+        if (d->nfa[d->scratch[i]].type == DFA_NFA_MATCH) s->match = true;
+    }
+    memset(s->next, -1, sizeof(s->next));
+
+    a->table[slot] = a->state_count;
+    return a->state_count++;
+}
+
+/* Get the state that an automaton starts in */
+static int
+dfa_start(struct dfa *d, struct dfa_automaton *a)
+{
+    if (a->start >= 0) return a->start;
+
+    bool flushed = false;
+    dfa_set_begin(d);
+    dfa_set_add(d, a->nfa_start);
+    a->start = dfa_state_get(d, a, dfa_set_end(d), &flushed);
+    return a->start;
+}
+
+/* Work out the state that follows another on a symbol */
+static int
+dfa_step_slow(struct dfa *d, struct dfa_automaton *a, int s, int sym)
+{
+    dfa_set_begin(d);
+
+    const struct dfa_state *const from = &a->states[s];
+    const int *const set = a->pool + from->set;
+    for (int i = 0; i < from->set_len; ++i)
+    {
+        const struct dfa_nfa_state *const x = &d->nfa[set[i]];
+        if (sym >= 256)
+        {
+            // The beginning and end of the line aren't characters; states
+            // that aren't waiting for them just carry on as they are
+            dfa_set_add(d, set[i]);
+            if ((x->type == DFA_NFA_BOL && sym == DFA_SYMBOL_BOL) ||
+                (x->type == DFA_NFA_EOL && sym == DFA_SYMBOL_EOL))
+            {
+                dfa_set_add(d, x->out);
+            }
+        }
+        else if (x->type == DFA_NFA_CLASS && dfa_class_has(d, x->cls, sym))
+        {
+            dfa_set_add(d, x->out);
+        }
+    }
+
+    // A match can begin anywhere
+    if (a->unanchored && sym < 256) dfa_set_add(d, a->nfa_start);
+
+    bool flushed = false;
+    const int next = dfa_state_get(d, a, dfa_set_end(d), &flushed);
+    if (!flushed) a->states[s].next[sym] = next;
+    return next;
+}
+
+static inline int
+dfa_step(struct dfa *d, struct dfa_automaton *a, int s, int sym)
+{
+    const int next = a->states[s].next[sym];
+    return next >= 0 ? next : dfa_step_slow(d, a, s, sym);
+}
+
+/*
+ * Compile a pattern.  Returns false if it isn't valid, with a description of
+ * the problem in error
+ */
+bool
+dfa_compile(struct dfa *d, const char *pattern, const char **error)
+{
+    memset(d, 0, sizeof(struct dfa));
+
+    for (int x = 0; x < 256; ++x) s_fold[x] = x < 0x80 ? tolower(x) : x;
+
+    struct dfa_parser p =
+    {
+        .d = d,
+        .c = pattern,
+    };
+    int root = dfa_parse_alt(&p);
+    if (!p.error && *p.c == ')') p.error = "unmatched )";
+    if (p.error)
+    {
+        *error = p.error;
+        free(p.nodes);
+        dfa_free(d);
+        return false;
+    }
+
+    // Forwards and reversed NFAs share the state that they both finish in
+    const int match = dfa_nfa_new(d, DFA_NFA_MATCH, -1, -1, -1);
+    const int fwd = dfa_nfa_build(d, p.nodes, root, match, false);
+    const int rev = dfa_nfa_build(d, p.nodes, root, match, true);
+    free(p.nodes);
+    if (d->nfa_count > DFA_NFA_MAX)
+    {
+        *error = "pattern too large";
+        dfa_free(d);
+        return false;
+    }
+
+    // Every state is on the stack at most twice when working out a set
+    d->scratch = malloc(d->nfa_count * sizeof(int));
+    d->stack = malloc((d->nfa_count * 2 + 1) * sizeof(int));
+    d->marks = calloc(d->nfa_count, sizeof(unsigned));
+    if (!d->scratch || !d->stack || !d->marks)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    dfa_automaton_init(&d->fwd, fwd, false);
+    dfa_automaton_init(&d->rev, rev, true);
+
+    return true;
+}
+
+void
+dfa_free(struct dfa *d)
+{
+    free(d->nfa);
+    free(d->classes);
+    free(d->scratch);
+    free(d->stack);
+    free(d->marks);
+    free(d->starts);
+    free(d->visited);
+    dfa_automaton_free(&d->fwd);
+    dfa_automaton_free(&d->rev);
+    memset(d, 0, sizeof(struct dfa));
+}
+
+/* Forget the places that the forwards pattern has been run through */
+static void
+dfa_visited_clear(struct dfa *d)
+{
+    d->visited_count = 0;
+    d->visited_flushes = d->fwd.flushes;
+
+    // Entries are only reset once the generation counter wraps around
+    if (++d->visited_gen == 0)
+    {
+        memset(d->visited, 0, d->visited_capacity * sizeof(struct dfa_visit));
+        d->visited_gen = 1;
+    }
+}
+
+static inline uint32_t
+dfa_visit_hash(uint32_t pos, int state)
+{
+    const uint32_t key[2] = { pos, (uint32_t)state };
+    return fnv1a(FNV1A_BASIS, key, sizeof(key));
+}
+
+/*
+ * Note that the forwards pattern has been run through a place in the line in
+ * the given state, returning true if it already had been
+ */
+static bool
+dfa_visit(struct dfa *d, uint32_t pos, int state)
+{
+    // The table is never more than half full
+    if (d->visited_count * 2 >= d->visited_capacity)
+    {
+        const int capacity = max(d->visited_capacity * 2, 256);
+        struct dfa_visit *const visited =
+            calloc(capacity, sizeof(struct dfa_visit));
+        if (!visited)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        for (int i = 0; i < d->visited_capacity; ++i)
+        {
+            const struct dfa_visit *const v = &d->visited[i];
+            if (v->gen != d->visited_gen) continue;
+
+            int slot = dfa_visit_hash(v->pos, v->state) & (capacity - 1);
+            for (; visited[slot].gen; slot = (slot + 1) & (capacity - 1));
+            visited[slot] = *v;
+        }
+        free(d->visited);
+        d->visited = visited;
+        d->visited_capacity = capacity;
+    }
+
+    const int mask = d->visited_capacity - 1;
+    int slot = dfa_visit_hash(pos, state) & mask;
+    for (; d->visited[slot].gen == d->visited_gen; slot = (slot + 1) & mask)
+    {
+        if (d->visited[slot].pos == pos && d->visited[slot].state == state)
+        {
+            return true;
+        }
+    }
+
+    d->visited[slot] = (struct dfa_visit)
+    {
+        .gen = d->visited_gen,
+        .pos = pos,
+        .state = state,
+    };
+    ++d->visited_count;
+    return false;
+}
+
+/*
+ * Begin searching a line.  The reversed pattern is run backwards over the
+ * whole line first, to find all of the places that a match begins at, so
+ * that the forwards pattern only needs to be run from those
+ */
+void
+dfa_scan_line(struct dfa *d, const char *begin, const char *end)
+{
+    const size_t len = end - begin;
+    if (len + 1 > d->starts_capacity)
+    {
+        free(d->starts);
+        d->starts_capacity = max(len + 1, d->starts_capacity * 2);
+        d->starts = malloc(d->starts_capacity * sizeof(bool));
+        if (!d->starts)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+    }
+    d->begin = begin;
+    d->end = end;
+    d->pos = 0;
+    dfa_visited_clear(d);
+
+    struct dfa_automaton *const a = &d->rev;
+    int s = dfa_step(d, a, dfa_start(d, a), DFA_SYMBOL_EOL);
+    d->starts[len] = a->states[s].match;
+    for (size_t i = len; i > 0; --i)
+    {
+        s = dfa_step(d, a, s, s_fold[(unsigned char)begin[i - 1]]);
+        d->starts[i - 1] = a->states[s].match;
+    }
+    s = dfa_step(d, a, s, DFA_SYMBOL_BOL);
+    d->starts[0] = a->states[s].match;
+}
+
+/*
+ * Find the next match in the line being searched; the leftmost one, and the
+ * longest one from there.  Matches don't overlap, and empty matches are
+ * skipped.  Returns where the match begins (setting where it ends), or NULL
+ * if there are no more.
+ *
+ * Finding the longest match means running the forwards pattern until it can't
+ * match anything more, which may be well past where the match ends (e.g.
+ * "a|a.*b" over a line of a's).  The next match begins after this one ends,
+ * so runs can cover the same text over and over.  But a run that gets to a
+ * place in the line in the same state as an earlier run did can't match
+ * anything past there, or the earlier run's match would have been longer and
+ * included where this run began.  So each run stops there, and searching a
+ * line steps over each byte at most once per DFA state
+ */
+const char *
+dfa_scan_next(struct dfa *d, const char **match_end)
+{
+    struct dfa_automaton *const a = &d->fwd;
+    const size_t len = d->end - d->begin;
+
+    for (size_t i = d->pos; i < len; ++i)
+    {
+        if (!d->starts[i]) continue;
+
+        int s = dfa_start(d, a);
+        if (i == 0) s = dfa_step(d, a, s, DFA_SYMBOL_BOL);
+
+        // Carry on until nothing more can match, or an earlier run has been
+        // here before
+        const char *c = d->begin + i, *last = NULL;
+        bool visited = false;
+        for (; c < d->end && a->states[s].set_len && !visited; ++c)
+        {
+            s = dfa_step(d, a, s, s_fold[(unsigned char)*c]);
+            if (a->states[s].match) last = c + 1;
+
+            // The states are numbered again when they're forgotten
+            if (d->visited_flushes != a->flushes) dfa_visited_clear(d);
+            visited = dfa_visit(d, c + 1 - d->begin, s);
+        }
+        if (c == d->end && a->states[s].set_len && !visited)
+        {
+            s = dfa_step(d, a, s, DFA_SYMBOL_EOL);
+            if (a->states[s].match) last = d->end;
+        }
+        if (!last) continue;
+
+        d->pos = last - d->begin;
+        *match_end = last;
+        return d->begin + i;
+    }
+
+    d->pos = len;
+    return NULL;
+}
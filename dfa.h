@@ -0,0 +1,140 @@
+#ifndef DFA_H
+#define DFA_H
+
+/*
+ * dfa.h
+ *
+ * Regular expressions, for searching.  Patterns are compiled to an NFA, which
+ * is turned into a DFA lazily (a state at a time, only as the text being
+ * searched needs them), so matching takes time linear in the length of the
+ * text however the pattern is written.  The DFA states are kept for as long
+ * as the pattern is, so searching again with it doesn't build them again.
+ *
+ * The syntax is a subset of POSIX extended regular expressions:
+ *   .          any character
+ *   [a-z_]     any of the characters in the brackets ([^...] for any but
+ *              them); only ASCII characters can be put in brackets
+ *   \d \w \s   a digit, word character or whitespace (\D \W \S for anything
+ *              but)
+ *   \c         the character c itself
+ *   * + ?      any number of, at least one, or at most one of the previous
+ *   {n,m}      n to m of the previous ({n} for exactly n, {n,} for at least n)
+ *   a|b  (ab)  alternatives and grouping
+ *   ^ $        the beginning and end of the line
+ * As with plain searches, case is ignored and a space matches any amount of
+ * whitespace (including none).
+ */
+
+// Bytes of text, plus the beginning and end of the line
+#define DFA_SYMBOLS 258
+#define DFA_SYMBOL_BOL 256
+#define DFA_SYMBOL_EOL 257
+
+/* A state of the NFA */
+struct dfa_nfa_state
+{
+    enum dfa_nfa_type
+    {
+        // Moves to out on any byte in the character class
+        DFA_NFA_CLASS = 0,
+
+        // Moves to both out and out1 without consuming anything
+        DFA_NFA_SPLIT,
+
+        // Moves to out at the beginning/end of the line
+        DFA_NFA_BOL,
+        DFA_NFA_EOL,
+
+        // The whole pattern was matched
+        DFA_NFA_MATCH,
+    } type;
+
+    int out, out1;
+    int cls;
+};
+
+/* A state of a DFA; i.e. a set of NFA states that could be in at once */
+struct dfa_state
+{
+    // The NFA states, as an offset into the automaton's pool
+    int set, set_len;
+
+    // Whether the pattern has been matched
+    bool match;
+
+    // The state that follows on each symbol, or -1 if not worked out yet
+    int next[DFA_SYMBOLS];
+};
+
+/* A DFA that is built as it's used */
+struct dfa_automaton
+{
+    // NFA state that it starts in, and whether it can also start again at any
+    // point in the text
+    int nfa_start;
+    bool unanchored;
+
+    // The DFA states that have been built so far, and the starting state (-1
+    // if it needs to be built again)
+    struct dfa_state *states;
+    int state_count, state_capacity;
+    int start;
+
+    // The sets of NFA states of each DFA state
+    int *pool;
+    size_t pool_len, pool_capacity;
+
+    // Hash table to look up DFA states by their set of NFA states
+    int *table;
+    int table_capacity;
+
+    // How many times the states have been forgotten to begin again
+    unsigned flushes;
+};
+
+struct dfa
+{
+    // The compiled pattern, forwards and reversed, in one NFA
+    struct dfa_nfa_state *nfa;
+    int nfa_count, nfa_capacity;
+
+    // Character classes of the NFA, as bitmaps of bytes
+    uint64_t (*classes)[4];
+    int class_count, class_capacity;
+
+    // The pattern forwards (to find where matches end), and reversed (to find
+    // where matches begin)
+    struct dfa_automaton fwd, rev;
+
+    // Scratch space for working out the states of the DFAs
+    int *scratch, *stack;
+    unsigned *marks;
+    unsigned mark;
+
+    // The line being searched, where matches can begin in it, and how far
+    // through it the search is
+    const char *begin, *end;
+    bool *starts;
+    size_t starts_capacity;
+    size_t pos;
+
+    // Hash table of the places in the line that the forwards pattern has
+    // been run through, and the state it was in there (see dfa_scan_next).
+    // Entries from an earlier line or an earlier set of states have an old
+    // generation, and are treated as empty
+    struct dfa_visit
+    {
+        uint32_t gen, pos;
+        int state;
+    } *visited;
+    int visited_count, visited_capacity;
+    uint32_t visited_gen;
+    unsigned visited_flushes;
+};
+
+bool dfa_compile(struct dfa *, const char *, const char **);
+void dfa_free(struct dfa *);
+void dfa_scan_line(struct dfa *, const char *, const char *);
+const char *dfa_scan_next(struct dfa *, const char **);
+
+#endif
@@ -0,0 +1,298 @@
+#include "pch.h"
+#include "event.h"
+
+struct event_fd
+{
+    int fd;
+    short events;
+    void (*func)(int, short, void *);
+    void *data;
+};
+
+struct event_timer
+{
+    // Monotonic time (in milliseconds) when the timer fires; 0 if unused
+    long long deadline;
+    void (*func)(void *);
+    void *data;
+};
+
+static struct event_fd s_fds[EVENT_FDS_MAX];
+static int s_fd_count = 0;
+
+static struct event_timer s_timers[EVENT_TIMERS_MAX];
+
+// Self-pipe that signal handlers write the signal number to
+static int s_signal_pipe[2] = { -1, -1 };
+static void (*s_signal_funcs[NSIG])(int);
+
+// Which signals interrupt blocking calls, and whether one has arrived that the
+// loop hasn't handled yet
+static bool s_signal_interrupts[NSIG];
+static volatile sig_atomic_t s_signal_interrupted = 0;
+
+static void event_signal_pipe_ready(int, short, void *);
+
+/* Current monotonic time in milliseconds */
+static long long
+event_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+event_init(void)
+{
+    if (pipe(s_signal_pipe) < 0)
+    {
+        fprintf(stderr, "failed to create signal pipe\n");
+        exit(-1);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        fcntl(s_signal_pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(s_signal_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    event_fd_add(s_signal_pipe[0], POLLIN, event_signal_pipe_ready, NULL);
+}
+
+void
+event_deinit(void)
+{
+    // Signals that still arrive have nowhere to go now
+    for (int i = 1; i < NSIG; ++i)
+    {
+        if (s_signal_funcs[i]) signal(i, SIG_DFL);
+        s_signal_funcs[i] = NULL;
+        s_signal_interrupts[i] = false;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (s_signal_pipe[i] != -1) close(s_signal_pipe[i]);
+        s_signal_pipe[i] = -1;
+    }
+
+    s_fd_count = 0;
+    memset(s_timers, 0, sizeof(s_timers));
+}
+
+/*
+ * Wait until at least one event is ready (or a signal interrupts the wait),
+ * and run the callbacks for whatever is ready
+ */
+void
+event_wait(void)
+{
+    // Sleep no longer than the next timer
+    long long now = event_now(), next = -1;
+    for (int i = 0; i < EVENT_TIMERS_MAX; ++i)
+    {
+        if (!s_timers[i].deadline) continue;
+        if (next == -1 || s_timers[i].deadline < next)
+        {
+            next = s_timers[i].deadline;
+        }
+    }
+    const int timeout = next == -1 ? -1 : (int)max(next - now, 0);
+
+    // Callbacks may add or remove descriptors, so poll a copy
+    struct pollfd pfds[EVENT_FDS_MAX];
+    const int count = s_fd_count;
+    for (int i = 0; i < count; ++i)
+    {
+        pfds[i] = (struct pollfd) { s_fds[i].fd, s_fds[i].events, 0 };
+    }
+
+    if (poll(pfds, count, timeout) < 0 && errno != EINTR)
+    {
+        fprintf(stderr, "poll: %s\n", strerror(errno));
+        exit(-1);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!pfds[i].revents) continue;
+
+        // Make sure it wasn't removed by an earlier callback
+        for (int f = 0; f < s_fd_count; ++f)
+        {
+            if (s_fds[f].fd != pfds[i].fd) continue;
+            s_fds[f].func(pfds[i].fd, pfds[i].revents, s_fds[f].data);
+            break;
+        }
+    }
+
+    // Fire any timers that are due.  A timer is cleared before its callback,
+    // so that the callback can set it again
+    now = event_now();
+    for (int i = 0; i < EVENT_TIMERS_MAX; ++i)
+    {
+        struct event_timer *const t = &s_timers[i];
+        if (!t->deadline || t->deadline > now) continue;
+
+        const struct event_timer fired = *t;
+        *t = (struct event_timer) { 0 };
+        fired.func(fired.data);
+    }
+}
+
+/* Call func whenever the given events (for poll) are ready on fd */
+int
+event_fd_add(
+    int fd,
+    short events,
+    void (*func)(int, short, void *),
+    void *data)
+{
+    // Replace any existing registration of the descriptor
+    event_fd_remove(fd);
+
+    if (s_fd_count >= EVENT_FDS_MAX) return -1;
+
+    s_fds[s_fd_count++] = (struct event_fd) { fd, events, func, data };
+    return 0;
+}
+
+void
+event_fd_remove(int fd)
+{
+    for (int i = 0; i < s_fd_count; ++i)
+    {
+        if (s_fds[i].fd != fd) continue;
+
+        s_fds[i] = s_fds[--s_fd_count];
+        return;
+    }
+}
+
+/*
+ * Call func once in ms milliseconds.  Setting a timer with the same callback
+ * and data again replaces its deadline
+ */
+void
+event_timer_set(int ms, void (*func)(void *), void *data)
+{
+    const long long deadline = event_now() + max(ms, 0) + 1;
+
+    struct event_timer *free_timer = NULL;
+    for (int i = 0; i < EVENT_TIMERS_MAX; ++i)
+    {
+        struct event_timer *const t = &s_timers[i];
+        if (!t->deadline)
+        {
+            if (!free_timer) free_timer = t;
+            continue;
+        }
+        if (t->func != func || t->data != data) continue;
+
+        t->deadline = deadline;
+        return;
+    }
+
+    if (!free_timer)
+    {
+        fprintf(stderr, "too many timers\n");
+        exit(-1);
+    }
+    *free_timer = (struct event_timer) { deadline, func, data };
+}
+
+void
+event_timer_cancel(void (*func)(void *), void *data)
+{
+    for (int i = 0; i < EVENT_TIMERS_MAX; ++i)
+    {
+        struct event_timer *const t = &s_timers[i];
+        if (t->deadline && t->func == func && t->data == data)
+        {
+            *t = (struct event_timer) { 0 };
+        }
+    }
+}
+
+/* Signal handler; just pass the signal on to the loop */
+static void
+event_signal_handler(int signo)
+{
+    const int errno_saved = errno;
+
+    if (s_signal_interrupts[signo])
+    {
+        // The loop hasn't got to the last one, so something is stuck; do what
+        // the signal would normally do (once this handler returns)
+        if (s_signal_interrupted)
+        {
+            signal(signo, SIG_DFL);
+            raise(signo);
+        }
+        s_signal_interrupted = 1;
+    }
+
+    const unsigned char c = signo;
+    if (write(s_signal_pipe[1], &c, 1) < 0)
+    {
+        // Pipe is full; the loop has plenty to be getting on with anyway
+    }
+    errno = errno_saved;
+}
+
+/*
+ * Handle signal from the event loop (rather than in the signal handler).  If
+ * interrupt is set, blocking calls that the signal arrives during aren't
+ * restarted (see event_signal_interrupted)
+ */
+int
+event_signal_add(int signo, void (*func)(int), bool interrupt)
+{
+    if (signo <= 0 || signo >= NSIG || signo > UCHAR_MAX) return -1;
+
+    s_signal_funcs[signo] = func;
+    s_signal_interrupts[signo] = interrupt;
+
+    struct sigaction sigact;
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = event_signal_handler;
+    sigact.sa_flags = interrupt ? 0 : SA_RESTART;
+    sigemptyset(&sigact.sa_mask);
+    if (sigaction(signo, &sigact, NULL) < 0)
+    {
+        s_signal_funcs[signo] = NULL;
+        s_signal_interrupts[signo] = false;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Whether an interrupting signal has arrived that the loop hasn't handled
+ * yet.  Anything that blocks outside of the loop (e.g. fetching a page)
+ * should give up once this is true
+ */
+bool
+event_signal_interrupted(void)
+{
+    return s_signal_interrupted;
+}
+
+static void
+event_signal_pipe_ready(int fd, short revents, void *data)
+{
+    (void)revents;
+    (void)data;
+
+    unsigned char signals[64];
+    ssize_t n;
+    s_signal_interrupted = 0;
+    while ((n = read(fd, signals, sizeof(signals))) > 0)
+    {
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            void (*const func)(int) = s_signal_funcs[signals[i]];
+            if (func) func(signals[i]);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+/*
+ * event.h
+ *
+ * The main event loop.  Everything the program waits on (terminal input,
+ * sockets, signals and timers) is registered here, and a single poll() call
+ * sleeps until one of them is ready, so nothing runs at all while idle.
+ *
+ * Signals are delivered through a pipe that the signal handler writes to
+ * (the "self-pipe trick"), so that their callbacks run from the loop rather
+ * than in the handler itself.  Signals that are added as interrupting ones
+ * (e.g. to quit) also make a blocking call that they arrive during fail with
+ * EINTR, and event_signal_interrupted() tells the caller to give up on it
+ * rather than carry on.  A second one that arrives before the loop has got to
+ * the first takes the signal's default action, in case the program is stuck
+ * in a call that can't be interrupted (e.g. looking up an address).
+ */
+
+// Maximum number of file descriptors and timers that can be registered
+#define EVENT_FDS_MAX 16
+#define EVENT_TIMERS_MAX 16
+
+void event_init(void);
+void event_deinit(void);
+void event_wait(void);
+
+int  event_fd_add(int, short, void (*)(int, short, void *), void *);
+void event_fd_remove(int);
+
+void event_timer_set(int, void (*)(void *), void *);
+void event_timer_cancel(void (*)(void *), void *);
+
+int  event_signal_add(int, void (*)(int), bool);
+bool event_signal_interrupted(void);
+
+#endif
@@ -8,6 +8,22 @@
 static struct fav_node *s_head, *s_tail;
 static bool s_favs_modified = false;
 
+/* Set the URI string of a node */
+static void
+favourites_set_uri(struct fav_node *n, const char *uri, size_t len)
+{
+    n->uri = malloc(len + 1);
+    if (!n->uri)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    memcpy(n->uri, uri, len);
+    n->uri[len] = '\0';
+    n->uri_len = len;
+    n->uri_hash = fnv1a(FNV1A_BASIS, uri, len);
+}
+
 void
 favourites_init(void)
 {
@@ -62,10 +78,7 @@ favourites_init(void)
         {
             *n->title = '\0';
         }
-        int uri_len = (int)(uri_end - uri_start);
-        n->uri = malloc(uri_len + 1);
-        strncpy(n->uri, uri_start, uri_len);
-        n->uri[uri_len] = '\0';
+        favourites_set_uri(n, uri_start, uri_end - uri_start);
 
         // Push the node
         favourites_push(n);
@@ -155,13 +168,18 @@ struct fav_node *
 favourites_find(const struct uri *u)
 {
     char s[URI_STRING_MAX];
-    uri_str(u, s, sizeof(s), URI_FLAGS_NO_TRAILING_SLASH_BIT);
+    const size_t len = min(
+        uri_str(u, s, sizeof(s), URI_FLAGS_NO_TRAILING_SLASH_BIT),
+        sizeof(s) - 1);
+    const uint32_t hash = fnv1a(FNV1A_BASIS, s, len);
 
     for (struct fav_node *n = s_head;
         n != NULL;
         n = n->link_n)
     {
-        if (strncmp(s, n->uri, URI_STRING_MAX) == 0)
+        if (n->uri_hash == hash &&
+            n->uri_len == len &&
+            memcmp(s, n->uri, len) == 0)
         {
             return n;
         }
@@ -196,9 +214,10 @@ favourites_push_uri(
 {
     struct fav_node *n = malloc(sizeof(struct fav_node));
 
-    // We allocate maximum URI size for now to keep things simple
-    n->uri = malloc(URI_STRING_MAX);
-    uri_str(u, n->uri, URI_STRING_MAX, URI_FLAGS_NO_TRAILING_SLASH_BIT);
+    char s[URI_STRING_MAX];
+    favourites_set_uri(n, s, min(
+        uri_str(u, s, sizeof(s), URI_FLAGS_NO_TRAILING_SLASH_BIT),
+        sizeof(s) - 1));
 
     if (title_len)
     {
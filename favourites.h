@@ -25,8 +25,11 @@ struct fav_node
 
     // Store the URI as a null-terminated dynamically-allocated string, so we
     // don't need maximum URI size for every node, as most of that space will
-    // be unused.
+    // be unused.  Its length and hash are kept so that most nodes can be
+    // passed over without comparing the strings
     char *uri;
+    size_t uri_len;
+    uint32_t uri_hash;
 
     // Name of the favourite
     char title[FAVOURITE_TITLE_MAX];
@@ -1,4 +1,5 @@
 #include "pch.h"
+#include "event.h"
 #include "gemini.h"
 #include "state.h"
 #include "tofu.h"
@@ -136,10 +137,11 @@ gemini_request(struct uri *uri)
     // Get response header
     // <status><space><meta><cr-lf>
     static char response_header[2 + 1 + 1024 + 2 + 1];
-    int response_code, ssl_error;
-    int response_header_len = 0, response_header_len_mime = 0;
+    int response_code = 0, ssl_error;
+    int response_header_len = 0;
     int response_bytes_read = 0;
     while (sizeof(response_header) - response_bytes_read > 0 &&
+        !event_signal_interrupted() &&
         (response_code = SSL_read(gem->ssl,
             response_header + response_bytes_read,
         sizeof(response_header) - response_bytes_read)) > 0)
@@ -161,7 +163,6 @@ gemini_request(struct uri *uri)
 
                 // Adjust the header length
                 response_header_len = x - response_header;
-                response_header_len_mime = strcspn(response_header, ";\0");
                 response_bytes_read += response_code;
                 goto got_crlf;
             }
@@ -169,6 +170,9 @@ gemini_request(struct uri *uri)
         response_bytes_read += response_code;
     }
 got_crlf:
+    // Give up if e.g. the program is quitting
+    if (event_signal_interrupted()) goto fail;
+
     if (response_code <= 0 &&
         (ssl_error = SSL_get_error(gem->ssl, response_code)) != SSL_ERROR_NONE)
     {
@@ -216,10 +220,10 @@ got_crlf:
             char chunk[512];
             size_t recv_bytes = 0;
 
-            // Copy MIME type
+            // Copy MIME type (and its parameters)
             mime_parse(&g_recv->mime,
                 response_header + 2 + 1,
-                response_header_len_mime - 2 - 1);
+                response_header_len - 2 - 1);
 
             // Read whatever was left from the header chunk after the header
             // (or else we end up with missing content...)
@@ -235,15 +239,16 @@ got_crlf:
             }
 
             // Read response body in chunks
-            while ((response_code =
-                SSL_read(gem->ssl, chunk, sizeof(chunk))) > 0)
+            while (!event_signal_interrupted() &&
+                (response_code =
+                    SSL_read(gem->ssl, chunk, sizeof(chunk))) > 0)
             {
                 recv_buffer_check_size(recv_bytes + response_code);
                 memcpy(g_recv->b + recv_bytes, chunk, response_code);
                 recv_bytes += response_code;
             }
             g_recv->size = 0;
-            if (response_code < 0)
+            if (response_code < 0 || event_signal_interrupted())
             {
                 tui_status_say("Error reading server response body");
                 goto fail;
@@ -302,7 +307,8 @@ fail:
         SSL_free(gem->ssl);
         gem->ssl = NULL;
     }
-    close(gem->sock);
+    // No socket if the connection failed (don't close stdin!)
+    if (gem->sock) close(gem->sock);
     gem->sock = 0;
 
     return ret_status;
@@ -1,4 +1,5 @@
 #include "pch.h"
+#include "event.h"
 #include "gopher.h"
 #include "state.h"
 #include "tui.h"
@@ -85,8 +86,9 @@ gopher_request(struct uri *uri)
 
     // Read response body in chunks
     size_t recv_bytes = 0;
-    int response_code;
+    int response_code = 0;
     for (char chunk[512];
+        !event_signal_interrupted() &&
         (response_code = read(ph->sock, chunk, sizeof(chunk))) > 0;)
     {
         recv_buffer_check_size(recv_bytes + response_code);
@@ -94,7 +96,7 @@ gopher_request(struct uri *uri)
         recv_bytes += response_code;
     }
     g_recv->size = 0;
-    if (response_code < 0)
+    if (response_code < 0 || event_signal_interrupted())
     {
         tui_status_begin();
         tui_printf("Error reading server response body");
@@ -111,7 +113,8 @@ gopher_request(struct uri *uri)
         gopher_item_to_mime(uri->gopher_item), MIME_TYPE_MAX);
 
 fail:
-    close(ph->sock);
+    // No socket if the connection failed (don't close stdin!)
+    if (ph->sock) close(ph->sock);
     ph->sock = 0;
 
     return ret_status;
@@ -5,8 +5,10 @@
 #include "state.h"
 #include "uri.h"
 
+// End of the current history stack's items
+#define HISTORY_END (g_hist->items + MAX_HISTORY_SIZE)
+
 struct history_stack *g_hist;
-static struct history_item *max_hist_ptr = NULL;
 static struct history_item *get_next_hist_ptr(void);
 static struct history_item *get_prev_hist_ptr(void);
 
@@ -15,16 +17,38 @@ history_init(void)
 {
     // Initialise history stack
     g_hist = &g_state.hist;
-    g_hist->items = calloc(MAX_HISTORY_SIZE, sizeof(struct history_item));
-    g_hist->ptr = g_hist->items;
-    g_hist->oldest_ptr = g_hist->items;
-    max_hist_ptr = g_hist->items + MAX_HISTORY_SIZE;
+    history_stack_init(g_hist);
 }
 
 void
 history_deinit(void)
 {
-    free(g_hist->items);
+    history_stack_deinit(g_hist);
+}
+
+/* Initialise an empty undo/redo stack (each tab has its own) */
+void
+history_stack_init(struct history_stack *h)
+{
+    h->items = calloc(MAX_HISTORY_SIZE, sizeof(struct history_item));
+    if (!h->items)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    h->ptr = h->items;
+    h->oldest_ptr = h->items;
+}
+
+void
+history_stack_deinit(struct history_stack *h)
+{
+    for (int i = 0; h->items && i < MAX_HISTORY_SIZE; ++i)
+    {
+        uri_strings_free(&h->items[i].strings);
+    }
+    free(h->items);
+    h->items = h->ptr = h->oldest_ptr = NULL;
 }
 
 void
@@ -36,7 +60,7 @@ history_push(struct uri *uri)
     // Increment oldest pointer
     if (g_hist->ptr == g_hist->oldest_ptr)
     {
-        if (g_hist->oldest_ptr + 1 >= max_hist_ptr)
+        if (g_hist->oldest_ptr + 1 >= HISTORY_END)
         {
             g_hist->oldest_ptr = g_hist->items;
         }
@@ -47,7 +71,8 @@ history_push(struct uri *uri)
     }
 
     g_hist->ptr->initialised = true;
-    memcpy(&g_hist->ptr->uri, uri, sizeof(struct uri));
+    g_hist->ptr->strings.len = 0;
+    uri_pack(&g_hist->ptr->uri, uri, &g_hist->ptr->strings);
 
     // Now that we've pushed new history onto the stack we need to deinitialise
     // everything else after what was here
@@ -58,7 +83,7 @@ history_push(struct uri *uri)
             i < g_hist->oldest_ptr;
             i->initialised = false, ++i);
         for (i = g_hist->ptr + 1;
-            i < max_hist_ptr;
+            i < HISTORY_END;
             i->initialised = false, ++i);
     }
     else
@@ -161,7 +186,7 @@ history_next(void)
 static struct history_item *
 get_next_hist_ptr(void)
 {
-    if (g_hist->ptr + 1 >= max_hist_ptr)
+    if (g_hist->ptr + 1 >= HISTORY_END)
     {
         return g_hist->items;
     }
@@ -174,7 +199,7 @@ get_prev_hist_ptr(void)
 {
     if (g_hist->ptr - 1 < g_hist->items)
     {
-        return max_hist_ptr - 1;
+        return HISTORY_END - 1;
     }
     return g_hist->ptr - 1;
 }
@@ -19,8 +19,9 @@ struct history_item
     // Whether this history item has been properly initialised with a URI
     bool initialised;
 
-    // URI the item points to
-    struct uri uri;
+    // URI the item points to, packed into the item's own strings
+    struct uri_packed uri;
+    struct uri_strings strings;
 };
 
 /*
@@ -46,11 +47,21 @@ extern struct history_stack *g_hist;
 void history_init(void);
 void history_deinit(void);
 void history_push(struct uri *);
+void history_stack_init(struct history_stack *);
+void history_stack_deinit(struct history_stack *);
 
 // History stack functions
 const struct history_item *const history_pop(void);
 const struct history_item *const history_next(void);
 
+/* Get the URI of a history item */
+static inline struct uri *
+history_item_uri(const struct history_item *item, struct uri *uri)
+{
+    uri_unpack(uri, &item->uri, &item->strings);
+    return uri;
+}
+
 // History log functions
 int history_log_display(void);
 
@@ -1,10 +1,88 @@
 #include "pch.h"
 #include "hyphenate_alg.h"
+#include "hyphenate_patterns.h"
 
-static int s_hyphens[1024];
+/*
+ * Liang's hyphenation algorithm (as used by TeX).  The pattern sets in
+ * hyphenation/ are compiled at build time into packed tries (see
+ * tools/hyph_compile.c); here we just walk the trie from each letter of the
+ * word and keep the highest value seen between each pair of letters.  Odd
+ * values are allowed hyphenation points.
+ */
+
+// Longest word (in bytes) that we attempt to hyphenate; hyphenation points are
+// kept as a 64-bit mask of byte offsets
+#define HYPHENATE_WORD_MAX 64
+
+// Number of entries in the per-word result cache, must be a power of two
+#define HYPHENATE_CACHE_SIZE 4096
+
+// Longest word (in bytes) that is stored in the cache
+#define HYPHENATE_CACHE_WORD_MAX 38
+
+struct hyphenate_cache_entry
+{
+    // Bit n set if there is a hyphenation point at byte offset n
+    uint64_t breaks;
+    uint8_t len;
+    char word[HYPHENATE_CACHE_WORD_MAX];
+};
+
+static int s_hyphens[HYPHENATE_WORD_MAX];
 static int s_count;
 static int s_cur;
 
+static const struct hyph_lang *s_lang = NULL;
+static bool s_lang_set = false;
+static struct hyphenate_cache_entry s_cache[HYPHENATE_CACHE_SIZE];
+
+static uint64_t hyphenate_word(const char *, size_t);
+
+/* Select the pattern set to use from a language tag (e.g. "en-GB") */
+void
+hyphenate_set_lang(const char *tag)
+{
+    const struct hyph_lang *lang = NULL, *primary = NULL;
+
+    if (!tag || !*tag) tag = TYPESET_HYPHENATION_LANG;
+
+    const size_t tag_primary = strcspn(tag, "-_");
+    for (size_t i = 0; i < sizeof(HYPH_LANGS) / sizeof(HYPH_LANGS[0]); ++i)
+    {
+        const char *name = HYPH_LANGS[i].name;
+
+        // Exact match (regions may be written with an underscore)
+        size_t n;
+        for (n = 0; name[n] && tag[n]; ++n)
+        {
+            if (tolower(tag[n]) != name[n] &&
+                !(tag[n] == '_' && name[n] == '-')) break;
+        }
+        if (!name[n] && !tag[n])
+        {
+            lang = &HYPH_LANGS[i];
+            break;
+        }
+
+        // Otherwise fall back to any set for the same language, preferring
+        // the configured one
+        if (strcspn(name, "-") == tag_primary &&
+            strncasecmp(name, tag, tag_primary) == 0 &&
+            (!primary || strcmp(name, TYPESET_HYPHENATION_LANG) == 0))
+        {
+            primary = &HYPH_LANGS[i];
+        }
+    }
+    if (!lang) lang = primary;
+
+    if (s_lang_set && lang == s_lang) return;
+
+    // Languages that we have no patterns for are not hyphenated at all
+    s_lang = lang;
+    s_lang_set = true;
+    memset(s_cache, 0, sizeof(s_cache));
+}
+
 /* Start hyphenating a word */
 void
 hyphenate(const char *word, size_t word_len)
@@ -16,42 +94,40 @@ hyphenate(const char *word, size_t word_len)
     return;
 #endif
 
-    if (!word_len) return;
+    if (!word_len || word_len > HYPHENATE_WORD_MAX) return;
+
+    if (!s_lang_set) hyphenate_set_lang(NULL);
+    if (!s_lang) return;
 
-    // This is an extremely basic hyphenation algorithm that doesn't take into
-    // account any pattern matching, etc., and hence produces awful results for
-    // most words.  This is just temporary until a proper algorithm is
-    // implemented
-    for (const char *c = word; c < word + word_len; ++c)
+    uint64_t breaks;
+    if (word_len <= HYPHENATE_CACHE_WORD_MAX)
     {
-        // Don't hyphenate if there's an explicit hyphen in it and the word is
-        // short enough
-        if (*c == '-' && word_len < 24)
-        {
-            s_count = 0;
-            s_cur = -1;
-            return;
-        }
+        // Hash of the word, to look it up in the cache
+        const uint32_t hash = fnv1a(FNV1A_BASIS, word, word_len);
 
-        // Check if the word contains multi-byte/UTF-8 sequences.  If so then
-        // we give up attempting to hyphenate the word, as if we try split it
-        // there's a good chance that we will create a split between the
-        // multibyte sequence and screw up the width for the line breaking
-        // algorithm
-        if ((*c & 0xC0) == 0x80)
+        struct hyphenate_cache_entry *e =
+            &s_cache[hash & (HYPHENATE_CACHE_SIZE - 1)];
+        if (e->len == word_len && memcmp(e->word, word, word_len) == 0)
         {
-            s_count = 0;
-            s_cur = -1;
-            return;
+            breaks = e->breaks;
         }
-
-        if (c - word > 3 &&
-            c - word < word_len - 2 &&
-            (c - word) % 2 == 0)
+        else
         {
-            s_hyphens[s_count++] = c - word;
+            breaks = hyphenate_word(word, word_len);
+            e->breaks = breaks;
+            e->len = word_len;
+            memcpy(e->word, word, word_len);
         }
     }
+    else
+    {
+        breaks = hyphenate_word(word, word_len);
+    }
+
+    for (; breaks; breaks &= breaks - 1)
+    {
+        s_hyphens[s_count++] = __builtin_ctzll(breaks);
+    }
 }
 
 /* Get next hyphenation (-1 on end) */
@@ -67,3 +143,135 @@ hyphenate_get(void)
 
     return s_hyphens[s_cur++];
 }
+
+/*
+ * Get the lowercase Latin-1 letter at c, or 0 if it isn't a letter (or is
+ * outside of Latin-1).  The length of the character is stored in len
+ */
+static inline uint8_t
+hyphenate_letter(const char *c, const char *end, int *len)
+{
+    const uint8_t b = c[0];
+    *len = 1;
+
+    if (b < 0x80)
+    {
+        if (b >= 'A' && b <= 'Z') return b + ('a' - 'A');
+        if (b >= 'a' && b <= 'z') return b;
+        return 0;
+    }
+
+    // Only two-byte sequences can be Latin-1
+    if ((b != 0xc3 && b != 0xc2) ||
+        c + 1 >= end ||
+        (c[1] & 0xc0) != 0x80)
+    {
+        return 0;
+    }
+    *len = 2;
+
+    const uint8_t cp = ((b & 0x1f) << 6) | (c[1] & 0x3f);
+    if (cp < 0xc0 || cp == 0xd7 || cp == 0xf7) return 0;
+    if (cp <= 0xde) return cp + 0x20;
+    return cp;
+}
+
+/* Find hyphenation points of a word, as a bitmask of byte offsets */
+static uint64_t
+hyphenate_word(const char *word, size_t word_len)
+{
+    const char *c = word, *end = word + word_len;
+    int len;
+
+    // Skip leading punctuation, quotes, etc.
+    for (; c < end && !hyphenate_letter(c, end, &len); c += len);
+
+    // Letters of the word, surrounded by the '.' word boundary markers
+    uint8_t letters[HYPHENATE_WORD_MAX + 3];
+    int offsets[HYPHENATE_WORD_MAX];
+    int count = 0;
+    letters[0] = '.';
+
+    for (; c < end; c += len)
+    {
+        const uint8_t l = hyphenate_letter(c, end, &len);
+        if (!l) break;
+        if (count >= HYPHENATE_WORD_MAX) return 0;
+        offsets[count] = c - word;
+        letters[++count] = l;
+    }
+
+    // Only trailing punctuation is allowed after the letters; anything else
+    // (digits, apostrophes, other scripts, etc.) and we leave it alone
+    for (; c < end; c += len)
+    {
+        if (hyphenate_letter(c, end, &len) ||
+            (uint8_t)*c >= 0x80 ||
+            isalnum(*c) ||
+            *c == '\'' ||
+            *c == '-')
+        {
+            return 0;
+        }
+    }
+
+    const struct hyph_lang *const lang = s_lang;
+    if (count < lang->leftmin + lang->rightmin) return 0;
+
+    // The pattern values between each letter; values[n] is the value before
+    // the nth letter (counting the leading '.')
+    uint8_t values[HYPHENATE_WORD_MAX + 3] = { 0 };
+
+    // Exceptions override the patterns entirely
+    int lo = 0, hi = lang->exception_count - 1;
+    letters[count + 1] = '\0';
+    while (lo <= hi)
+    {
+        const int mid = (lo + hi) / 2;
+        const int cmp = strcmp(
+            (const char *)letters + 1, lang->exceptions[mid].word);
+        if (cmp < 0) hi = mid - 1;
+        else if (cmp > 0) lo = mid + 1;
+        else
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                values[i + 1] = (lang->exceptions[mid].breaks >> i) & 1;
+            }
+            goto breaks;
+        }
+    }
+    letters[count + 1] = '.';
+
+    for (int i = 0; i < count + 2; ++i)
+    {
+        const struct hyph_node *node = &lang->nodes[0];
+        for (int j = i; j < count + 2; ++j)
+        {
+            // Find the child node for this letter
+            const struct hyph_node
+                *child = &lang->nodes[node->child],
+                *const child_end = child + node->child_count;
+            for (; child < child_end && child->ch < letters[j]; ++child);
+            if (child >= child_end || child->ch != letters[j]) break;
+            node = child;
+
+            if (!node->values) continue;
+
+            // Pattern spans letters i..j, with a value either side of each
+            const uint8_t *v = &lang->values[node->values];
+            for (int k = 0; k <= j - i + 1; ++k)
+            {
+                if (v[k] > values[i + k]) values[i + k] = v[k];
+            }
+        }
+    }
+
+breaks:;
+    uint64_t breaks = 0;
+    for (int i = lang->leftmin; i <= count - lang->rightmin; ++i)
+    {
+        if (values[i + 1] & 1) breaks |= (uint64_t)1 << offsets[i];
+    }
+    return breaks;
+}
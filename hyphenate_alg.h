@@ -1,6 +1,7 @@
 #ifndef HYPHENATE_ALG_H
 #define HYPHENATE_ALG_H
 
+void hyphenate_set_lang(const char *);
 void hyphenate(const char *, size_t);
 int hyphenate_get(void);
 
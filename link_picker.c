@@ -0,0 +1,435 @@
+#include "pch.h"
+#include "link_picker.h"
+#include "pager.h"
+#include "state.h"
+#include "status_line.h"
+#include "tui.h"
+#include "tui_input_prompt.h"
+#include "typesetter.h"
+#include "uri.h"
+
+// Score for each character of the query that's matched, plus a bonus if it
+// follows the previous one or begins a word.  Each character skipped over in
+// between costs a point
+#define LINK_PICKER_SCORE_CHAR 16
+#define LINK_PICKER_BONUS_CONSECUTIVE 16
+#define LINK_PICKER_BONUS_WORD 8
+
+// Scores are kept below this, so that matches can be ranked by counting them
+#define LINK_PICKER_SCORE_MAX 8192
+
+struct link_picker_match
+{
+    int link, score;
+};
+
+static struct
+{
+    // Query (lowercased) that the matches are for, if any
+    char query[TUI_INPUT_BUFFER_MAX];
+    size_t query_len;
+    bool valid;
+
+    // Links that match the query, in order of link
+    struct link_picker_match *matches;
+    int match_count, match_capacity;
+
+    // The matching links, best first
+    int *ranked;
+
+    // Number of matches with each score, while ranking
+    int buckets[LINK_PICKER_SCORE_MAX];
+
+    // Selected match, and the first one that is shown
+    int selected, top;
+} s_picker;
+
+static inline char
+link_picker_lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static inline bool
+link_picker_is_alnum(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+/* Add the text of a link to the arena */
+static void
+link_picker_add(int link_index)
+{
+    struct pager_link *const link = &g_pager->links[link_index];
+    const char *const label =
+        g_pager->typeset.raw_lines[link->raw_index].s + link->label;
+    const size_t label_len = link->label_len;
+
+    struct uri link_uri;
+    char uri[URI_STRING_MAX];
+    const size_t uri_len = min(
+        uri_str(pager_link_uri(link_index, &link_uri), uri, sizeof(uri), 0),
+        sizeof(uri) - 1);
+
+    // The label and URI are separated by a space
+    const size_t n = label_len + 1 + uri_len;
+    if (g_pager->link_text_len + n > g_pager->link_text_capacity)
+    {
+        size_t new_cap = max(g_pager->link_text_capacity, 4096);
+        while (new_cap < g_pager->link_text_len + n)
+        {
+            new_cap = (new_cap * 3) / 2;
+        }
+
+        char *tmp = realloc(g_pager->link_text, new_cap);
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        g_pager->link_text = tmp;
+        g_pager->link_text_capacity = new_cap;
+    }
+
+    char *const text = g_pager->link_text + g_pager->link_text_len;
+    for (size_t i = 0; i < label_len; ++i)
+    {
+        text[i] = link_picker_lower(label[i]);
+    }
+    text[label_len] = ' ';
+    for (size_t i = 0; i < uri_len; ++i)
+    {
+        text[label_len + 1 + i] = link_picker_lower(uri[i]);
+    }
+
+    link->text = g_pager->link_text_len;
+    link->text_len = n;
+    g_pager->link_text_len += n;
+}
+
+/*
+ * Put the text of all of the page's links in the arena, unless it's there
+ * already (it's emptied whenever the page's links are found again)
+ */
+static void
+link_picker_fill(void)
+{
+    if (g_pager->link_text_len) return;
+
+    for (int i = 0; i < g_pager->link_count; ++i) link_picker_add(i);
+}
+
+/*
+ * Score how well a query matches some text, or -1 if it doesn't have all of
+ * the query's characters in order
+ */
+static int
+link_picker_score(const char *s, size_t n, const char *q, size_t q_len)
+{
+    const char *const end = s + n;
+
+    // Find where the first match of the query ends
+    const char *c = s;
+    for (size_t j = 0; j < q_len; ++j, ++c)
+    {
+        if (!(c = memchr(c, q[j], end - c))) return -1;
+    }
+
+    // Then go back from there for the shortest match that ends there too
+    const char *begin = c;
+    for (size_t j = q_len; j > 0;)
+    {
+        if (*--begin == q[j - 1]) --j;
+    }
+
+    int score = 0;
+    const char *prev = NULL;
+    for (size_t j = 0; j < q_len; ++begin)
+    {
+        if (*begin != q[j]) continue;
+
+        score += LINK_PICKER_SCORE_CHAR;
+        if (prev && begin == prev + 1) score += LINK_PICKER_BONUS_CONSECUTIVE;
+        else if (prev) score -= begin - prev - 1;
+        if (begin == s || !link_picker_is_alnum(begin[-1]))
+        {
+            score += LINK_PICKER_BONUS_WORD;
+        }
+
+        prev = begin;
+        ++j;
+    }
+
+    return max(min(score, LINK_PICKER_SCORE_MAX - 1), 0);
+}
+
+/* Score the match of a link against the current query */
+static inline int
+link_picker_score_link(int i)
+{
+    const struct pager_link *const link = &g_pager->links[i];
+    return link_picker_score(
+        g_pager->link_text + link->text, link->text_len,
+        s_picker.query, s_picker.query_len);
+}
+
+/*
+ * Find the links that match a query, and rank them best first (links that
+ * match equally well stay in order).  Returns the number of matches
+ */
+int
+link_picker_rank(const char *query, size_t len)
+{
+    char q[TUI_INPUT_BUFFER_MAX];
+    len = min(len, sizeof(q));
+    for (size_t i = 0; i < len; ++i) q[i] = link_picker_lower(query[i]);
+
+    // Nothing to do if it's the same query (e.g. the caret moved)
+    if (s_picker.valid &&
+        len == s_picker.query_len &&
+        memcmp(q, s_picker.query, len) == 0)
+    {
+        return s_picker.match_count;
+    }
+
+    link_picker_fill();
+
+    if (s_picker.match_capacity < g_pager->link_count)
+    {
+        free(s_picker.matches);
+        free(s_picker.ranked);
+        s_picker.match_capacity = g_pager->link_count;
+        s_picker.matches = malloc(
+            s_picker.match_capacity * sizeof(struct link_picker_match));
+        s_picker.ranked = malloc(s_picker.match_capacity * sizeof(int));
+        if (!s_picker.matches || !s_picker.ranked)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+    }
+
+    // Anything that matches a longer query matches the one it began with, so
+    // only those links need to be looked at again
+    const bool narrowing =
+        s_picker.valid &&
+        len >= s_picker.query_len &&
+        memcmp(q, s_picker.query, s_picker.query_len) == 0;
+
+    memcpy(s_picker.query, q, len);
+    s_picker.query_len = len;
+    s_picker.valid = true;
+
+    int count = 0;
+    if (narrowing)
+    {
+        for (int k = 0; k < s_picker.match_count; ++k)
+        {
+            const int i = s_picker.matches[k].link;
+            const int score = link_picker_score_link(i);
+            if (score < 0) continue;
+            s_picker.matches[count++] = (struct link_picker_match) { i, score };
+        }
+    }
+    else
+    {
+        for (int i = 0; i < g_pager->link_count; ++i)
+        {
+            const int score = link_picker_score_link(i);
+            if (score < 0) continue;
+            s_picker.matches[count++] = (struct link_picker_match) { i, score };
+        }
+    }
+    s_picker.match_count = count;
+
+    // Rank them by counting how many there are of each score, which gives
+    // where each score begins
+    memset(s_picker.buckets, 0, sizeof(s_picker.buckets));
+    for (int k = 0; k < count; ++k)
+    {
+        ++s_picker.buckets[s_picker.matches[k].score];
+    }
+    for (int score = LINK_PICKER_SCORE_MAX - 1, pos = 0; score >= 0; --score)
+    {
+        const int n = s_picker.buckets[score];
+        s_picker.buckets[score] = pos;
+        pos += n;
+    }
+    for (int k = 0; k < count; ++k)
+    {
+        const struct link_picker_match *const m = &s_picker.matches[k];
+        s_picker.ranked[s_picker.buckets[m->score]++] = m->link;
+    }
+
+    s_picker.selected = 0;
+    s_picker.top = 0;
+    return count;
+}
+
+/* Forget the matches */
+void
+link_picker_reset(void)
+{
+    free(s_picker.matches);
+    free(s_picker.ranked);
+    s_picker.matches = NULL;
+    s_picker.ranked = NULL;
+    s_picker.match_count = 0;
+    s_picker.match_capacity = 0;
+    s_picker.valid = false;
+}
+
+/* Show the number of matches after the query */
+static void
+link_picker_say_count(void)
+{
+    tui_status_begin_soft();
+    tui_cursor_move(g_in->prompt_len + 1 + g_in->buffer_len, g_tui->h);
+    tui_printf("  (%d/%d)\x1b[K", s_picker.match_count, g_pager->link_count);
+    tui_cursor_move(g_in->prompt_len + 1 + g_in->caret, g_tui->h);
+    tui_status_end();
+}
+
+/* Begin picking a link, with every link listed */
+void
+link_picker_open(void)
+{
+    // Need the whole document typeset, to show where each link is
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+    if (!g_pager->typeset.links_typeset)
+    {
+        tui_status_say("No links on this page");
+        return;
+    }
+
+    link_picker_reset();
+    tui_input_prompt_begin(
+        TUI_MODE_LINK_PICKER,
+        "find link: ", 0,
+        NULL,
+        NULL);
+    link_picker_update("", 0);
+}
+
+/* The query was changed */
+void
+link_picker_update(const char *query, size_t len)
+{
+    link_picker_rank(query, len);
+
+    tui_invalidate(INVALIDATE_PAGER_BIT);
+    link_picker_say_count();
+}
+
+/* Move the selection by a number of matches */
+void
+link_picker_move(int amount)
+{
+    s_picker.selected = max(min(s_picker.selected + amount,
+        s_picker.match_count - 1), 0);
+
+    tui_invalidate(INVALIDATE_PAGER_BIT);
+}
+
+/*
+ * Stop picking a link, selecting (and scrolling to) the one that was picked
+ * if choose is set.  Returns whether there was one
+ */
+bool
+link_picker_close(bool choose)
+{
+    const bool chosen = choose && s_picker.selected < s_picker.match_count;
+    if (chosen)
+    {
+        const int i = s_picker.ranked[s_picker.selected];
+        g_pager->link_index = i;
+
+        // Bring it into view if it isn't already (and has been typeset)
+        const int line = g_pager->links[i].line_index;
+        if (i < g_pager->typeset.links_typeset &&
+            (line < g_pager->scroll ||
+            line >= g_pager->scroll + g_pager->visible_buffer.h))
+        {
+            g_pager->scroll = max(line - g_pager->visible_buffer.h / 2, 0);
+        }
+    }
+
+    link_picker_reset();
+    return chosen;
+}
+
+/* Paint a link in the list, on the row that the cursor is at */
+static void
+link_picker_paint_link(int i, bool selected)
+{
+    // Links that haven't been typeset (as the pager is too narrow) have no
+    // line to show
+    if (i >= g_pager->typeset.links_typeset) return;
+
+    const struct pager_link *const link = &g_pager->links[i];
+    const struct pager_buffer_line *const line =
+        &g_pager->buffer.lines[link->line_index];
+    int width = g_pager->visible_buffer.w -
+        g_pager->margin.l - g_pager->margin.r;
+
+    // The link as it's shown on the page (just its first line), without the
+    // indent that lines up the link numbers
+    const char *s = pager_line_str(&g_pager->buffer, line);
+    size_t bytes = line->bytes, prefix = line->proto_len;
+    for (; bytes && *s == ' '; ++s, --bytes, prefix -= prefix > 0);
+    prefix = min(prefix, bytes);
+
+    tui_say(selected ? "\x1b[7m" : COLOUR_PAGER_LINK_PROTOCOL);
+    const size_t prefix_shown = utf8_size_w(s, prefix, width);
+    tui_sayn(s, prefix_shown);
+    width -= utf8_width(s, prefix_shown);
+    if (!selected) tui_say("\x1b[0m");
+
+    const size_t text_shown = utf8_size_w(s + prefix, bytes - prefix, width);
+    tui_sayn(s + prefix, text_shown);
+    width -= utf8_width(s + prefix, text_shown);
+
+    // Then its URI, if there's room
+    if (width < 2) return;
+    struct uri link_uri;
+    char uri[URI_STRING_MAX];
+    const size_t uri_len = min(
+        uri_str(pager_link_uri(i, &link_uri), uri, sizeof(uri), 0),
+        sizeof(uri) - 1);
+    tui_say(selected ? " " : " \x1b[2m");
+    tui_sayn(uri, utf8_size_w(uri, uri_len, width - 1));
+}
+
+/* Paint the matching links over the pager */
+void
+link_picker_paint(void)
+{
+    const int h = g_pager->visible_buffer.h;
+
+    // The page may have been typeset again (e.g. on resize) since it opened
+    typeset_all(&g_pager->typeset, &g_pager->buffer);
+
+    // Keep the selected link in view
+    if (s_picker.selected < s_picker.top)
+    {
+        s_picker.top = s_picker.selected;
+    }
+    else if (s_picker.selected >= s_picker.top + h)
+    {
+        s_picker.top = s_picker.selected - h + 1;
+    }
+
+    for (int row = 0; row < h; ++row)
+    {
+        const int k = s_picker.top + row;
+        tui_cursor_move(g_pager->margin.l, row + 1 + STATUS_LINE_TOP_HEIGHT);
+        if (k < s_picker.match_count)
+        {
+            link_picker_paint_link(s_picker.ranked[k], k == s_picker.selected);
+        }
+        tui_say("\x1b[0m\x1b[K");
+    }
+
+    // None of the pager's rows are left on the terminal
+    g_pager->scroll_painted = -1;
+}
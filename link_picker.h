@@ -0,0 +1,26 @@
+#ifndef LINK_PICKER_H
+#define LINK_PICKER_H
+
+/*
+ * link_picker.h
+ *
+ * Fuzzy finder for the links of the page.  As a query is typed, the links
+ * whose label or URI has all of its characters in order are listed over the
+ * pager, best first, and one can be picked to be followed.
+ *
+ * The text that's matched against is put in one lowercased arena (see
+ * pager_state.link_text) when the picker is first used on the page, so each
+ * keystroke is just a scan through it; and when the query only grows, only
+ * the links that matched before are looked at again
+ */
+
+int link_picker_rank(const char *, size_t);
+void link_picker_reset(void);
+
+void link_picker_open(void);
+void link_picker_update(const char *, size_t);
+void link_picker_move(int);
+bool link_picker_close(bool);
+void link_picker_paint(void);
+
+#endif
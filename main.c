@@ -1,10 +1,14 @@
 #include "pch.h"
 #include "cache.h"
+#include "event.h"
 #include "favourites.h"
+#include "page_pool.h"
 #include "paths.h"
+#include "render.h"
 #include "sighandle.h"
 #include "state.h"
 #include "status_line.h"
+#include "tabs.h"
 #include "tofu.h"
 #include "tui.h"
 
@@ -16,13 +20,68 @@ struct recv_buffer *g_recv;
 
 void program_exited(void);
 
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: " PROGRAM_NAME " [file or URI]\n"
+        "       " PROGRAM_NAME " --render [--width N] [--repeat N] [--plain] "
+        "file or URI\n");
+}
+
+/* Parse a positive integer option value */
+static int
+parse_count(const char *opt, const char *s)
+{
+    char *end;
+    const long n = s ? strtol(s, &end, 10) : 0;
+    if (!s || *end != '\0' || n <= 0 || n > INT_MAX)
+    {
+        fprintf(stderr, "%s expects a positive number\n", opt);
+        usage();
+        exit(-1);
+    }
+    return n;
+}
+
 int
 main(int argc, char **argv)
 {
     setlocale(LC_ALL, "");
 
+    // Headless rendering options
+    bool render = false, render_plain = false;
+    int render_width = RENDER_WIDTH_DEFAULT, render_repeat = 1;
+
+    // Pick out the options, leaving just the files/URIs in argv
+    {
+        char **arg_out = argv + 1;
+        for (char **arg = argv + 1; *arg != NULL; ++arg)
+        {
+            if (strcmp(*arg, "--render") == 0) render = true;
+            else if (strcmp(*arg, "--plain") == 0) render_plain = true;
+            else if (strcmp(*arg, "--width") == 0)
+            {
+                render_width = parse_count(*arg, arg[1]);
+                ++arg;
+            }
+            else if (strcmp(*arg, "--repeat") == 0)
+            {
+                render_repeat = parse_count(*arg, arg[1]);
+                ++arg;
+            }
+            else if (strncmp(*arg, "--", 2) == 0)
+            {
+                fprintf(stderr, "unknown option '%s'\n", *arg);
+                usage();
+                return -1;
+            }
+            else *arg_out++ = *arg;
+        }
+        *arg_out = NULL;
+    }
+
     if (paths_init() < 0) return -1;
-    utf8_init();
 
 #if 0
     const char *word = "hyphenate";
@@ -52,11 +111,17 @@ main(int argc, char **argv)
     history_init();
     favourites_init();
 
-    sighandle_register();
+    event_init();
+
+    // Signals are handled by the event loop, which a headless render doesn't
+    // run; so it's left to be interrupted as usual
+    if (!render) sighandle_register();
 
     pager_init();
+    tabs_init();
     status_line_init();
-    tui_init();
+    if (render) tui_init_headless(render_width, RENDER_HEIGHT);
+    else tui_init();
 
     gemini_init();
     tofu_init();
@@ -68,6 +133,7 @@ main(int argc, char **argv)
         CMD_ARGS_FILE,
         CMD_ARGS_URI,
     } argmode = CMD_ARGS_NONE;
+    const bool have_args = argv[1] != NULL;
 
     // Check the command-line args for content
     for (++argv; *argv != NULL; ++argv)
@@ -82,14 +148,17 @@ main(int argc, char **argv)
             uri.protocol = PROTOCOL_FILE;
             strncpy(uri.path, *argv, URI_PATH_MAX);
 
-            tui_go_to_uri(&uri, true, false);
+            if (tui_go_to_uri(&uri, !render, false) < 0 && render)
+            {
+                argmode = CMD_ARGS_NONE;
+            }
 
             break;
         }
 
         // See if we can parse a URI
         struct uri uri = uri_parse(*argv, strlen(*argv));
-        if (tui_go_to_uri(&uri, true, false) == 0)
+        if (tui_go_to_uri(&uri, !render, false) == 0)
         {
             argmode = CMD_ARGS_URI;
             break;
@@ -135,6 +204,20 @@ main(int argc, char **argv)
         "Stupidly long word here that hopefullywillgetdetectedbythesearchingalgorithmthingtestintetsfdidsifisdfidsifsdiihyphenationsrtiewroewirewoirweiriweiriweri\n"
         "This is a test paragraph\n";
 #endif
+    if (render)
+    {
+        int status = -1;
+        if (argmode != CMD_ARGS_NONE)
+        {
+            status = render_page(render_width, render_repeat, render_plain);
+        }
+        else if (have_args) fprintf(stderr, "failed to load page\n");
+        else usage();
+
+        program_exited();
+        return status;
+    }
+
     if (argmode == CMD_ARGS_NONE)
     {
     #if 0
@@ -169,6 +252,11 @@ program_exited(void)
     if (exited) return;
     exited = true;
 
+    // Tabs copy their page out of the cache (if it was there), so they go
+    // before it
+    tabs_deinit();
+    page_pool_deinit();
+
     cache_deinit();
     tofu_deinit();
 
@@ -180,9 +268,11 @@ program_exited(void)
 
     favourites_deinit();
     history_deinit();
+    uri_intern_deinit();
 
     free(g_recv->b);
 
     paths_deinit();
-    utf8_deinit();
+
+    event_deinit();
 }
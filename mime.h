@@ -2,6 +2,7 @@
 #define MIME_H
 
 #define MIME_TYPE_MAX 64
+#define MIME_LANG_MAX 16
 
 #define MIME_GEMTEXT "text/gemini"
 #define MIME_GOPHERMAP "text/gophermap"
@@ -9,36 +10,57 @@
 
 struct mime
 {
-    // Full MIME type string
+    // Full MIME type string (without parameters)
     char str[MIME_TYPE_MAX];
 
     // Location of '/' in string
     int sep;
+
+    // Value of the "lang" parameter, if any (e.g. "en-GB")
+    char lang[MIME_LANG_MAX];
 };
 
-/* Parse a MIME type */
+/* Parse a MIME type, with optional parameters */
 static inline void
 mime_parse(struct mime *m, const char *s, size_t s_len)
 {
-    // Copy full string
-    const size_t len = min(MIME_TYPE_MAX, s_len + 1);
-    strncpy(m->str, s, len);
-    m->str[len - 1] = '\0';
+    const char *const s_end = s + s_len;
+
+    // Type ends at the first parameter
+    const char *type_end = s;
+    for (; type_end < s_end && *type_end && *type_end != ';'; ++type_end);
+    const char *param = type_end;
+    for (; type_end > s && isspace(type_end[-1]); --type_end);
+
+    // Copy type string
+    const size_t len = min(MIME_TYPE_MAX - 1, type_end - s);
+    memcpy(m->str, s, len);
+    m->str[len] = '\0';
 
     // Get location of separator
-    for (const char *x = m->str;; ++x)
+    const char *x = strchr(m->str, '/');
+    m->sep = x ? x - m->str : -1;
+
+    // Parameters; we only care about the language
+    m->lang[0] = '\0';
+    while (param < s_end && *param == ';')
     {
-        if (!*x || x >= s + s_len)
-        {
-            m->sep = -1;
-            break;
-        }
+        for (++param; param < s_end && *param == ' '; ++param);
 
-        if (*x == '/')
+        const char *param_end = param;
+        for (;
+            param_end < s_end && *param_end && *param_end != ';';
+            ++param_end);
+
+        if (param_end - param > 5 && strncasecmp(param, "lang=", 5) == 0)
         {
-            m->sep = x - m->str;
-            break;
+            const size_t lang_len =
+                min(MIME_LANG_MAX - 1, param_end - param - 5);
+            memcpy(m->lang, param + 5, lang_len);
+            m->lang[lang_len] = '\0';
         }
+
+        param = param_end;
     }
 }
 
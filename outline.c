@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "outline.h"
+#include "pager.h"
+#include "state.h"
+#include "status_line.h"
+#include "tui.h"
+#include "typesetter.h"
+
+// Selected heading, and the first one that is shown
+static struct
+{
+    int selected, top;
+} s_outline;
+
+/* Show which heading is selected in the status line */
+static void
+outline_say_status(void)
+{
+    tui_status_begin();
+    tui_printf("Outline %d/%d (Enter to go, q to close)",
+        s_outline.selected + 1, g_pager->typeset.heading_count);
+    tui_status_end();
+}
+
+/* Open the outline of the page, with the heading above the scroll selected */
+void
+outline_open(void)
+{
+    struct typesetter *const t = &g_pager->typeset;
+
+    // Need the whole document for all of its headings
+    typeset_all(t, &g_pager->buffer);
+    if (!t->heading_count)
+    {
+        tui_status_say("No headings on this page");
+        return;
+    }
+
+    s_outline.selected =
+        max(typeset_heading_before(t, g_pager->scroll + 1), 0);
+    s_outline.top = 0;
+
+    tui_input_mode(TUI_MODE_OUTLINE);
+    tui_invalidate(INVALIDATE_PAGER_BIT);
+    outline_say_status();
+}
+
+void
+outline_close(void)
+{
+    tui_input_mode(TUI_MODE_NORMAL);
+    tui_status_begin();
+    tui_status_end();
+    tui_invalidate(INVALIDATE_ALL);
+}
+
+/* Move the selection by a number of headings */
+void
+outline_move(int amount)
+{
+    s_outline.selected = max(min(s_outline.selected + amount,
+        g_pager->typeset.heading_count - 1), 0);
+
+    tui_invalidate(INVALIDATE_PAGER_BIT);
+    outline_say_status();
+}
+
+/* Scroll to the selected heading, and close the outline */
+void
+outline_follow(void)
+{
+    const struct typesetter *const t = &g_pager->typeset;
+    if (s_outline.selected < t->heading_count)
+    {
+        g_pager->scroll = max(min(t->headings[s_outline.selected].line,
+            g_pager->buffer.line_count - 1), 0);
+    }
+    outline_close();
+}
+
+/* Paint a heading of the outline, on the row that the cursor is at */
+static void
+outline_paint_heading(int i)
+{
+    static const char *const COLOURS[] =
+    {
+        COLOUR_HEADING1,
+        COLOUR_HEADING2,
+        COLOUR_HEADING3,
+        COLOUR_HEADING4,
+    };
+    const struct typesetter *const t = &g_pager->typeset;
+    const struct typeset_heading *const h = &t->headings[i];
+
+    // The text of the heading is taken from the raw document, as the typeset
+    // line may be just the first of many
+    const struct typeset_raw_line *const raw =
+        &t->raw_lines[g_pager->buffer.line_pos[h->line].raw_index];
+    const char *s = raw->s, *const end = raw->s + raw->bytes;
+    for (; s < end && *s == '#'; ++s);
+    for (; s < end && (*s == ' ' || *s == '\t'); ++s);
+
+    const int indent =
+        min(h->level - 1, 3) * OUTLINE_INDENT_LEVEL;
+    const int width = g_pager->visible_buffer.w -
+        g_pager->margin.l - g_pager->margin.r - indent;
+    if (width < 1) return;
+
+    tui_printf("%*s", indent, "");
+    tui_say(i == s_outline.selected
+        ? "\x1b[7m"
+        : COLOURS[max(min(h->level, 4), 1) - 1]);
+
+    tui_sayn(s, utf8_size_w(s, end - s, width));
+}
+
+/* Paint the outline over the pager */
+void
+outline_paint(void)
+{
+    struct typesetter *const t = &g_pager->typeset;
+    const int h = g_pager->visible_buffer.h;
+
+    // The page may have been typeset again (e.g. on resize) since it opened
+    typeset_all(t, &g_pager->buffer);
+    s_outline.selected =
+        max(min(s_outline.selected, t->heading_count - 1), 0);
+
+    // Keep the selected heading in view
+    if (s_outline.selected < s_outline.top)
+    {
+        s_outline.top = s_outline.selected;
+    }
+    else if (s_outline.selected >= s_outline.top + h)
+    {
+        s_outline.top = s_outline.selected - h + 1;
+    }
+
+    for (int row = 0; row < h; ++row)
+    {
+        tui_cursor_move(g_pager->margin.l, row + 1 + STATUS_LINE_TOP_HEIGHT);
+        if (s_outline.top + row < t->heading_count)
+        {
+            outline_paint_heading(s_outline.top + row);
+        }
+        tui_say("\x1b[0m\x1b[K");
+    }
+
+    // None of the pager's rows are left on the terminal
+    g_pager->scroll_painted = -1;
+}
@@ -0,0 +1,19 @@
+#ifndef OUTLINE_H
+#define OUTLINE_H
+
+/*
+ * outline.h
+ *
+ * Table of contents of the page: a list of its headings, drawn over the
+ * pager, that can be moved through and jumped to.  The headings come from the
+ * outline that the typesetter keeps as it goes (see typesetter.h), so opening
+ * it doesn't need to look through the page
+ */
+
+void outline_open(void);
+void outline_close(void);
+void outline_move(int);
+void outline_follow(void);
+void outline_paint(void);
+
+#endif
@@ -0,0 +1,214 @@
+#include "pch.h"
+#include "page_pool.h"
+#include "pager.h"
+#include "state.h"
+#include "typesetter.h"
+#include "uri.h"
+
+static struct pooled_page s_pages[max(HISTORY_PAGES_KEPT, 1)];
+static int s_count = 0;
+
+// Incremented each time a page is put in the pool
+static unsigned long s_clock = 0;
+
+// The current page's raw buffer, set aside while another page is loaded.
+// Loads nest when a redirect is followed, and only the outermost one sets the
+// buffer aside
+static struct
+{
+    struct recv_buffer recv;
+    bool held;
+    int depth;
+} s_load;
+
+static void
+pooled_page_free(struct pooled_page *p)
+{
+    free(p->pager.links);
+    free(p->pager.link_text);
+    uri_strings_free(&p->pager.link_uris);
+    free(p->pager.search.matches);
+    pager_buffer_free(&p->pager.buffer);
+    typesetter_deinit(&p->pager.typeset);
+    free(p->recv.b);
+}
+
+static int
+page_pool_find(const struct uri *uri)
+{
+    for (int i = 0; i < s_count; ++i)
+    {
+        if (uri_cmp_notrailing(&s_pages[i].uri, uri) == 0) return i;
+    }
+    return -1;
+}
+
+/*
+ * Whether the page in g_state is worth keeping.  Internal pages are generated
+ * afresh each time they are shown, and local files are cheap to read again
+ * (and may well have been changed)
+ */
+static bool
+page_pool_keeps_current(void)
+{
+    return HISTORY_PAGES_KEPT > 0 &&
+        (g_state.uri.protocol == PROTOCOL_GEMINI ||
+        g_state.uri.protocol == PROTOCOL_GOPHER);
+}
+
+/*
+ * Move the page in g_state (whose raw buffer is given) into the pool, dropping
+ * the oldest page if it's full.  The pager is left as it was, for the caller
+ * to replace
+ */
+static void
+page_pool_put(struct recv_buffer *recv)
+{
+    // Cached items can be freed or replaced at any time, so the pool needs its
+    // own copy of the page
+    if (recv->b_alt)
+    {
+        if (recv->capacity < recv->size)
+        {
+            free(recv->b);
+            recv->capacity = recv->size;
+            recv->b = malloc(recv->capacity);
+            if (!recv->b)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(-1);
+            }
+        }
+        memcpy(recv->b, recv->b_alt, recv->size);
+        typesetter_rebase(&g_pager->typeset, recv->b_alt, recv->b);
+        recv->b_alt = NULL;
+    }
+
+    // Replace the page if it's already in the pool, otherwise take a new
+    // slot or the oldest one
+    int index = page_pool_find(&g_state.uri);
+    if (index < 0 && s_count < HISTORY_PAGES_KEPT)
+    {
+        index = s_count++;
+    }
+    else
+    {
+        if (index < 0)
+        {
+            index = 0;
+            for (int i = 1; i < s_count; ++i)
+            {
+                if (s_pages[i].age < s_pages[index].age) index = i;
+            }
+        }
+        pooled_page_free(&s_pages[index]);
+    }
+
+    struct pooled_page *const p = &s_pages[index];
+    p->pager = g_state.pager;
+    p->pager.cached_page = NULL;
+    p->recv = *recv;
+    p->uri = g_state.uri;
+    p->age = ++s_clock;
+}
+
+void
+page_pool_deinit(void)
+{
+    for (int i = 0; i < s_count; ++i) pooled_page_free(&s_pages[i]);
+    s_count = 0;
+
+    if (s_load.held) free(s_load.recv.b);
+    s_load.held = false;
+    s_load.depth = 0;
+}
+
+/* Set the current page's raw buffer aside, before loading a page into g_recv */
+void
+page_pool_load_begin(void)
+{
+    if (s_load.depth++) return;
+
+    s_load.recv = *g_recv;
+    s_load.held = true;
+
+    g_recv->capacity = 4096;
+    g_recv->b = malloc(g_recv->capacity);
+    g_recv->b_alt = NULL;
+    g_recv->size = 0;
+    memset(&g_recv->mime, 0, sizeof(struct mime));
+    if (!g_recv->b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+}
+
+/*
+ * Finished loading a page.  If it failed then the current page's raw buffer
+ * is put back; otherwise page_pool_push_current is expected to follow
+ */
+void
+page_pool_load_end(bool loaded)
+{
+    if (--s_load.depth || !s_load.held || loaded) return;
+
+    free(g_recv->b);
+    *g_recv = s_load.recv;
+    s_load.held = false;
+}
+
+/*
+ * A new page was loaded successfully; put the page that is being left (and
+ * its raw buffer that was set aside) in the pool, leaving an empty page in the
+ * pager for the new one
+ */
+void
+page_pool_push_current(void)
+{
+    // Already done by a redirect that was followed while loading
+    if (!s_load.held) return;
+    s_load.held = false;
+
+    if (!page_pool_keeps_current())
+    {
+        // The pager's buffers are just reused by the new page
+        free(s_load.recv.b);
+        return;
+    }
+
+    page_pool_put(&s_load.recv);
+    pager_page_empty();
+}
+
+bool
+page_pool_has(const struct uri *uri)
+{
+    return HISTORY_PAGES_KEPT > 0 && page_pool_find(uri) >= 0;
+}
+
+/*
+ * Show a page from the pool (which must have it) instead of the current page,
+ * which goes into the pool in its place
+ */
+void
+page_pool_swap(const struct uri *uri)
+{
+    const int index = page_pool_find(uri);
+    const struct pooled_page p = s_pages[index];
+    s_pages[index] = s_pages[--s_count];
+
+    if (page_pool_keeps_current())
+    {
+        page_pool_put(g_recv);
+    }
+    else
+    {
+        pager_page_deinit();
+        free(g_recv->b);
+    }
+
+    pager_page_take(&p.pager);
+    *g_recv = p.recv;
+    g_state.uri = p.uri;
+}
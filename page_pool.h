@@ -0,0 +1,37 @@
+#ifndef PAGE_POOL_H
+#define PAGE_POOL_H
+
+#include "state.h"
+
+/*
+ * page_pool.h
+ *
+ * The last few pages that were navigated away from, kept with their raw and
+ * typeset buffers, links, scroll and selection, so that going back (or
+ * forward) to one of them is just a matter of moving it back into g_state.
+ *
+ * While a page is being loaded, the current page's raw buffer is set aside
+ * (the request is received into a new one), so the page can still be painted
+ * and then either put in the pool once the new page has loaded, or put back
+ * if loading failed.
+ */
+
+struct pooled_page
+{
+    // The page as it was left (the pager's visible buffers aren't valid)
+    struct pager_state pager;
+    struct recv_buffer recv;
+    struct uri uri;
+
+    // When the page was put in the pool, so the oldest is dropped first
+    unsigned long age;
+};
+
+void page_pool_deinit(void);
+void page_pool_load_begin(void);
+void page_pool_load_end(bool);
+void page_pool_push_current(void);
+bool page_pool_has(const struct uri *);
+void page_pool_swap(const struct uri *);
+
+#endif
@@ -1,5 +1,9 @@
 #include "pch.h"
+#include "line_break_alg.h"
+#include "link_picker.h"
+#include "outline.h"
 #include "pager.h"
+#include "perf.h"
 #include "search.h"
 #include "state.h"
 #include "status_line.h"
@@ -13,6 +17,20 @@ struct pager_state *g_pager = NULL;
 
 static void pager_alloc_visible_buffer(struct pager_visible_buffer *, int);
 
+/*
+ * Check whether the given line exists in the buffer, typesetting more of the
+ * document if needed
+ */
+static inline bool
+pager_has_line(int i)
+{
+    if (i < 0) return false;
+    if (i < g_pager->buffer.line_count) return true;
+
+    typeset_until_line(&g_pager->typeset, &g_pager->buffer, i);
+    return i < g_pager->buffer.line_count;
+}
+
 static void
 pager_recalc_margin(void)
 {
@@ -29,8 +47,28 @@ pager_init(void)
     g_pager->visible_buffer.rows = NULL;
     g_pager->visible_buffer_prev.rows = NULL;
 
+    line_break_init();
+
+    pager_page_init();
+}
+
+/*
+ * Initialise the state that belongs to the page itself rather than to the
+ * terminal (everything but the visible buffers), e.g. for a new tab
+ */
+void
+pager_page_init(void)
+{
+    g_pager->scroll_painted = -1;
+    g_pager->link_index = -1;
+
+    g_pager->link_count = 0;
     g_pager->link_capacity = 10;
     g_pager->links = malloc(g_pager->link_capacity * sizeof(struct pager_link));
+    g_pager->link_text = NULL;
+    g_pager->link_text_len = 0;
+    g_pager->link_text_capacity = 0;
+    memset(&g_pager->link_uris, 0, sizeof(struct uri_strings));
 
     search_init();
 
@@ -43,6 +81,7 @@ pager_update_page(int selected, int scroll)
     g_pager->link_count = 0;
     g_pager->link_index = selected;
     g_pager->scroll = scroll;
+    g_pager->scroll_painted = -1;
 
     // Reset marks
     memset(g_pager->marks, 0, sizeof(g_pager->marks));
@@ -78,8 +117,6 @@ pager_update_page(int selected, int scroll)
 void
 pager_deinit(void)
 {
-    if (g_pager->links) free(g_pager->links);
-
     if (g_pager->visible_buffer.rows)
     {
         free(g_pager->visible_buffer.rows);
@@ -88,15 +125,76 @@ pager_deinit(void)
     {
         free(g_pager->visible_buffer_prev.rows);
     }
+
+    pager_page_deinit();
+
+    search_regex_deinit();
+    line_break_deinit();
+}
+
+/*
+ * Leave an empty page in the pager, once the page it had has been moved
+ * elsewhere (a tab or the page pool)
+ */
+void
+pager_page_empty(void)
+{
+    const struct pager_visible_buffer
+        vis = g_pager->visible_buffer,
+        vis_prev = g_pager->visible_buffer_prev;
+
+    memset(g_pager, 0, sizeof(struct pager_state));
+    g_pager->visible_buffer = vis;
+    g_pager->visible_buffer_prev = vis_prev;
+
+    pager_page_init();
+}
+
+/*
+ * Move a page that was moved out of the pager back in (keeping the visible
+ * buffers, which belong to the terminal rather than the page)
+ */
+void
+pager_page_take(const struct pager_state *p)
+{
+    const struct pager_visible_buffer
+        vis = g_pager->visible_buffer,
+        vis_prev = g_pager->visible_buffer_prev;
+
+    *g_pager = *p;
+    g_pager->visible_buffer = vis;
+    g_pager->visible_buffer_prev = vis_prev;
+}
+
+void
+pager_page_deinit(void)
+{
+    if (g_pager->links) free(g_pager->links);
+    g_pager->links = NULL;
+    free(g_pager->link_text);
+    g_pager->link_text = NULL;
+    uri_strings_free(&g_pager->link_uris);
+
     search_deinit();
-    free(g_pager->buffer.b);
-    free(g_pager->buffer.lines);
+    pager_buffer_free(&g_pager->buffer);
     typesetter_deinit(&g_pager->typeset);
 }
 
+/* Free a typeset buffer, leaving it empty (it is allocated again as needed) */
+void
+pager_buffer_free(struct pager_buffer *b)
+{
+    free(b->b);
+    free(b->lines);
+    free(b->line_pos);
+    memset(b, 0, sizeof(struct pager_buffer));
+}
+
 void
 pager_resized(void)
 {
+    g_pager->scroll_painted = -1;
+
     pager_recalc_margin();
 
     int content_width =
@@ -112,29 +210,46 @@ pager_resized(void)
     // affects word-wrapping, etc.)
     if (!width_changed) return;
 
-    // We need to update search match positions
-    search_update();
-
     // For restoring scroll position after the resize.
     int scroll_raw_index = 0;
     size_t scroll_raw_dist = 0;
     if (g_pager->buffer.line_count)
     {
-        scroll_raw_index = g_pager->buffer.lines[g_pager->scroll].raw_index;
-        scroll_raw_dist = g_pager->buffer.lines[g_pager->scroll].raw_dist;
+        scroll_raw_index =
+            g_pager->buffer.line_pos[g_pager->scroll].raw_index;
+        scroll_raw_dist =
+            g_pager->buffer.line_pos[g_pager->scroll].raw_dist;
     }
 
     // Re-typeset the content, to update word-wrapping, etc.
+    pager_retypeset(scroll_raw_index, scroll_raw_dist);
+}
+
+/*
+ * Typeset the page again at the current width, keeping the given position in
+ * the raw document at the top of the pager
+ */
+void
+pager_retypeset(int scroll_raw_index, size_t scroll_raw_dist)
+{
+    pager_recalc_margin();
+
     typeset_page(&g_pager->typeset,
         &g_pager->buffer,
-        content_width,
+        g_tui->w - g_pager->margin.l - g_pager->margin.r,
         &g_recv->mime);
 
     // Now we need to restore the scroll position by finding the line that has
     // the raw index we had
-    for (int r = 0; r < g_pager->buffer.line_count; ++r)
+    for (int r = typeset_raw_to_line(
+            &g_pager->typeset, &g_pager->buffer, scroll_raw_index);
+        r < g_pager->buffer.line_count;
+        ++r)
     {
-        if (g_pager->buffer.lines[r].raw_index != scroll_raw_index) continue;
+        if (g_pager->buffer.line_pos[r].raw_index != scroll_raw_index)
+        {
+            continue;
+        }
 
         // Store the top of the wrapped line initially
         g_pager->scroll = r;
@@ -142,34 +257,47 @@ pager_resized(void)
         // Call it a day if there was no previous buffer
         if (g_pager->visible_buffer_prev.h == 0) break;
 
-        // Iterate over the rest of the lines with this index.
-        struct pager_buffer_line *l;
-        for (l = &g_pager->buffer.lines[r];
-            l->raw_index == scroll_raw_index;
-            l = &g_pager->buffer.lines[r], ++r)
+        // Iterate over the rest of the lines with this index.  We keep an
+        // index rather than a pointer as typesetting more lines may move them
+        int found = -1;
+        for (;
+            pager_has_line(r) &&
+                g_pager->buffer.line_pos[r].raw_index == scroll_raw_index;
+            ++r)
         {
+            found = r;
+
             // Found the line near to where we were before
-            if (l->raw_dist >= scroll_raw_dist) break;
+            if (g_pager->buffer.line_pos[r].raw_dist >= scroll_raw_dist)
+            {
+                break;
+            }
 
             g_pager->scroll = r;
         }
-        if (l)
+        if (found != -1)
         {
             // Honestly don't know why this even works (and seems to work well
             // too)
-            size_t diff = l->raw_dist - scroll_raw_dist;
-            if (diff > l->bytes / 2)
+            size_t diff =
+                g_pager->buffer.line_pos[found].raw_dist - scroll_raw_dist;
+            if (diff > g_pager->buffer.lines[found].bytes / 2)
             {
                 g_pager->scroll = max(g_pager->scroll - 1, 0);
             }
         }
         break;
     }
+    g_pager->scroll =
+        max(min(g_pager->scroll, g_pager->buffer.line_count - 1), 0);
 }
 
 void
 pager_scroll(int amount)
 {
+    // Make sure everything we could scroll to (and show) is typeset
+    pager_has_line(g_pager->scroll + amount + g_pager->visible_buffer.h);
+
     if (g_pager->scroll + amount < 0)
     {
         g_pager->scroll = 0;
@@ -187,6 +315,9 @@ pager_scroll(int amount)
 void
 pager_scroll_topbot(int t)
 {
+    // Need the whole document to know where the bottom is
+    if (t != -1) typeset_all(&g_pager->typeset, &g_pager->buffer);
+
     g_pager->scroll = t == -1
         ? 0
         : min(max((int)g_pager->buffer.line_count -
@@ -198,21 +329,13 @@ pager_scroll_topbot(int t)
 void
 pager_scroll_paragraph(int dir)
 {
-    int i;
-
-    // Scroll to next non-empty line (beginning of paragraph)
-    for (i = g_pager->scroll;
-        i >= 0 &&
-            i < g_pager->buffer.line_count &&
-            g_pager->buffer.lines[i].bytes <= 1;
-        i += dir);
-
-    // Scroll to next empty line (end of paragraph)
-    for (;
-        i >= 0 &&
-            i < g_pager->buffer.line_count &&
-            g_pager->buffer.lines[i].bytes > 1;
-        i += dir);
+    // Scroll to the empty line at the end of this (or the next) paragraph, or
+    // the one before the beginning of it
+    const int i = dir > 0
+        ? typeset_paragraph_end_after(
+            &g_pager->typeset, &g_pager->buffer, g_pager->scroll)
+        : typeset_paragraph_begin_before(
+            &g_pager->typeset, g_pager->scroll) - 1;
 
     g_pager->scroll = min(max(i, 0), g_pager->buffer.line_count - 1);
 }
@@ -220,16 +343,14 @@ pager_scroll_paragraph(int dir)
 /* Scroll to next heading (dir is -1 or 1) */
 void pager_scroll_heading(int dir)
 {
-    for (int i = g_pager->scroll + dir;
-        i >= 0 && i < g_pager->buffer.line_count;
-        i += dir)
-    {
-        if (g_pager->buffer.lines[i].is_heading)
-        {
-            g_pager->scroll = max(min(i, g_pager->buffer.line_count - 1), 0);
-            return;
-        }
-    }
+    const int i = dir > 0
+        ? typeset_heading_from(
+            &g_pager->typeset, &g_pager->buffer, g_pager->scroll + 1)
+        : typeset_heading_before(&g_pager->typeset, g_pager->scroll);
+    if (i < 0) return;
+
+    g_pager->scroll = max(min(g_pager->typeset.headings[i].line,
+        g_pager->buffer.line_count - 1), 0);
 }
 
 /*
@@ -246,6 +367,54 @@ pager_paint(bool full)
     // Partial updates only run if selected link changed
     if (!full && !update_sel_link) return;
 
+    // The outline and link picker are drawn over the pager while they're open
+    if (g_in->mode == TUI_MODE_OUTLINE)
+    {
+        outline_paint();
+        return;
+    }
+    if (g_in->mode == TUI_MODE_LINK_PICKER)
+    {
+        link_picker_paint();
+        return;
+    }
+
+    perf_begin(PERF_PAINT);
+
+    // Make sure all of the visible lines are typeset
+    pager_has_line(g_pager->scroll + g_pager->visible_buffer.h);
+
+    // Only rows in this range are painted on a full paint
+    int paint_begin = 0, paint_end = g_pager->visible_buffer.h;
+
+#if PAGER_SCROLL_REGION
+    // If we only scrolled since the last paint then the rows that are still
+    // visible are already on the terminal, just in the wrong place; so move
+    // them with a scroll region and only paint the rows that were exposed
+    const int scroll_delta = g_pager->scroll - g_pager->scroll_painted;
+    if (full &&
+        !update_sel_link &&
+        g_pager->scroll_painted >= 0 &&
+        scroll_delta != 0 &&
+        abs(scroll_delta) < g_pager->visible_buffer.h)
+    {
+        tui_printf("\x1b[%d;%dr\x1b[%d%c\x1b[r",
+            PAGER_TOP + 1,
+            PAGER_TOP + g_pager->visible_buffer.h,
+            abs(scroll_delta),
+            scroll_delta > 0 ? 'S' : 'T');
+
+        if (scroll_delta > 0)
+        {
+            paint_begin = g_pager->visible_buffer.h - scroll_delta;
+        }
+        else
+        {
+            paint_end = -scroll_delta;
+        }
+    }
+#endif
+
     // Draw the visible buffer
     int line_index;
     bool moved, will_print;
@@ -262,9 +431,12 @@ pager_paint(bool full)
         {
             // Past end of text buffer
             *line =
-                (struct pager_buffer_line) { NULL, 0, 0 };
+                (struct pager_buffer_line) { 0, 0, 0 };
         }
 
+        // Rows that were scrolled into place don't need painting
+        if (i < paint_begin || i >= paint_end) continue;
+
         // Draw the line
         moved = false;
         if (i < g_pager->buffer.line_count - g_pager->scroll)
@@ -322,22 +494,23 @@ pager_paint(bool full)
             // Move cursor to end of left margin, and fill the indent
             DRAW_START();
 
+            const char *s = pager_line_str(&g_pager->buffer, line);
         #if 0
-            tui_sayn(line->s, line->bytes);
+            tui_sayn(s, line->bytes);
         #else
             if (prefix_fmt && addr_fmt)
             {
                 tui_say(prefix_fmt);
 
-                tui_sayn(line->s, line->proto_len);
+                tui_sayn(s, line->proto_len);
 
                 tui_say(addr_fmt);
 
-                tui_sayn(line->s + line->proto_len,
+                tui_sayn(s + line->proto_len,
                          line->bytes - line->proto_len);
             }
             else
-                tui_sayn(line->s, line->bytes);
+                tui_sayn(s, line->bytes);
         #endif
 
             // Always clear the escapes after the line
@@ -366,22 +539,21 @@ pager_paint(bool full)
         #endif
         }
 
-        // Clear the old line
-        int clear_count = max(
-            ((int)g_pager->visible_buffer_prev.rows[i].len +
-                g_pager->visible_buffer_prev.rows[i].indent) -
-            ((int)line->len + line->indent), 0) + 1;
-        tui_printf("%*s", clear_count, "");
+        // Clear whatever is left of the old line
+        tui_say("\x1b[K");
     }
 
     // Highlight search matches
-    search_highlight_matches();
+    search_highlight_matches(paint_begin, paint_end);
 
     // Swap pointers to store old rows so we know what to clear on next paint
     struct pager_buffer_line *tmp = g_pager->visible_buffer.rows;
     g_pager->visible_buffer.rows = g_pager->visible_buffer_prev.rows;
     g_pager->visible_buffer_prev.rows = tmp;
     g_pager->link_index_prev = g_pager->link_index;
+    if (full) g_pager->scroll_painted = g_pager->scroll;
+
+    perf_end(PERF_PAINT);
 }
 
 static void
@@ -419,17 +591,29 @@ pager_alloc_visible_buffer(struct pager_visible_buffer *b, int h)
     }
 }
 
-void
-pager_select_first_link_visible(void)
+/*
+ * Get the first link on or after the given line, out of those that have been
+ * typeset (which are in order of line)
+ */
+static int
+pager_link_lower_bound(int line_index)
 {
-    for (int i = 0; i < g_pager->link_count; ++i)
+    int lo = 0, hi = g_pager->typeset.links_typeset;
+    while (lo < hi)
     {
-        // Skip lines that are before where the visible buffer starts
-        if (g_pager->links[i].line_index < g_pager->scroll) continue;
-
-        g_pager->link_index = i;
-        return;
+        const int mid = lo + (hi - lo) / 2;
+        if (g_pager->links[mid].line_index < line_index) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
+}
+
+void
+pager_select_first_link_visible(void)
+{
+    // Skip links that are before where the visible buffer starts
+    const int i = pager_link_lower_bound(g_pager->scroll);
+    if (i < g_pager->typeset.links_typeset) g_pager->link_index = i;
 }
 
 void
@@ -437,15 +621,10 @@ pager_select_last_link_visible(void)
 {
     if (g_pager->visible_buffer.h == 0) return;
 
-    for (int i = g_pager->link_count - 1; i > -1; --i)
-    {
-        // Skip lines that are after where the visible buffer starts
-        if (g_pager->links[i].line_index >=
-            g_pager->scroll + g_pager->visible_buffer.h) continue;
-
-        g_pager->link_index = i;
-        return;
-    }
+    // Skip links that are after where the visible buffer ends
+    const int i = pager_link_lower_bound(
+        g_pager->scroll + g_pager->visible_buffer.h) - 1;
+    if (i > -1) g_pager->link_index = i;
 }
 
 /* Ensure a new link can be added without overflow */
@@ -8,48 +8,61 @@
 
 struct cached_item;
 
-struct pager_buffer_line
+enum pager_buffer_line_flags
 {
-    // Pointer to where in buffer line begins
-    const char *s;
+    // Whether this line is a heading
+    PAGER_LINE_HEADING_BIT = (1 << 0),
 
-    // Line length
-    size_t len;
+    // Whether this line ends on a word hyphenated by the line breaking
+    // algorithm (used for search functionality)
+    PAGER_LINE_HYPHENATED_BIT = (1 << 1),
+};
+
+/*
+ * A line in the typeset buffer.  These are kept small as there's one for
+ * every wrapped line of the document; only what's needed for painting,
+ * scrolling and searching is stored here (see pager_buffer_line_pos below).
+ */
+struct pager_buffer_line
+{
+    // Offset in the buffer where line begins.  We use an offset rather than
+    // a pointer so that the buffer can be reallocated while typesetting
+    uint32_t off;
 
     // Line byte count
-    size_t bytes;
-
-    // The true 'raw' line index that this line exists under.  Used only for
-    // the pager's processed/formatted buffer so we can track scroll position
-    // on window size changes
-    // This may be renamed to 'index' in future if other buffers require lines
-    // to hold their own index for whatever reason.  Perhaps a union might even
-    // work too.
-    int raw_index;
-    // And additionally the number of bytes this line is from the beginning of
-    // the raw line
-    size_t raw_dist;
+    uint32_t bytes;
 
-    // Whether this line is a heading
-    // NOTE: if we have any more bools like this in future this should become
-    // a bitfield enum
-    bool is_heading;
+    // Link associated with line (index in the pager state links array)
+    int32_t link_index;
 
-    // Whether this line ends on a word hyphenated by the line breaking
-    // algorithm (used for search functionality)
-    bool is_hyphenated;
+    // Line length (display width)
+    uint16_t len;
 
     // Line indent level
-    int indent;
+    uint8_t indent;
+
+    // Line flags (see enum above)
+    uint8_t flags;
 
     // Length of prefix that is applied to this line
-    size_t prefix_len;
+    uint8_t prefix_len;
 
     // For links: the length of the initial hang, and prefix.
-    size_t proto_len;
+    uint8_t proto_len;
+};
 
-    // Link associated with line (index in the pager state links array)
-    int link_index;
+/*
+ * Where a typeset line came from in the raw document.  Kept separately as it
+ * is only needed to track scroll position on window size changes
+ */
+struct pager_buffer_line_pos
+{
+    // The true 'raw' line index that this line exists under
+    int32_t raw_index;
+
+    // And additionally the number of bytes this line is from the beginning of
+    // the raw line
+    uint32_t raw_dist;
 };
 
 struct pager_buffer
@@ -57,15 +70,35 @@ struct pager_buffer
     char *b;
     size_t size;
 
-    // Points where line-breaks occur in the buffer
+    // Points where line-breaks occur in the buffer, and where they came from
+    // in the raw document (both have the same capacity)
     struct pager_buffer_line *lines;
+    struct pager_buffer_line_pos *line_pos;
     int line_count, lines_capacity;
 };
 
+/* Get pointer to the text of a line in the buffer */
+static inline const char *
+pager_line_str(
+    const struct pager_buffer *b,
+    const struct pager_buffer_line *l)
+{
+    return b->b + l->off;
+}
+
 struct pager_link
 {
-    struct uri uri;
+    // Packed into the page's link_uris (see pager_link_uri)
+    struct uri_packed uri;
+
+    // Raw line that the link is on, and the first typeset line of it (-1 if
+    // it hasn't been typeset yet)
+    int raw_index;
     int line_index;
+
+    // Where its label is in its raw line, and where its text for the link
+    // picker is (see link_text below)
+    uint32_t label, label_len, text, text_len;
 };
 
 struct pager_state
@@ -91,12 +124,27 @@ struct pager_state
     // Current pager scroll value
     int scroll;
 
-    // List of links on the page
+    // Scroll value at the last full paint, so that the terminal can be
+    // scrolled rather than repainted.  -1 if the rows on the terminal can't
+    // be reused (new page, resize, search changed, etc.)
+    int scroll_painted;
+
+    // List of links on the page.  These are found once when the page is
+    // loaded (see typesetter.c), and are kept when it's typeset again
     struct pager_link *links;
     int link_count;
     int link_capacity;
     int link_index, link_index_prev;
 
+    // Paths and queries of the links' URIs
+    struct uri_strings link_uris;
+
+    // Label and URI of each link, lowercased and one after another, for the
+    // link picker to match against.  It's filled when the picker is first
+    // used, and emptied whenever the links are found again
+    char *link_text;
+    size_t link_text_len, link_text_capacity;
+
     // Pager margins
     struct margin
     {
@@ -120,6 +168,11 @@ extern struct pager_state *g_pager;
 
 void pager_init(void);
 void pager_deinit(void);
+void pager_page_init(void);
+void pager_page_deinit(void);
+void pager_page_empty(void);
+void pager_page_take(const struct pager_state *);
+void pager_buffer_free(struct pager_buffer *);
 void pager_load_buffer(struct pager_buffer *);
 void pager_scroll(int);
 void pager_scroll_topbot(int);
@@ -128,6 +181,7 @@ void pager_scroll_paragraph(int);
 void pager_scroll_heading(int);
 void pager_paint(bool);
 void pager_resized(void);
+void pager_retypeset(int, size_t);
 void pager_update_page(int, int);
 void pager_select_first_link_visible(void);
 void pager_select_last_link_visible(void);
@@ -141,4 +195,12 @@ pager_has_link(void)
         g_pager->link_index < g_pager->link_count;
 }
 
+/* Get the URI of a link */
+static inline struct uri *
+pager_link_uri(int i, struct uri *uri)
+{
+    uri_unpack(uri, &g_pager->links[i].uri, &g_pager->link_uris);
+    return uri;
+}
+
 #endif
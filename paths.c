@@ -40,6 +40,8 @@ static const struct path_info
     [PATH_ID_CACHE_META]     = { { PATH_PREFIX_DATA }, "/cache/meta.dir"     },
     [PATH_ID_CACHE_META_TMP] = { { PATH_PREFIX_DATA }, "/cache/meta.dir.tmp" },
     [PATH_ID_CACHE_META_BAK] = { { PATH_PREFIX_DATA }, "/cache/meta.dir.bak" },
+    [PATH_ID_CACHE_INDEX]    = { { PATH_PREFIX_DATA }, "/cache/index"        },
+    [PATH_ID_CACHE_INDEX_TMP]= { { PATH_PREFIX_DATA }, "/cache/index.tmp"    },
 
     // sentinel
     [PATH_ID_COUNT]          = { { 0 } }
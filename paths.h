@@ -23,6 +23,8 @@ enum path_id
     PATH_ID_CACHE_META,
     PATH_ID_CACHE_META_TMP,
     PATH_ID_CACHE_META_BAK,
+    PATH_ID_CACHE_INDEX,
+    PATH_ID_CACHE_INDEX_TMP,
 
     PATH_ID_COUNT
 };
@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "perf.h"
+#include "state.h"
+#include "tui.h"
+
+// Width of the bars in the internal:perf histograms
+#define PERF_HISTOGRAM_WIDTH 40
+
+static const struct perf_counter_info
+{
+    const char *name, *desc, *unit;
+} PERF_COUNTER_INFO[PERF_COUNTER_COUNT] =
+{
+    [PERF_FRAME] = { "Frame",
+        "Time to build a frame and write it out to the terminal", "us" },
+    [PERF_FRAME_BYTES] = { "Frame output",
+        "Bytes written to the terminal for each frame", "B" },
+    [PERF_PAINT] = { "Paint",
+        "Time spent painting the pager (pager_paint)", "us" },
+    [PERF_TYPESET] = { "Typeset",
+        "Time to typeset a page, or a block of a large page", "us" },
+    [PERF_LINE_BREAK] = { "Line breaking",
+        "Time spent in the line breaking algorithm while typesetting", "us" },
+    [PERF_SEARCH] = { "Search",
+        "Time to find all matches of a search (search_perform)", "us" },
+    [PERF_FETCH] = { "Fetch",
+        "Time to request and receive a page over the network", "us" },
+};
+
+static struct perf_counter s_counters[PERF_COUNTER_COUNT];
+
+/* Current monotonic time in microseconds */
+uint64_t
+perf_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Start timing; nested begin/end pairs are part of the outermost sample */
+void
+perf_begin(enum perf_counter_id id)
+{
+    struct perf_counter *const c = &s_counters[id];
+    if (c->depth++ == 0) c->begin = perf_now();
+}
+
+/* Finish timing, returning true if a sample was recorded */
+bool
+perf_end(enum perf_counter_id id)
+{
+    struct perf_counter *const c = &s_counters[id];
+    if (c->depth == 0 || --c->depth) return false;
+
+    perf_record(id, perf_now() - c->begin);
+    return true;
+}
+
+/* Add a sample */
+void
+perf_record(enum perf_counter_id id, uint64_t value)
+{
+    struct perf_counter *const c = &s_counters[id];
+    c->samples[c->next] = min(value, UINT32_MAX);
+    c->next = (c->next + 1) % PERF_SAMPLES;
+    c->count = min(c->count + 1, PERF_SAMPLES);
+}
+
+/* Add to the next sample, for timings spread over many small calls */
+void
+perf_accumulate(enum perf_counter_id id, uint64_t value)
+{
+    s_counters[id].pending += value;
+}
+
+/* Add whatever has been accumulated as a sample */
+void
+perf_commit(enum perf_counter_id id)
+{
+    perf_record(id, s_counters[id].pending);
+    s_counters[id].pending = 0;
+}
+
+/* Get the latest sample (0 if there are none) */
+uint64_t
+perf_last(enum perf_counter_id id)
+{
+    const struct perf_counter *const c = &s_counters[id];
+    if (!c->count) return 0;
+    return c->samples[(c->next + PERF_SAMPLES - 1) % PERF_SAMPLES];
+}
+
+/* Append formatted text to the receive buffer */
+static void
+perf_say(const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int bytes = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    bytes = min(bytes, (int)sizeof(line) - 1);
+
+    recv_buffer_check_size(g_recv->size + bytes);
+    memcpy(g_recv->b + g_recv->size, line, bytes);
+    g_recv->size += bytes;
+}
+
+static int
+perf_compare_samples(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Displays the recorded timings in a buffer */
+int
+perf_display(void)
+{
+    g_recv->size = 0;
+    perf_say("# Performance\n\n");
+    perf_say("The last %d samples of each counter.\n", PERF_SAMPLES);
+
+    for (int id = 0; id < PERF_COUNTER_COUNT; ++id)
+    {
+        const struct perf_counter_info *const info = &PERF_COUNTER_INFO[id];
+        const struct perf_counter *const c = &s_counters[id];
+
+        perf_say("\n## %s\n%s.\n", info->name, info->desc);
+        if (!c->count)
+        {
+            perf_say("No samples yet.\n");
+            continue;
+        }
+
+        uint32_t sorted[PERF_SAMPLES];
+        memcpy(sorted, c->samples, c->count * sizeof(uint32_t));
+        qsort(sorted, c->count, sizeof(uint32_t), perf_compare_samples);
+
+        perf_say("* Last: %lu %s\n", (unsigned long)perf_last(id), info->unit);
+        perf_say("* Min: %u %s\n", sorted[0], info->unit);
+        perf_say("* Median: %u %s\n", sorted[c->count / 2], info->unit);
+        perf_say("* 90th percentile: %u %s\n",
+            sorted[(c->count * 9) / 10], info->unit);
+        perf_say("* Max: %u %s\n", sorted[c->count - 1], info->unit);
+        perf_say("* Samples: %d\n", c->count);
+
+        // Histogram with power-of-two buckets, from the smallest sample to
+        // the largest
+        int lo = 0, hi;
+        for (; ((uint64_t)1 << (lo + 1)) <= sorted[0]; ++lo);
+        for (hi = lo;
+            ((uint64_t)1 << (hi + 1)) <= sorted[c->count - 1];
+            ++hi);
+
+        int buckets[33] = { 0 }, most = 1;
+        for (int i = 0, b = lo; i < c->count; ++i)
+        {
+            for (; b < hi && ((uint64_t)1 << (b + 1)) <= sorted[i]; ++b);
+            ++buckets[b];
+            most = max(most, buckets[b]);
+        }
+
+        perf_say("Distribution of samples:\n```\n");
+        for (int b = lo; b <= hi; ++b)
+        {
+            char bar[PERF_HISTOGRAM_WIDTH + 1];
+            const int bar_len = (buckets[b] * PERF_HISTOGRAM_WIDTH + most - 1)
+                / most;
+            memset(bar, '#', bar_len);
+            bar[bar_len] = '\0';
+
+            perf_say("< %10lu %-2s |%-*s %d\n",
+                (unsigned long)1 << (b + 1),
+                info->unit,
+                PERF_HISTOGRAM_WIDTH, bar,
+                buckets[b]);
+        }
+        perf_say("```\n");
+    }
+
+    mime_parse(&g_recv->mime, MIME_GEMTEXT, strlen(MIME_GEMTEXT));
+    tui_status_clear();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef PERF_H
+#define PERF_H
+
+/*
+ * perf.h
+ *
+ * Timings of the hot paths (painting, typesetting, searching, fetching), kept
+ * in small ring buffers so that regressions can be spotted without attaching
+ * a profiler.  The latest values can be shown in the status line (see
+ * STATUS_LINE_PERF), and internal:perf shows histograms of each.
+ */
+
+// Number of samples kept for each counter
+#define PERF_SAMPLES 256
+
+enum perf_counter_id
+{
+    // Time to build and write out a frame
+    PERF_FRAME = 0,
+
+    // Bytes written to the terminal for a frame
+    PERF_FRAME_BYTES,
+
+    // Time spent in pager_paint
+    PERF_PAINT,
+
+    // Time to typeset a page (or a block of a lazily-typeset page)
+    PERF_TYPESET,
+
+    // Time spent line breaking during the above
+    PERF_LINE_BREAK,
+
+    // Time spent in search_perform
+    PERF_SEARCH,
+
+    // Time to fetch a page over the network
+    PERF_FETCH,
+
+    PERF_COUNTER_COUNT
+};
+
+struct perf_counter
+{
+    // Ring buffer of samples; microseconds, or bytes for PERF_FRAME_BYTES
+    uint32_t samples[PERF_SAMPLES];
+    int count, next;
+
+    // Nesting depth of perf_begin/perf_end, and when the outermost began
+    int depth;
+    uint64_t begin;
+
+    // Amount accumulated towards the next sample
+    uint64_t pending;
+};
+
+uint64_t perf_now(void);
+void perf_begin(enum perf_counter_id);
+bool perf_end(enum perf_counter_id);
+void perf_record(enum perf_counter_id, uint64_t);
+void perf_accumulate(enum perf_counter_id, uint64_t);
+void perf_commit(enum perf_counter_id);
+uint64_t perf_last(enum perf_counter_id);
+int perf_display(void);
+
+#endif
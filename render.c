@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "pager.h"
+#include "perf.h"
+#include "render.h"
+#include "state.h"
+#include "typesetter.h"
+
+/* Write text to stdout, dropping any escape sequences if plain */
+static void
+render_write(const char *s, size_t n, bool plain)
+{
+    if (!plain)
+    {
+        fwrite(s, 1, n, stdout);
+        return;
+    }
+
+    const char *const end = s + n;
+    while (s < end)
+    {
+        const char *esc = memchr(s, '\x1b', end - s);
+        if (!esc) esc = end;
+        fwrite(s, 1, esc - s, stdout);
+        if (esc == end) break;
+
+        // Skip over the escape; CSI sequences end with a byte in @ to ~
+        s = esc + 1;
+        if (s < end && *s == '[')
+        {
+            for (++s; s < end && (*s < 0x40 || *s > 0x7e); ++s);
+        }
+        if (s < end) ++s;
+    }
+}
+
+/*
+ * Typeset the current page repeat times at the given width, then write the
+ * typeset lines out
+ */
+int
+render_page(int width, int repeat, bool plain)
+{
+    uint64_t time_min = UINT64_MAX, time_max = 0, time_total = 0;
+
+    for (int rep = 0; rep < repeat; ++rep)
+    {
+        const uint64_t begin = perf_now();
+
+        g_pager->link_count = 0;
+        typesetter_reinit(&g_pager->typeset);
+        if (!typeset_page(&g_pager->typeset,
+            &g_pager->buffer, width, &g_recv->mime))
+        {
+            fprintf(stderr, "render: can't display '%s'\n", g_recv->mime.str);
+            return -1;
+        }
+        typeset_all(&g_pager->typeset, &g_pager->buffer);
+
+        const uint64_t t = perf_now() - begin;
+        time_min = min(time_min, t);
+        time_max = max(time_max, t);
+        time_total += t;
+    }
+
+    const struct pager_buffer *const buf = &g_pager->buffer;
+    for (int i = 0; i < buf->line_count; ++i)
+    {
+        const struct pager_buffer_line *const line = &buf->lines[i];
+        const char *s = pager_line_str(buf, line);
+
+        printf("%*s", line->indent, "");
+
+        // Links are coloured the same way as in the pager
+        if (!plain && line->link_index > -1)
+        {
+            fputs(COLOUR_PAGER_LINK_PROTOCOL, stdout);
+            fwrite(s, 1, line->proto_len, stdout);
+            fputs(COLOUR_PAGER_LINK_LOCATION, stdout);
+            s += line->proto_len;
+            fwrite(s, 1, line->bytes - line->proto_len, stdout);
+        }
+        else render_write(s, line->bytes, plain);
+
+        fputs(plain ? "\n" : "\x1b[0m\n", stdout);
+    }
+    fflush(stdout);
+
+    const double mean = (double)time_total / repeat;
+    fprintf(stderr,
+        "render: %zu bytes to %d lines at width %d; %d run%s, "
+        "min %.3f ms, mean %.3f ms, max %.3f ms (%.1f MiB/s)\n",
+        g_recv->size, buf->line_count, width,
+        repeat, repeat == 1 ? "" : "s",
+        time_min / 1000.0, mean / 1000.0, time_max / 1000.0,
+        mean > 0 ? g_recv->size / (mean / 1e6) / (1024.0 * 1024.0) : 0.0);
+
+    return 0;
+}
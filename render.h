@@ -0,0 +1,15 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+/*
+ * render.h
+ *
+ * Headless rendering (the --render option).  The page that was loaded is
+ * typeset at a fixed width and the formatted lines are written to stdout,
+ * for use in pipelines and for benchmarking the typesetter without a
+ * terminal.  Timings are reported on stderr so they don't mix with the page
+ */
+
+int render_page(int width, int repeat, bool plain);
+
+#endif
@@ -1,19 +1,61 @@
 #include "pch.h"
+#include "dfa.h"
+#include "event.h"
 #include "pager.h"
+#include "perf.h"
 #include "search.h"
 #include "tui.h"
+#include "typesetter.h"
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 static struct search *s_search = NULL;
 
+// The search from before a query began to be typed, to go back to if it's
+// cancelled
+static struct
+{
+    char query[sizeof(((struct search *)NULL)->query)];
+    unsigned query_len;
+    bool reverse;
+} s_prev;
+
+// The query that was last compiled as a regular expression, which is kept
+// until another one is searched for (so e.g. searching the same page again
+// after it's reloaded doesn't compile it again)
+static struct
+{
+    char query[sizeof(((struct search *)NULL)->query)];
+    bool compiled;
+    struct dfa dfa;
+
+    // Why the query isn't a valid pattern, or NULL if it is
+    const char *error;
+} s_regex;
+
+// Where a match is in the typeset buffer
+struct search_range
+{
+    struct
+    {
+        // Index of the typeset line, and offset in the typeset buffer
+        int line;
+        size_t loc;
+    } begin, end;
+};
+
+// Most matches on a raw line that are found in the typeset buffer at once
+#define SEARCH_MAP_BATCH 64
+
+// Most bytes of the typeset text that are skipped over looking for a byte of
+// the raw text, before deciding that the byte isn't shown (e.g. list bullets
+// and hyphens are skipped this way)
+#define SEARCH_MAP_SLACK 16
+
 static void search_scroll_to_next(void);
 static void search_scroll_to_prev(void);
-static int
-multiline_search_query(
-    const char *restrict,
-    const char *restrict,
-    struct pager_buffer *restrict,
-    int,
-    struct search_match *);
 
 /* Initialise search stuff */
 void
@@ -27,6 +69,8 @@ search_init(void)
         malloc(sizeof(struct search_match) * s_search->match_capacity);
 
     s_search->invalidated = true;
+    s_search->scanning = false;
+    s_search->scroll_orig = -1;
 }
 
 /* De-initialise search stuff */
@@ -36,20 +80,24 @@ search_deinit(void)
     free(s_search->matches);
 }
 
-/* Reset current search state */
+/* Free the compiled regular expression */
 void
-search_reset(void)
+search_regex_deinit(void)
 {
-    s_search->invalidated = true;
-    s_search->match_count = 0;
+    dfa_free(&s_regex.dfa);
+    s_regex.compiled = false;
 }
 
-/* Cause search to be refreshed */
+/* Reset current search state */
 void
-search_update(void)
+search_reset(void)
 {
+    // Highlights on the terminal are out of date
+    g_pager->scroll_painted = -1;
+
     s_search->invalidated = true;
-    search_perform();
+    s_search->scanning = false;
+    s_search->match_count = 0;
 }
 
 /* Navigate to next search item (based on direction) */
@@ -68,6 +116,223 @@ search_prev(void)
     else search_scroll_to_prev();
 }
 
+/* Make room for another match */
+static void
+search_check_match_capacity(struct search *s)
+{
+    if (s->match_count < s->match_capacity) return;
+
+    size_t new_cap = s->match_capacity * 2;
+    void *tmp = realloc(s->matches, new_cap * sizeof(struct search_match));
+    if (!tmp)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    s->match_capacity = new_cap;
+    s->matches = tmp;
+}
+
+/*
+ * Find the next byte that could begin a match; i.e. the first character of
+ * the query in either case.  Only the first byte can be checked this way, as
+ * the rest of a match may have different whitespace to the query
+ */
+static inline const char *
+search_scan_first(const char *s, const char *end, char lower, char upper)
+{
+#if defined(__SSE2__)
+    const __m128i l = _mm_set1_epi8(lower), u = _mm_set1_epi8(upper);
+    for (; end - s >= 16; s += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)s);
+        const int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, l), _mm_cmpeq_epi8(v, u)));
+        if (mask) return s + __builtin_ctz(mask);
+    }
+#else
+    if (lower == upper)
+    {
+        const char *const c = memchr(s, lower, end - s);
+        return c ? c : end;
+    }
+
+    // Check a word at a time for a byte equal to either case
+    const uint64_t ones = 0x0101010101010101ull,
+                   high = 0x8080808080808080ull;
+    for (; end - s >= 8; s += 8)
+    {
+        uint64_t w;
+        memcpy(&w, s, sizeof(w));
+        const uint64_t dl = w ^ (ones * (unsigned char)lower),
+                       du = w ^ (ones * (unsigned char)upper);
+        if (((dl - ones) & ~dl & high) | ((du - ones) & ~du & high)) break;
+    }
+#endif
+
+    for (; s < end && *s != lower && *s != upper; ++s);
+
+    return s;
+}
+
+/*
+ * Whether a query is a regular expression, i.e. it begins with
+ * SEARCH_REGEX_PREFIX.  Anything else is searched for as plain text, whatever
+ * characters are in it
+ */
+static bool
+search_is_regex(const char *query, size_t len)
+{
+    return len >= strlen(SEARCH_REGEX_PREFIX) &&
+        strncmp(query, SEARCH_REGEX_PREFIX, strlen(SEARCH_REGEX_PREFIX)) == 0;
+}
+
+/*
+ * Compile the query if it's a regular expression (and wasn't the last one to
+ * be compiled).  Returns false if it isn't a valid one
+ */
+static bool
+search_compile(void)
+{
+    const char *const query = s_search->query;
+    if (!search_is_regex(query, s_search->query_len)) return true;
+
+    if (s_regex.compiled && strcmp(query, s_regex.query) == 0)
+    {
+        return !s_regex.error;
+    }
+
+    dfa_free(&s_regex.dfa);
+    s_regex.error = NULL;
+    dfa_compile(&s_regex.dfa,
+        query + strlen(SEARCH_REGEX_PREFIX),
+        &s_regex.error);
+
+    strcpy(s_regex.query, query);
+    s_regex.compiled = true;
+    return !s_regex.error;
+}
+
+/* Tell the user that nothing was found (or why it couldn't be searched for) */
+static void
+search_say_not_found(void)
+{
+    if (!search_is_regex(s_search->query, s_search->query_len) ||
+        !s_regex.compiled ||
+        !s_regex.error)
+    {
+        tui_status_say("Pattern not found");
+        return;
+    }
+
+    tui_status_begin();
+    tui_printf("Invalid pattern: %s", s_regex.error);
+    tui_status_end();
+}
+
+/* Add a match found on the raw line being searched */
+static void
+search_add_match(
+    const char *raw,
+    const char *begin,
+    const char *end,
+    const char *shown)
+{
+    struct search *const s = s_search;
+
+    search_check_match_capacity(s);
+    s->matches[s->match_count++] = (struct search_match)
+    {
+        .raw_index = s->scan_line,
+        .begin = begin - raw,
+        .end = end - raw,
+        .shown = shown - raw,
+    };
+}
+
+/*
+ * Check for a match of the query at c, which can't go past end.  Case is
+ * ignored, and a space in the query matches any amount of whitespace (or
+ * none).  Returns where the match ends, or NULL if there's no match
+ */
+static const char *
+search_match_raw(const char *c, const char *end, const char *query)
+{
+    for (;;)
+    {
+        if (!*query) return c;
+        if (c >= end ||
+            tolower((unsigned char)*c) != tolower((unsigned char)*query))
+        {
+            return NULL;
+        }
+        ++c;
+        ++query;
+
+        if (*query == ' ')
+        {
+            // Skip any more white space, in both
+            for (; *query == ' '; ++query);
+            for (; c < end && (*c == ' ' || *c == '\t'); ++c);
+        }
+    }
+}
+
+/*
+ * Search the raw lines from s->scan_line onwards, for at most the given number
+ * of microseconds (or until the end if 0).  Returns whether the end of the
+ * document was reached
+ */
+static bool
+search_scan(uint64_t budget_us)
+{
+    struct search *const s = s_search;
+    const struct typesetter *const t = &g_pager->typeset;
+    const uint64_t deadline = budget_us ? perf_now() + budget_us : 0;
+    const bool regex = search_is_regex(s->query, s->query_len);
+
+    // Matches always begin with the first character of the query (in either
+    // case), so only those positions need to be checked properly
+    const char first_lower = tolower(s->query[0]),
+               first_upper = toupper(s->query[0]);
+
+    for (;; ++s->scan_line)
+    {
+        if (s->scan_line >= t->raw_line_count) return true;
+
+        if (deadline &&
+            s->scan_line % 64 == 0 &&
+            perf_now() >= deadline) return false;
+
+        // Only search the text that is actually shown, e.g. not the URIs of
+        // links that have labels
+        const char *const raw = t->raw_lines[s->scan_line].s;
+        const char *shown, *shown_end;
+        if (!typeset_raw_shown(t,
+            s->scan_line, &s->scan_verbatim, &shown, &shown_end)) continue;
+
+        if (regex)
+        {
+            const char *c, *end;
+            dfa_scan_line(&s_regex.dfa, shown, shown_end);
+            while ((c = dfa_scan_next(&s_regex.dfa, &end)))
+            {
+                search_add_match(raw, c, end, shown);
+            }
+            continue;
+        }
+
+        for (const char *c = shown;
+            (c = search_scan_first(c, shown_end, first_lower, first_upper)) <
+                shown_end;
+            ++c)
+        {
+            const char *const end = search_match_raw(c, shown_end, s->query);
+            if (end) search_add_match(raw, c, end, shown);
+        }
+    }
+}
+
 /* Perform search, assumes that query has already been set */
 void
 search_perform(void)
@@ -78,119 +343,510 @@ search_perform(void)
 
     s->match_count = 0;
     s->invalidated = false;
+    s->index = -1;
+    g_pager->scroll_painted = -1;
 
-    struct search_match match;
+    if (!search_compile())
+    {
+        search_say_not_found();
+        return;
+    }
+
+    perf_begin(PERF_SEARCH);
+
+    // Matches could be anywhere in the document
+    s->scan_line = 0;
+    s->scanning = false;
+    s->scan_verbatim = false;
+    search_scan(0);
 
-    // Search for all matches in the buffer itself
-    for (int i = 0; i < g_pager->buffer.line_count; ++i)
+    perf_end(PERF_SEARCH);
+
+    if (s->match_count == 0) search_say_not_found();
+}
+
+/* Move over any escape codes at c */
+static inline const char *
+search_skip_escapes(const char *c, const char *end)
+{
+    while (c < end && *c == '\x1b')
     {
-        struct pager_buffer_line *line = &g_pager->buffer.lines[i];
+        for (; c < end && *c != 'm'; ++c);
+        if (c < end) ++c;
+    }
+    return c;
+}
 
-        // Simple linear search for the string
-        for (const char *c = line->s;
-            c < line->s + line->bytes;
-            ++c)
+/*
+ * Find where some matches (which must all be on the same raw line, in order)
+ * are in the typeset buffer.  The typeset text is the shown part of the raw
+ * line with its whitespace changed (by wrapping, justification and indents)
+ * and a few things added (escapes, prefixes, bullets and hyphens), so the two
+ * are gone through side by side, lining up their non-whitespace bytes
+ */
+static void
+search_map(const struct search_match *m, int n, struct search_range *out)
+{
+    struct pager_buffer *const b = &g_pager->buffer;
+    const int r = m->raw_index;
+    const struct typeset_raw_line *const rawline =
+        &g_pager->typeset.raw_lines[r];
+
+    int li = b->line_count
+        ? typeset_raw_to_line(&g_pager->typeset, b, r)
+        : 0;
+    const struct pager_buffer_line *line = &b->lines[li];
+
+    // Anything that can't be found is put at the start of the line
+    for (int k = 0; k < n; ++k)
+    {
+        out[k].begin.line = out[k].end.line = li;
+        out[k].begin.loc = out[k].end.loc = b->line_count ? line->off : 0;
+    }
+    if (li >= b->line_count || b->line_pos[li].raw_index != r) return;
+
+    // The first line may begin with escapes, a blockquote prefix, or a link's
+    // index and protocol, before any of the raw text
+    const char *tp = b->b + line->off, *tp_end = tp + line->bytes;
+    tp = search_skip_escapes(tp, tp_end) + line->prefix_len;
+    if (line->link_index >= 0)
+    {
+        tp = max(tp, b->b + line->off + line->proto_len);
+    }
+    tp = min(tp, tp_end);
+
+    // Next match to begin, and first match that may not have ended yet
+    int k_begin = 0, k_end = 0;
+    for (const char *rp = rawline->s + m->shown;
+        rp < rawline->s + rawline->bytes && k_end < n;
+        ++rp)
+    {
+        if (*rp == ' ' || *rp == '\t') continue;
+
+        // Find the byte in the typeset text, skipping over whatever was added
+        const int li_from = li;
+        const char *const tp_from = tp;
+        bool found = false;
+        for (int skipped = 0; skipped <= SEARCH_MAP_SLACK;)
         {
-            // Check for match using our special search function
-            if (multiline_search_query(
-                c, s->query, &g_pager->buffer, i, &match) != 0) continue;
+            tp = search_skip_escapes(tp, tp_end);
+            if (tp >= tp_end)
+            {
+                // Carry on to the next line that the raw line was wrapped to
+                if (li + 1 >= b->line_count ||
+                    b->line_pos[li + 1].raw_index != r) break;
+
+                line = &b->lines[++li];
+                tp = b->b + line->off + line->prefix_len;
+                tp_end = b->b + line->off + line->bytes;
+                continue;
+            }
 
-            s->matches[s->match_count++] = (struct search_match)
+            if (*tp == *rp)
             {
-                .begin =
-                {
-                    .line = i,
-                    .loc = c,
-                },
-                .end = match.end
-            };
+                found = true;
+                break;
+            }
+            if (*tp != ' ' && *tp != '\t') ++skipped;
+            ++tp;
         }
+        if (!found)
+        {
+            // The byte isn't shown; pretend that it's where the search began
+            li = li_from;
+            line = &b->lines[li];
+            tp = tp_from;
+            tp_end = b->b + line->off + line->bytes;
+        }
+
+        const size_t loc = tp - b->b, o = rp - rawline->s;
+        for (; k_begin < n && m[k_begin].begin <= o; ++k_begin)
+        {
+            out[k_begin].begin.line = out[k_begin].end.line = li;
+            out[k_begin].begin.loc = out[k_begin].end.loc = loc;
+        }
+        if (found)
+        {
+            for (int k = k_end; k < k_begin; ++k)
+            {
+                if (o >= m[k].end) continue;
+                out[k].end.line = li;
+                out[k].end.loc = loc + 1;
+            }
+            ++tp;
+        }
+        for (; k_end < k_begin && m[k_end].end <= o + 1; ++k_end);
     }
+}
 
-    s->index = -1;
+/* Get the typeset line that a match begins on */
+static int
+search_match_line(unsigned i)
+{
+    struct search_range range;
+    search_map(&s_search->matches[i], 1, &range);
+    return range.begin.line;
+}
 
-    if (s->match_count == 0)
+/* Get the first match on or after the given raw line */
+static unsigned
+search_match_lower_bound(int raw_index)
+{
+    unsigned lo = 0, hi = s_search->match_count;
+    while (lo < hi)
     {
-        tui_status_say("Pattern not found");
-        return;
+        const unsigned mid = lo + (hi - lo) / 2;
+        if (s_search->matches[mid].raw_index < raw_index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Get the raw line that a typeset line came from */
+static int
+search_line_raw_index(int line)
+{
+    const struct pager_buffer *const b = &g_pager->buffer;
+    return b->line_pos[max(min(line, b->line_count - 1), 0)].raw_index;
+}
+
+/* Get the first match that begins on or after a typeset line, or -1 */
+static int
+search_match_from(int line)
+{
+    struct search *const s = s_search;
+    if (!g_pager->buffer.line_count) return -1;
+
+    // Only matches on the same raw line as it need to be found in the typeset
+    // buffer; the rest are before or after it
+    const int r = search_line_raw_index(line);
+    for (unsigned i = search_match_lower_bound(r); i < s->match_count; ++i)
+    {
+        if (s->matches[i].raw_index != r || search_match_line(i) >= line)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Get the last match that begins on or before a typeset line, or -1 */
+static int
+search_match_before(int line)
+{
+    struct search *const s = s_search;
+    if (!g_pager->buffer.line_count) return -1;
+
+    const int r = search_line_raw_index(line);
+    for (int i = (int)search_match_lower_bound(r + 1) - 1; i >= 0; --i)
+    {
+        if (s->matches[i].raw_index != r || search_match_line(i) <= line)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Whether the most recent match begins on the given typeset line */
+static bool
+search_index_on_line(int line)
+{
+    struct search *const s = s_search;
+    return s->index >= 0 &&
+        s->index < (int)s->match_count &&
+        g_pager->buffer.line_count &&
+        s->matches[s->index].raw_index == search_line_raw_index(line) &&
+        search_match_line(s->index) == line;
+}
+
+/*
+ * While a query is typed, show the first match from where it began to be
+ * typed (or the last one before it if searching in reverse)
+ */
+static void
+search_incremental_show(void)
+{
+    struct search *const s = s_search;
+
+    int i = s->reverse
+        ? search_match_before(s->scroll_orig)
+        : search_match_from(s->scroll_orig);
+
+    // Wrap around once the whole document has been searched
+    if (i < 0 && !s->scanning && s->match_count)
+    {
+        i = s->reverse ? s->match_count - 1 : 0;
+    }
+
+    g_pager->scroll = i < 0 ? s->scroll_orig : search_match_line(i);
+
+    tui_invalidate(INVALIDATE_PAGER_BIT | INVALIDATE_STATUS_LINE_BIT);
+}
+
+/* Search the next slice of the document for the query being typed */
+static void
+search_incremental_slice(void *data)
+{
+    (void)data;
+    struct search *const s = s_search;
+
+    if (s->scanning)
+    {
+        perf_begin(PERF_SEARCH);
+        s->scanning = !search_scan(SEARCH_INCREMENTAL_SLICE_US);
+        perf_end(PERF_SEARCH);
+
+        // Carry on once any input that came in meanwhile has been handled
+        if (s->scanning) event_timer_set(0, search_incremental_slice, NULL);
     }
+
+    search_incremental_show();
+}
+
+/* A query is about to be typed into the search prompt */
+void
+search_incremental_begin(bool reverse)
+{
+    struct search *const s = s_search;
+
+    memcpy(s_prev.query, s->query, sizeof(s_prev.query));
+    s_prev.query_len = s->query_len;
+    s_prev.reverse = s->reverse;
+
+    search_reset();
+    s->query_len = 0;
+    s->reverse = reverse;
+    s->scroll_orig = g_pager->scroll;
 }
 
-/* Highlight all text in the visible buffer that matches our search query */
+/* The query in the search prompt was changed; search for it as it is */
 void
-search_highlight_matches(void)
+search_incremental(const char *query, int query_len)
 {
-    // Highlight search matches
-    const struct search_match *match;
-    for (int i = 0; i < s_search->match_count; ++i)
+    struct search *const s = s_search;
+    if (s->scroll_orig < 0) return;
+
+    query_len = min(query_len, (int)sizeof(s->query) - 1);
+
+    // Nothing to do if it didn't actually change (e.g. the caret was moved)
+    if (!s->invalidated &&
+        query_len == s->query_len &&
+        strncmp(query, s->query, query_len) == 0) return;
+
+    // Matches of a query are always matches of any query that it begins
+    // with, so if some more was typed then it's just a matter of checking
+    // the matches found so far again (which isn't so for patterns)
+    const bool extends = !s->invalidated &&
+        !search_is_regex(query, query_len) &&
+        s->query_len > 0 &&
+        query_len > s->query_len &&
+        strncmp(query, s->query, s->query_len) == 0;
+
+    memcpy(s->query, query, query_len);
+    s->query[query_len] = '\0';
+    s->query_len = query_len;
+    s->index = -1;
+    g_pager->scroll_painted = -1;
+
+    if (!query_len)
     {
-        match = &s_search->matches[i];
+        event_timer_cancel(search_incremental_slice, NULL);
+        search_reset();
+        search_incremental_show();
+        return;
+    }
 
-        if (match->begin.line < g_pager->scroll ||
-            match->begin.line >= g_pager->scroll + g_pager->visible_buffer.h)
+    if (extends)
+    {
+        const struct typesetter *const t = &g_pager->typeset;
+        unsigned kept = 0;
+        for (unsigned i = 0; i < s->match_count; ++i)
         {
-            continue;
+            struct search_match *const m = &s->matches[i];
+            const char *const raw = t->raw_lines[m->raw_index].s;
+
+            // Only where the shown text ends is needed, which doesn't depend
+            // on whether the line is preformatted
+            const char *shown, *shown_end;
+            bool verbatim = false;
+            typeset_raw_shown(t,
+                m->raw_index, &verbatim, &shown, &shown_end);
+
+            const char *const end =
+                search_match_raw(raw + m->begin, shown_end, s->query);
+            if (!end) continue;
+
+            m->end = end - raw;
+            s->matches[kept++] = *m;
         }
+        s->match_count = kept;
+    }
+    else
+    {
+        s->match_count = 0;
+        s->scan_line = 0;
+        s->scanning = search_compile();
+        s->scan_verbatim = false;
+    }
+    s->invalidated = false;
 
-        // Match occurs in visible buffer; so move cursor to it's begin/end
-        // range and write some nice escape codes
+    search_incremental_slice(NULL);
+}
 
-        const struct pager_buffer_line
-            *const line_begin = &g_pager->buffer.lines[match->begin.line],
-            *line_end = &g_pager->buffer.lines[match->end.line],
-            *line_last_visible;
+/*
+ * The search prompt was finished with.  If the query was accepted then finish
+ * searching for it, otherwise go back to the search from before
+ */
+void
+search_incremental_end(bool accept)
+{
+    struct search *const s = s_search;
+    if (s->scroll_orig < 0) return;
 
-        // Make sure ending line is within the visible buffer
-        line_last_visible = &g_pager->buffer.lines[max(min(
-            g_pager->scroll + g_pager->visible_buffer.h - 1,
-            g_pager->buffer.line_count - 1), 0)];
-        for (;
-            line_end > line_last_visible;
-            --line_end);
+    event_timer_cancel(search_incremental_slice, NULL);
 
-        tui_cursor_move(
-            g_pager->margin.l + line_begin->indent +
-            utf8_width(
-                line_begin->s, match->begin.loc - line_begin->s),
-            (match->begin.line - g_pager->scroll) + 1);
+    g_pager->scroll = s->scroll_orig;
+    s->scroll_orig = -1;
 
-        if (line_end != line_begin) // spans multiple lines
+    if (accept)
+    {
+        if (s->scanning)
         {
-            // Print out the highlighted word to end of beginning line
-            tui_say("\x1b[7m");
-            tui_sayn(match->begin.loc,
-                line_begin->s + line_begin->bytes - match->begin.loc);
-            tui_say("\x1b[27m");
+            perf_begin(PERF_SEARCH);
+            search_scan(0);
+            perf_end(PERF_SEARCH);
+            s->scanning = false;
+        }
+        return;
+    }
 
-            // And print out lines in between
-            for (const struct pager_buffer_line *line_cur = line_begin + 1;
-                line_cur < line_end;
-                ++line_cur)
-            {
-                tui_cursor_move(
-                    g_pager->margin.l + line_cur->indent,
-                    (line_cur - line_begin +
-                     match->begin.line - g_pager->scroll) + 1);
-                tui_say("\x1b[7m");
-                tui_sayn(line_cur->s, line_cur->bytes);
-                tui_say("\x1b[27m");
-            }
+    memcpy(s->query, s_prev.query, sizeof(s->query));
+    s->query_len = s_prev.query_len;
+    s->reverse = s_prev.reverse;
+    search_reset();
+
+    tui_invalidate(INVALIDATE_PAGER_BIT | INVALIDATE_STATUS_LINE_BIT);
+}
+
+/* Highlight a match, if it's on the visible rows row_begin to row_end */
+static void
+search_highlight_range(
+    const struct search_range *match,
+    int row_begin,
+    int row_end)
+{
+    if (match->begin.line < g_pager->scroll ||
+        match->begin.line >= g_pager->scroll + g_pager->visible_buffer.h)
+    {
+        return;
+    }
+
+    // Rows outside of the range are already highlighted
+    if (match->end.line < g_pager->scroll + row_begin ||
+        match->begin.line >= g_pager->scroll + row_end)
+    {
+        return;
+    }
 
-            // And the rest of the highlighted word on the ending line
+    // Match occurs in visible buffer; so move cursor to it's begin/end
+    // range and write some nice escape codes
+
+    const struct pager_buffer_line
+        *const line_begin = &g_pager->buffer.lines[match->begin.line],
+        *line_end = &g_pager->buffer.lines[match->end.line],
+        *line_last_visible;
+
+    // Make sure ending line is within the visible buffer
+    line_last_visible = &g_pager->buffer.lines[max(min(
+        g_pager->scroll + g_pager->visible_buffer.h - 1,
+        g_pager->buffer.line_count - 1), 0)];
+    for (;
+        line_end > line_last_visible;
+        --line_end);
+
+    const char *const text = g_pager->buffer.b;
+    tui_cursor_move(
+        g_pager->margin.l + line_begin->indent +
+        utf8_width(
+            text + line_begin->off, match->begin.loc - line_begin->off),
+        (match->begin.line - g_pager->scroll) + 1);
+
+    if (line_end != line_begin) // spans multiple lines
+    {
+        // Print out the highlighted word to end of beginning line
+        tui_say("\x1b[7m");
+        tui_sayn(text + match->begin.loc,
+            line_begin->off + line_begin->bytes - match->begin.loc);
+        tui_say("\x1b[27m");
+
+        // And print out lines in between
+        for (const struct pager_buffer_line *line_cur = line_begin + 1;
+            line_cur < line_end;
+            ++line_cur)
+        {
             tui_cursor_move(
-                g_pager->margin.l + line_end->indent,
-                (match->end.line - g_pager->scroll) + 1);
+                g_pager->margin.l + line_cur->indent,
+                (line_cur - line_begin +
+                 match->begin.line - g_pager->scroll) + 1);
             tui_say("\x1b[7m");
-            tui_sayn(line_end->s, match->end.loc - line_end->s);
+            tui_sayn(text + line_cur->off, line_cur->bytes);
             tui_say("\x1b[27m");
         }
-        else // single line
+
+        // And the rest of the highlighted word on the ending line
+        tui_cursor_move(
+            g_pager->margin.l + line_end->indent,
+            (match->end.line - g_pager->scroll) + 1);
+        tui_say("\x1b[7m");
+        tui_sayn(text + line_end->off, match->end.loc - line_end->off);
+        tui_say("\x1b[27m");
+    }
+    else // single line
+    {
+        // Print out the highlighted word to end of range
+        tui_say("\x1b[7m");
+        tui_sayn(text + match->begin.loc,
+            match->end.loc - match->begin.loc);
+        tui_say("\x1b[27m");
+    }
+}
+
+/*
+ * Highlight all text in the visible buffer that matches our search query, on
+ * visible rows row_begin to row_end (exclusive)
+ */
+void
+search_highlight_matches(int row_begin, int row_end)
+{
+    struct search *const s = s_search;
+    const struct pager_buffer *const b = &g_pager->buffer;
+    if (!s->match_count || g_pager->scroll >= b->line_count) return;
+
+    // Only the matches on the raw lines that are visible need to be found in
+    // the typeset buffer
+    const int raw_last = search_line_raw_index(
+        g_pager->scroll + g_pager->visible_buffer.h - 1);
+
+    struct search_range ranges[SEARCH_MAP_BATCH];
+    for (unsigned i = search_match_lower_bound(
+            b->line_pos[g_pager->scroll].raw_index);
+        i < s->match_count && s->matches[i].raw_index <= raw_last;)
+    {
+        // Find the matches on the same raw line all at once
+        int n = 1;
+        for (;
+            i + n < s->match_count &&
+                n < SEARCH_MAP_BATCH &&
+                s->matches[i + n].raw_index == s->matches[i].raw_index;
+            ++n);
+        search_map(&s->matches[i], n, ranges);
+
+        for (int k = 0; k < n; ++k)
         {
-            // Print out the highlighted word to end of range
-            tui_say("\x1b[7m");
-            tui_sayn(match->begin.loc, match->end.loc - match->begin.loc);
-            tui_say("\x1b[27m");
+            search_highlight_range(&ranges[k], row_begin, row_end);
         }
+        i += n;
     }
 }
 
@@ -204,44 +860,21 @@ search_scroll_to_next(void)
 
     if (s->match_count == 0)
     {
-        tui_status_say("Pattern not found");
+        search_say_not_found();
         return;
     }
 
-    // Start search from scroll position
-    const int search_pos = g_pager->scroll;
-    bool got = false;
-    for (int i = 0; i < s->match_count; ++i)
-    {
-        if (s->matches[i].begin.line >= search_pos)
-        {
-            if (s->index != -1 && i <= s->index)
-            {
-                // Check if there's any other matches on this line we could use
-                // instead
-                for (int j = i + 1; j < s->match_count; ++j)
-                {
-                    if (s->matches[j].begin.line == search_pos)
-                    {
-                        i = j;
-                        break;
-                    }
-                }
-                if (s->index == i) continue;
-            }
+    // Start search from scroll position, moving past the most recent match if
+    // it's there
+    int i = search_index_on_line(g_pager->scroll)
+        ? s->index + 1
+        : search_match_from(g_pager->scroll);
 
-            s->index = i;
-            g_pager->scroll = s->matches[i].begin.line;
-            got = true;
-            break;
-        }
-    }
-    if (!got)
-    {
-        // Wrap search
-        s->index = 0;
-        g_pager->scroll = s->matches[s->index].begin.line;
-    }
+    // Wrap search
+    if (i < 0 || i >= (int)s->match_count) i = 0;
+
+    s->index = i;
+    g_pager->scroll = search_match_line(i);
 
     tui_invalidate(INVALIDATE_PAGER_BIT);
 
@@ -263,45 +896,21 @@ search_scroll_to_prev(void)
 
     if (s->match_count == 0)
     {
-        tui_status_say("Pattern not found");
+        search_say_not_found();
         return;
     }
 
-    // Start search from scroll position
-    const int search_pos = g_pager->scroll;
+    // Start search from scroll position, moving past the most recent match if
+    // it's there
+    int i = search_index_on_line(g_pager->scroll)
+        ? s->index - 1
+        : search_match_before(g_pager->scroll);
 
-    bool got = false;
-    for (int i = s->match_count - 1; i > -1; --i)
-    {
-        if (s->matches[i].begin.line <= search_pos)
-        {
-            if (s->index != -1 && i >= s->index)
-            {
-                // Check if there's any other matches on this line we could use
-                // instead
-                for (int j = i - 1; j > -1; --j)
-                {
-                    if (s->matches[j].begin.line == search_pos)
-                    {
-                        i = j;
-                        break;
-                    }
-                }
-                if (s->index == i) continue;
-            }
+    // Wrap
+    if (i < 0) i = s->match_count - 1;
 
-            s->index = i;
-            g_pager->scroll = s->matches[i].begin.line;
-            got = true;
-            break;
-        }
-    }
-    if (!got)
-    {
-        // Wrap
-        s->index = s->match_count - 1;
-        g_pager->scroll = s->matches[s->index].begin.line;
-    }
+    s->index = i;
+    g_pager->scroll = search_match_line(i);
 
     tui_invalidate(INVALIDATE_PAGER_BIT);
 
@@ -312,129 +921,3 @@ search_scroll_to_prev(void)
         s->index + 1, s->match_count);
     tui_status_end();
 }
-
-/*
- * Search function that works across wrapped lines of the buffer, including
- * across hyphenations
- */
-static int
-multiline_search_query(
-    // String/location that we are currently comparing
-    const char *restrict s1,
-    // Search query to check for match from s1
-    const char *restrict query,
-    // The pager buffer and index of line that s1 begins on
-    struct pager_buffer *restrict b,
-    int line_index,
-    struct search_match *match)
-{
-    /*
-     * There's a few rules we lay out to determine if a match occurs
-     * + Whitespace counts are always ignored; i.e. spaces will always match if
-     *   there is at least one whitespace character; this helps simplify the
-     *   wrapped word search a bit.
-     * + If the comparison has been good so far and we reach the end of the
-     *   line; there is 3 possible outcomes to consider:
-     *     0.) the match succeeds because there is no characters left of the
-     *         query.
-     *
-     *         query="foo"
-     *
-     *         |This is a line foo| <-- match succeeds
-     *         |A second line     |
-     *
-     *     1.) the current word being checked does not have whitespace, and is
-     *         hyphenated across the line, so the check continues on the next
-     *         line
-     *
-     *         query="foobar"
-     *
-     *                     |This is a line foo-|
-     *         move here ->|bar second line    |
-     *
-     *     2.) the current word being checked in the query has whitespace where
-     *         we are and we are at end of the current line, so match continues
-     *         from next non-whitespace character (usually first char) on the
-     *         next line
-     *
-     *         query="foo bar"
-     *
-     *                     |This is a line foo|
-     *                     |bar second line   |
-     *                      ^-- begin here, technically should not be any
-     *                          actual whitespace before this on this line
-     *                          because of the line breaking algorithm.
-     *
-     * + In future, we will also need to make considerations for other things,
-     *   like ignoring escape codes (in case of bold/italic highlighting) and
-     *   could provide matches for e.g. UTF-8 bullet point character to
-     *   asterisks, etc.
-     * + Matching of multi-byte UTF-8 sequences hasn't been tested, but
-     *   it should work reasonably fine, I think.
-     */
-
-    // Current line we are on and searching
-    const char *line = b->lines[line_index].s + b->lines[line_index].prefix_len,
-               *line_end = b->lines[line_index].s + b->lines[line_index].bytes;
-
-    // Match until we reach end of query
-    const char *c;
-    for (c = s1;;)
-    {
-        // Check that current character matches
-        if (!*query) goto match;
-
-        //if (*c != *query) break;
-        if (tolower(*c) != tolower(*query)) break;
-
-        // Move to next char
-        c = next_char_w_formats(c, line_end);
-        ++query;
-
-        // Check for match
-        if (!*query) goto match;
-
-        if (*query == ' ')
-        {
-            // Skip any more white space
-            for (; *query && *query == ' '; ++query);
-
-            // Move to next line
-            if (!*c || c >= line_end) goto next_line;
-
-            // Skip white space in pointer too
-            for (;
-                c < line_end && *c && *c == ' ';
-                c = next_char_w_formats(c, line_end));
-
-            continue;
-        }
-
-        // If we reach a hyphen at the end of the line, then move to the next
-        // line
-        if (c >= line_end - 1 &&
-            *c == '-' &&
-            b->lines[line_index].is_hyphenated)
-        {
-            // Move to next line
-            goto next_line;
-        }
-
-        continue;
-    next_line:
-        ++line_index;
-        if (line_index >= b->line_count) break;
-        line     = b->lines[line_index].s + b->lines[line_index].prefix_len;
-        line_end = b->lines[line_index].s + b->lines[line_index].bytes;
-        for (c = line;
-            c < line_end && *c && *c == ' ';
-            c = next_char_w_formats(c, line_end));
-    }
-
-    return -1;
-
-match:
-    match->end.line = line_index;
-    match->end.loc = c;
-    return 0;
-}
@@ -11,20 +11,17 @@
 
 struct search_match
 {
-    // We store the range where the match begins/ends
-    struct
-    {
-        // Index in the *typeset* buffer where the match was found.  We
-        // use the typeset buffer rather than the raw one because the
-        // raw one creates way too many issues to try and deal with
-        // (i.e. unformatted text is present, and it's a royal pain in
-        // the ass to work out where the match is in the typeset buffer
-        // to highlight it)
-        unsigned line;
-
-        // Location of the beginning/end in the line's buffer pointer
-        const char *loc;
-    } begin, end;
+    // Raw line that the match was found on, and where the match begins/ends
+    // as byte offsets into it.  Matches are kept against the raw document so
+    // that they stay valid when it's typeset again (e.g. on window width
+    // resize); they are only found in the typeset buffer when they are shown
+    // or scrolled to
+    int raw_index;
+    uint32_t begin, end;
+
+    // Offset where the shown text of the raw line begins (e.g. after the
+    // asterisk of a list item), to line it up with the typeset text from
+    uint32_t shown;
 };
 
 struct search
@@ -38,8 +35,7 @@ struct search
     unsigned match_count;
     unsigned match_capacity;
 
-    // Whether the match locations need to be updated due to the typeset
-    // buffer changing (e.g. on window width resize)
+    // Whether the query was changed since the document was last searched
     bool invalidated;
 
     // Index of most recent match (e.g. via 'n'/'N' keys)
@@ -47,15 +43,30 @@ struct search
 
     // Whether we are searching in reverse (via '?')
     bool reverse;
+
+    // Searching as the query is typed is done a slice at a time, so that
+    // typing doesn't stall on large pages; this is the next raw line to
+    // search, whether there is more to do, and whether the lines being
+    // searched are preformatted
+    int scan_line;
+    bool scanning;
+    bool scan_verbatim;
+
+    // Scroll position from before the query began to be typed, to go back to
+    // if it's cancelled; -1 when not typing a query
+    int scroll_orig;
 };
 
 void search_init(void);
 void search_deinit(void);
+void search_regex_deinit(void);
 void search_reset(void);
-void search_update(void);
 void search_perform(void);
 void search_next(void);
 void search_prev(void);
-void search_highlight_matches(void);
+void search_highlight_matches(int, int);
+void search_incremental_begin(bool);
+void search_incremental(const char *, int);
+void search_incremental_end(bool);
 
 #endif
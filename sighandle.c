@@ -1,25 +1,35 @@
 #include "pch.h"
+#include "event.h"
 #include "sighandle.h"
 #include "tui.h"
 
 volatile bool g_sigint_caught = false;
 
-/* Interrupt/termination handler */
+/*
+ * Interrupt/termination handler.  This is called from the event loop, and
+ * just ends the main loop, so that cleaning up (which locks, frees, and writes
+ * files) happens in the normal flow of the program rather than in a handler.
+ * A fetch that's in progress gives up when the signal arrives, so that the
+ * loop gets to it
+ */
 static void
 handle_sigint_sigterm(int param)
 {
     (void)param;
-    exit(0);
+    g_sigint_caught = true;
 }
 
-/* Window resize handler */
+/*
+ * Window resize handler.  This is called from the event loop rather than
+ * the signal handler itself, as resizing re-typesets the whole page
+ */
 static void
 handle_sigwinch(int param)
 {
     (void)param;
 
-    // Update TUI dimensions
-    tui_resized();
+    // Update TUI dimensions (once they've stopped changing)
+    tui_resize_requested();
 }
 
 /* Register signal handlers */
@@ -27,13 +37,9 @@ void
 sighandle_register(void)
 {
     // Register signal termination and interrupt handlers
-    struct sigaction sigact;
-    memset(&sigact, 0, sizeof(sigact));
-    sigact.sa_handler = handle_sigint_sigterm;
-    sigaction(SIGINT, &sigact, NULL);
-    sigaction(SIGTERM, &sigact, NULL);
+    event_signal_add(SIGINT, handle_sigint_sigterm, true);
+    event_signal_add(SIGTERM, handle_sigint_sigterm, true);
 
     // Register window resize signal handler
-    sigact.sa_handler = handle_sigwinch;
-    sigaction(SIGWINCH, &sigact, NULL);
+    event_signal_add(SIGWINCH, handle_sigwinch, false);
 }
@@ -1,7 +1,9 @@
 #include "pch.h"
 #include "pager.h"
+#include "perf.h"
 #include "state.h"
 #include "status_line.h"
+#include "tabs.h"
 #include "tui.h"
 
 struct status_line g_statline;
@@ -59,33 +61,94 @@ status_line_paint(void)
 
         case STATUS_LINE_COMPONENT_RIGHT:
         {
-            int scroll_percent = (int)ceil(100.0 *
-                g_pager->scroll /
-                ((int)max(g_pager->buffer.line_count, 2) - 1));
+            int scroll_percent;
+            if (typeset_is_done(&g_pager->typeset))
+            {
+                scroll_percent = (int)ceil(100.0 *
+                    g_pager->scroll /
+                    ((int)max(g_pager->buffer.line_count, 2) - 1));
+            }
+            else
+            {
+                // Document is only partially typeset; so estimate from the
+                // raw line we are up to (and never claim we're at the bottom)
+                const int raw_index = g_pager->scroll <
+                    g_pager->buffer.line_count
+                    ? g_pager->buffer.line_pos[g_pager->scroll].raw_index
+                    : 0;
+                scroll_percent = min((int)ceil(100.0 * raw_index /
+                    max(g_pager->typeset.raw_line_count, 1)), 99);
+            }
             scroll_percent = max(scroll_percent, 0);
+
+            // Which tab this is, if there are others
+            char tab[32] = "";
+            if (tabs_count() > 1)
+            {
+                snprintf(tab, sizeof(tab), "  [%d/%d]",
+                    tabs_current() + 1, tabs_count());
+            }
+
             switch (scroll_percent)
             {
             case 0:
                 c->len = snprintf(text, sizeof(text),
-                    " %s  top", g_recv->mime.str);
+                    " %s  top%s", g_recv->mime.str, tab);
                 break;
             case 100:
                 c->len = snprintf(text, sizeof(text),
-                    " %s  bottom", g_recv->mime.str);
+                    " %s  bottom%s", g_recv->mime.str, tab);
                 break;
             default:
                 c->len = snprintf(text, sizeof(text),
-                    " %s  %d%%", g_recv->mime.str, scroll_percent);
+                    " %s  %d%%%s", g_recv->mime.str, scroll_percent, tab);
                 break;
             }
             c->bytes = c->len;
             x_pos = g_tui->w - c->len + 1;
         } break;
 
+        case STATUS_LINE_COMPONENT_PERF:
+        {
+        #if STATUS_LINE_PERF
+            const struct status_line_component
+                *const left = &g_statline.components[
+                    STATUS_LINE_COMPONENT_LEFT],
+                *const right = &g_statline.components[
+                    STATUS_LINE_COMPONENT_RIGHT];
+            const int right_x = g_tui->w - (int)right->len + 1;
+
+            // Clear where it was last time, without touching the right side
+            if (c->len_prev)
+            {
+                tui_cursor_move(c->x, g_tui->h - 1);
+                tui_printf("%*s", min((int)c->len_prev, right_x - c->x), "");
+            }
+
+            c->len = snprintf(text, sizeof(text),
+                "paint %.2fms  frame %luB  typeset %.1fms  lb %.1fms  ",
+                perf_last(PERF_PAINT) / 1000.0,
+                (unsigned long)perf_last(PERF_FRAME_BYTES),
+                perf_last(PERF_TYPESET) / 1000.0,
+                perf_last(PERF_LINE_BREAK) / 1000.0);
+
+            // Only if it fits between the left and right sides
+            if ((int)(left->len + c->len + right->len) + 4 > g_tui->w)
+            {
+                c->len = 0;
+            }
+            c->bytes = c->len;
+            x_pos = right_x - c->len;
+        #else
+            continue;
+        #endif
+        } break;
+
         default: continue;
         }
 
         // Draw the new text
+        c->x = x_pos;
         tui_cursor_move(x_pos, g_tui->h - 1);
         tui_say(COLOUR_STATUS_LINE);
         tui_sayn(text, c->bytes);
@@ -93,7 +156,7 @@ status_line_paint(void)
 
         // Clear previous text
         int clear = (int)(c->len_prev - c->len);
-        if (clear <= 0) continue;
+        if (clear <= 0 || cid == STATUS_LINE_COMPONENT_PERF) continue;
         if (cid == STATUS_LINE_COMPONENT_RIGHT)
         {
             tui_cursor_move(
@@ -9,6 +9,9 @@ enum status_line_component_id
     STATUS_LINE_COMPONENT_LEFT = 0,
     STATUS_LINE_COMPONENT_RIGHT,
 
+    // Timings of the last paint, typeset, etc. (see STATUS_LINE_PERF)
+    STATUS_LINE_COMPONENT_PERF,
+
     STATUS_LINE_COMPONENT_COUNT
 };
 
@@ -17,6 +20,9 @@ struct status_line_component
     bool invalidated;
     size_t len, bytes;
     size_t len_prev, bytes_prev;
+
+    // Column the component was last drawn at
+    int x;
 };
 
 struct status_line
@@ -0,0 +1,264 @@
+#include "pch.h"
+#include "history.h"
+#include "pager.h"
+#include "state.h"
+#include "tabs.h"
+#include "tui.h"
+#include "typesetter.h"
+
+static struct tab s_tabs[TABS_MAX];
+static int s_count = 0, s_current = 0;
+
+// Incremented each time a tab is shown
+static unsigned long s_clock = 0;
+
+static void tabs_drop_typeset(void);
+
+void
+tabs_init(void)
+{
+    s_count = 1;
+    s_current = 0;
+    s_tabs[0].last_used = ++s_clock;
+}
+
+/* Move the page in g_state out into a tab */
+static void
+tab_save(struct tab *t)
+{
+    // Cached items can be freed or replaced at any time, so the tab needs its
+    // own copy of the page
+    if (g_recv->b_alt)
+    {
+        recv_buffer_check_size(g_recv->size);
+        memcpy(g_recv->b, g_recv->b_alt, g_recv->size);
+        typesetter_rebase(&g_pager->typeset, g_recv->b_alt, g_recv->b);
+        g_recv->b_alt = NULL;
+    }
+    g_pager->cached_page = NULL;
+
+    t->pager = g_state.pager;
+    t->recv = g_state.recv_buffer;
+    t->uri = g_state.uri;
+    t->hist = g_state.hist;
+}
+
+/* Move a tab's page into g_state */
+static void
+tab_take(const struct tab *t)
+{
+    pager_page_take(&t->pager);
+    g_state.recv_buffer = t->recv;
+    g_state.uri = t->uri;
+    g_state.hist = t->hist;
+}
+
+/* Set up an empty page in g_state */
+static void
+tab_page_new(void)
+{
+    pager_page_empty();
+
+    g_recv->capacity = 4096;
+    g_recv->b = malloc(g_recv->capacity);
+    g_recv->b_alt = NULL;
+    g_recv->size = 0;
+    memset(&g_recv->mime, 0, sizeof(struct mime));
+    if (!g_recv->b)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    g_state.uri = uri_parse(URI_INTERNAL_BLANK, strlen(URI_INTERNAL_BLANK));
+
+    history_stack_init(g_hist);
+}
+
+/* Free the page in g_state */
+static void
+tab_page_free(void)
+{
+    pager_page_deinit();
+
+    free(g_recv->b);
+    g_recv->b = NULL;
+
+    history_stack_deinit(g_hist);
+}
+
+/* Show the given tab (the current page must have been moved out already) */
+static void
+tab_show(int index)
+{
+    struct tab *const t = &s_tabs[index];
+    tab_take(t);
+    s_current = index;
+    t->last_used = ++s_clock;
+
+    if (t->dropped)
+    {
+        t->dropped = false;
+        pager_retypeset(t->scroll_raw_index, t->scroll_raw_dist);
+    }
+
+    // The window may have been resized since the tab was last shown
+    pager_resized();
+
+    tabs_drop_typeset();
+
+    tui_repaint(false);
+}
+
+void
+tabs_deinit(void)
+{
+    tab_save(&s_tabs[s_current]);
+    for (int i = 0; i < s_count; ++i)
+    {
+        if (i == s_current) continue;
+        tab_take(&s_tabs[i]);
+        tab_page_free();
+    }
+    tab_take(&s_tabs[s_current]);
+
+    s_count = 1;
+    s_current = 0;
+}
+
+/* Open a new tab (with an empty page) after the current one */
+int
+tabs_new(void)
+{
+    if (s_count >= TABS_MAX)
+    {
+        tui_status_say("Too many tabs open");
+        return -1;
+    }
+
+    tab_save(&s_tabs[s_current]);
+
+    const int index = s_current + 1;
+    memmove(&s_tabs[index + 1],
+        &s_tabs[index],
+        (s_count - index) * sizeof(struct tab));
+    ++s_count;
+
+    s_tabs[index] = (struct tab) { .last_used = ++s_clock };
+    s_current = index;
+
+    tab_page_new();
+
+    return 0;
+}
+
+/* Load a page in a new tab */
+int
+tabs_open(const struct uri *uri_in)
+{
+    // The URI may be pointing into the current page (e.g. a link)
+    const struct uri uri = *uri_in;
+
+    if (tabs_new() < 0) return -1;
+
+    if (tui_go_to_uri(&uri, true, false) != 0)
+    {
+        tabs_close();
+        return -1;
+    }
+    return 0;
+}
+
+/* Close the current tab */
+void
+tabs_close(void)
+{
+    if (s_count <= 1)
+    {
+        tui_status_say("Can't close the last tab");
+        return;
+    }
+
+    tab_page_free();
+
+    memmove(&s_tabs[s_current],
+        &s_tabs[s_current + 1],
+        (s_count - s_current - 1) * sizeof(struct tab));
+    --s_count;
+
+    // Show the tab before it (like closing a tab in most browsers)
+    tab_show(max(s_current - 1, 0));
+}
+
+/* Switch to a tab relative to the current one (wrapping around) */
+void
+tabs_switch(int offset)
+{
+    if (s_count <= 1)
+    {
+        tui_status_say("No other tabs open");
+        return;
+    }
+
+    tab_save(&s_tabs[s_current]);
+    tab_show(((s_current + offset) % s_count + s_count) % s_count);
+}
+
+int
+tabs_count(void)
+{
+    return s_count;
+}
+
+int
+tabs_current(void)
+{
+    return s_current;
+}
+
+/* Memory used by a tab's typeset buffer */
+static size_t
+tab_typeset_size(const struct tab *t)
+{
+    const struct pager_buffer *const b = &t->pager.buffer;
+    return b->size + b->lines_capacity *
+        (sizeof(struct pager_buffer_line) +
+            sizeof(struct pager_buffer_line_pos));
+}
+
+/*
+ * Drop the typeset buffers of the least recently used tabs in the background
+ * until they are under TABS_TYPESET_MEM_MAX
+ */
+static void
+tabs_drop_typeset(void)
+{
+    for (;;)
+    {
+        size_t total = 0;
+        struct tab *lru = NULL;
+        for (int i = 0; i < s_count; ++i)
+        {
+            struct tab *const t = &s_tabs[i];
+            if (i == s_current || t->dropped) continue;
+
+            total += tab_typeset_size(t);
+            if (!lru || t->last_used < lru->last_used) lru = t;
+        }
+        if (!lru || total <= TABS_TYPESET_MEM_MAX) break;
+
+        // Remember where it was scrolled to
+        struct pager_state *const p = &lru->pager;
+        lru->scroll_raw_index = 0;
+        lru->scroll_raw_dist = 0;
+        if (p->scroll < p->buffer.line_count)
+        {
+            lru->scroll_raw_index = p->buffer.line_pos[p->scroll].raw_index;
+            lru->scroll_raw_dist = p->buffer.line_pos[p->scroll].raw_dist;
+        }
+
+        pager_buffer_free(&p->buffer);
+        p->scroll = 0;
+        lru->dropped = true;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef TABS_H
+#define TABS_H
+
+#include "state.h"
+
+/*
+ * tabs.h
+ *
+ * Multiple pages open at once.  The page that is being viewed always lives in
+ * g_state (where everything else expects it), and the others are moved out
+ * into tabs with their raw and typeset buffers, links, marks, search and
+ * history intact.  Switching tabs just moves the states around and repaints.
+ */
+
+struct tab
+{
+    // State of the page in the tab (not valid for the current tab, as that is
+    // in g_state).  The pager's visible buffers are not kept, as they belong
+    // to the terminal rather than the page
+    struct pager_state pager;
+    struct recv_buffer recv;
+    struct uri uri;
+    struct history_stack hist;
+
+    // When the tab was last shown, for dropping the typeset buffers of the
+    // least recently used tabs first
+    unsigned long last_used;
+
+    // Whether the typeset buffer was dropped, and the position in the raw
+    // document that was at the top of the pager
+    bool dropped;
+    int scroll_raw_index;
+    size_t scroll_raw_dist;
+};
+
+void tabs_init(void);
+void tabs_deinit(void);
+int  tabs_new(void);
+int  tabs_open(const struct uri *);
+void tabs_close(void);
+void tabs_switch(int);
+int  tabs_count(void);
+int  tabs_current(void);
+
+#endif
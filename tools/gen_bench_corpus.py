@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+# Generates the synthetic corpus in bench/corpus/ that the benchmarks run over.
+# The output only depends on the seed, so the corpus is checked in and only
+# needs regenerating if this script changes:
+#
+#   python3 tools/gen_bench_corpus.py bench/corpus
+#
+import os
+import random
+import sys
+
+WORDS = [
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "and",
+    "typesetting", "paragraph", "hyphenation", "extraordinary", "of", "a",
+    "gemini", "capsule", "protocol", "document", "with", "some", "words",
+    "naïve", "café", "über", "façade", "—", "“quoted”", "日本語", "text.",
+    "sentence.", "comma,", "is", "to", "in", "it", "that", "for", "on",
+    "internationalisation", "incomprehensibilities", "gopherhole", "phlog",
+]
+
+# Rare word that the search benchmark looks for
+NEEDLE = "needle"
+
+HOSTS = [
+    "example.org", "gemini.circumlunar.space", "gopher.floodgap.com",
+    "tilde.example", "xn--caf-dma.example", "localhost",
+]
+
+rng = random.Random(0x5271)
+
+class Output:
+    """Text being generated, and its size in bytes"""
+    def __init__(self):
+        self.parts, self.size = [], 0
+
+    def add(self, s):
+        self.parts.append(s)
+        self.size += len(s.encode())
+
+    def text(self):
+        return "".join(self.parts)
+
+def sentence(n_min, n_max):
+    words = [rng.choice(WORDS) for _ in range(rng.randint(n_min, n_max))]
+    if words and rng.random() < 0.05:
+        words[rng.randrange(len(words))] = NEEDLE
+    return " ".join(words)
+
+def path():
+    parts = [rng.choice(["docs", "phlog", "~user", "2022", "a b", "x"])
+        for _ in range(rng.randint(0, 4))]
+    name = rng.choice(["index.gmi", "post.gmi", "", "file.txt", "img.png"])
+    return "/" + "/".join(parts + [name])
+
+def gemtext(size):
+    out, n = Output(), 0
+    while out.size < size:
+        n += 1
+        if n % 40 == 1:
+            out.add("%s Section %d\n\n" % ("#" * (1 + n // 40 % 3), n))
+        elif n % 7 == 0:
+            out.add("=> gemini://%s%s %s\n" % (
+                rng.choice(HOSTS), path(), sentence(1, 6)))
+        elif n % 11 == 0:
+            out.add("* %s\n" % sentence(3, 20))
+        elif n % 13 == 0:
+            out.add("> %s\n" % sentence(10, 60))
+        elif n % 29 == 0:
+            out.add("\n```\n")
+            for i in range(rng.randint(2, 10)):
+                out.add("    %s\n" % sentence(1, 12))
+            out.add("```\n\n")
+        else:
+            out.add(sentence(5, 120) + "\n")
+    return out.text()
+
+def gophermap(size):
+    out = Output()
+    while out.size < size:
+        t = rng.choice("iiiiii0017h")
+        host = rng.choice(HOSTS)
+        if t == "i":
+            out.add("i%s\tfake\t(NULL)\t0\r\n" % sentence(0, 12)[:70])
+        elif t == "h":
+            out.add("h%s\tURL:https://%s%s\t%s\t70\r\n" % (
+                sentence(1, 6), host, path(), host))
+        else:
+            out.add("%s%s\t%s\t%s\t70\r\n" % (
+                t, sentence(1, 8), path(), host))
+    out.add(".\r\n")
+    return out.text()
+
+def plaintext(size):
+    out = Output()
+    while out.size < size:
+        line, para = "", []
+        for word in sentence(20, 200).split(" "):
+            if len(line) + len(word) > 70:
+                para.append(line)
+                line = ""
+            line = (line + " " + word) if line else word
+        para.append(line)
+        out.add("\n".join(para) + "\n\n")
+    return out.text()
+
+def uris(count):
+    # Base URI and a (possibly relative) link from a page at that base
+    out = Output()
+    for _ in range(count):
+        host = rng.choice(HOSTS)
+        scheme = rng.choice(["gemini", "gemini", "gopher", "file"])
+        if scheme == "file":
+            base = "file://%s" % path()
+        else:
+            port = rng.choice(["", ":1965", ":70"])
+            base = "%s://%s%s%s" % (scheme, host, port, path())
+        link = rng.choice([
+            "gemini://%s%s" % (rng.choice(HOSTS), path()),
+            path(),
+            path().lstrip("/"),
+            "../" + path().lstrip("/"),
+            "./" + path().lstrip("/") + "?query%20string",
+            path() + "#fragment",
+            "//%s%s" % (rng.choice(HOSTS), path()),
+        ])
+        out.add("%s\t%s\n" % (base, link))
+    return out.text()
+
+def main():
+    outdir = sys.argv[1] if len(sys.argv) > 1 else "bench/corpus"
+    os.makedirs(outdir, exist_ok=True)
+    files = {
+        "doc.gmi": gemtext(256 * 1024),
+        "doc.gophermap": gophermap(128 * 1024),
+        "doc.txt": plaintext(256 * 1024),
+        "uris.txt": uris(2000),
+    }
+    for name, content in files.items():
+        with open(os.path.join(outdir, name), "w", newline="") as f:
+            f.write(content)
+
+main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+#
+# Generates utf8_width_table.h, the table of zero-width and wide (East Asian
+# wide/fullwidth) codepoint ranges used by utf8_width().  Uses the Unicode
+# database that ships with Python:
+#
+#   python3 tools/gen_utf8_width_table.py > utf8_width_table.h
+#
+import sys
+import unicodedata
+
+# Prepended concatenation marks are format characters, but are displayed
+PREPENDED_CONCATENATION_MARKS = {
+    0x0600, 0x0601, 0x0602, 0x0603, 0x0604, 0x0605, 0x06dd, 0x070f,
+    0x0890, 0x0891, 0x08e2, 0x110bd, 0x110cd,
+}
+
+def is_zero_width(cp):
+    c = chr(cp)
+    if cp == 0x00ad or cp in PREPENDED_CONCATENATION_MARKS:
+        # Soft hyphen (and the above) are displayed by terminals
+        return False
+    if 0x1160 <= cp <= 0x11ff or 0xd7b0 <= cp <= 0xd7ff:
+        # Hangul medial vowels/final consonants combine with the initial
+        return True
+    if cp == 0x200b:
+        return True
+    return unicodedata.category(c) in ('Mn', 'Me', 'Cf')
+
+def is_wide(cp):
+    # Circled numbers on black squares and the Yijing hexagram symbols are
+    # drawn wide by terminals, even though they aren't East Asian wide
+    if 0x3248 <= cp <= 0x324f or 0x4dc0 <= cp <= 0x4dff:
+        return True
+    return unicodedata.east_asian_width(chr(cp)) in ('W', 'F')
+
+def ranges(pred):
+    out = []
+    start = None
+    for cp in range(0x80, 0x110000):
+        if pred(cp):
+            if start is None: start = cp
+        elif start is not None:
+            out.append((start, cp - 1))
+            start = None
+    if start is not None:
+        out.append((start, 0x10ffff))
+    return out
+
+def emit(name, rs):
+    print('static const struct utf8_range %s[] =' % name)
+    print('{')
+    for i in range(0, len(rs), 3):
+        row = ', '.join('{ 0x%05x, 0x%05x }' % r for r in rs[i:i + 3])
+        print('    %s,' % row)
+    print('};')
+
+print('#ifndef UTF8_WIDTH_TABLE_H')
+print('#define UTF8_WIDTH_TABLE_H')
+print()
+print('/*')
+print(' * utf8_width_table.h')
+print(' *')
+print(' * Generated by tools/gen_utf8_width_table.py from Unicode %s; do not edit.'
+    % unicodedata.unidata_version)
+print(' * Ranges are sorted and non-overlapping so they can be binary searched')
+print(' */')
+print()
+print('struct utf8_range')
+print('{')
+print('    uint32_t first, last;')
+print('};')
+print()
+emit('UTF8_ZERO_WIDTH', ranges(is_zero_width))
+print()
+emit('UTF8_WIDE', ranges(is_wide))
+print()
+print('#endif')
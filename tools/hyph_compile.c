@@ -0,0 +1,422 @@
+/*
+ * hyph_compile.c
+ *
+ * Compiles the TeX-style hyphenation pattern files in hyphenation/ into the
+ * packed tries used by hyphenate_alg.c.  Run by the Makefile at build time:
+ *
+ *   tools/hyph_compile hyphenation/en-us.pat ... > hyphenate_patterns.h
+ *
+ * The language name of each set is taken from the file's basename.  Letters
+ * are stored as their (lowercase) Latin-1 codepoints, so only patterns in the
+ * Latin-1 range are supported for now.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest pattern/exception, in letters
+#define WORD_MAX 63
+
+struct node
+{
+    // Letter that leads to this node
+    uint8_t ch;
+
+    // Pattern values (depth + 1 of them), or -1 if no pattern ends here
+    int values;
+
+    // Children, kept sorted by letter
+    int *children;
+    int child_count;
+
+    // Index of first child in the packed output
+    int packed_child;
+};
+
+struct exception
+{
+    uint8_t word[WORD_MAX + 1];
+    uint64_t breaks;
+};
+
+static struct node *s_nodes;
+static int s_node_count, s_node_capacity;
+static uint8_t *s_values;
+static int s_value_count, s_value_capacity;
+static struct exception *s_exceptions;
+static int s_exception_count, s_exception_capacity;
+
+static void *
+xrealloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (!p)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    return p;
+}
+
+static int
+node_new(uint8_t ch)
+{
+    if (s_node_count >= s_node_capacity)
+    {
+        s_node_capacity = s_node_capacity ? s_node_capacity * 2 : 1024;
+        s_nodes = xrealloc(s_nodes, sizeof(struct node) * s_node_capacity);
+    }
+    s_nodes[s_node_count] = (struct node) { .ch = ch, .values = -1 };
+    return s_node_count++;
+}
+
+/* Get child of node with given letter, creating it if needed */
+static int
+node_child(int n, uint8_t ch)
+{
+    struct node *node = &s_nodes[n];
+    int i;
+    for (i = 0; i < node->child_count; ++i)
+    {
+        const uint8_t c = s_nodes[node->children[i]].ch;
+        if (c == ch) return node->children[i];
+        if (c > ch) break;
+    }
+
+    const int child = node_new(ch);
+    node = &s_nodes[n];
+    node->children = xrealloc(node->children,
+        sizeof(int) * (node->child_count + 1));
+    memmove(&node->children[i + 1], &node->children[i],
+        sizeof(int) * (node->child_count - i));
+    node->children[i] = child;
+    ++node->child_count;
+    return child;
+}
+
+/* Decode next UTF-8 codepoint into a lowercase Latin-1 letter */
+static int
+next_letter(const char **s, const char *file, int line)
+{
+    const uint8_t *c = (const uint8_t *)*s;
+    uint32_t cp;
+    if (c[0] < 0x80)
+    {
+        cp = tolower(c[0]);
+        *s += 1;
+    }
+    else if ((c[0] & 0xe0) == 0xc0 && (c[1] & 0xc0) == 0x80)
+    {
+        cp = ((c[0] & 0x1f) << 6) | (c[1] & 0x3f);
+        *s += 2;
+    }
+    else
+    {
+        cp = 0x100;
+    }
+
+    if (cp > 0xff)
+    {
+        fprintf(stderr, "%s:%d: letter outside Latin-1 range\n", file, line);
+        exit(-1);
+    }
+
+    // Latin-1 uppercase letters (except the multiplication sign)
+    if (cp >= 0xc0 && cp <= 0xde && cp != 0xd7) cp += 0x20;
+
+    return cp;
+}
+
+/* Add a pattern like "hy3ph" to the trie */
+static void
+add_pattern(const char *s, const char *file, int line)
+{
+    uint8_t values[WORD_MAX + 2] = { 0 };
+    int n = 0, letters = 0;
+
+    for (; *s; ++letters)
+    {
+        if (isdigit(*s)) values[letters] = *s++ - '0';
+        if (!*s) break;
+        if (letters >= WORD_MAX)
+        {
+            fprintf(stderr, "%s:%d: pattern too long\n", file, line);
+            exit(-1);
+        }
+        n = node_child(n, next_letter(&s, file, line));
+    }
+
+    if (s_nodes[n].values != -1)
+    {
+        fprintf(stderr, "%s:%d: duplicate pattern\n", file, line);
+        exit(-1);
+    }
+
+    if (s_value_count + letters + 1 > s_value_capacity)
+    {
+        s_value_capacity = (s_value_capacity + letters + 1) * 2;
+        s_values = xrealloc(s_values, s_value_capacity);
+    }
+    s_nodes[n].values = s_value_count;
+    memcpy(&s_values[s_value_count], values, letters + 1);
+    s_value_count += letters + 1;
+}
+
+/* Add an exception like "acad-e-mies" */
+static void
+add_exception(const char *s, const char *file, int line)
+{
+    struct exception e = { 0 };
+    int letters = 0;
+
+    while (*s)
+    {
+        if (*s == '-')
+        {
+            e.breaks |= (uint64_t)1 << letters;
+            ++s;
+            continue;
+        }
+        if (letters >= WORD_MAX)
+        {
+            fprintf(stderr, "%s:%d: exception too long\n", file, line);
+            exit(-1);
+        }
+        e.word[letters++] = next_letter(&s, file, line);
+    }
+
+    if (s_exception_count >= s_exception_capacity)
+    {
+        s_exception_capacity = s_exception_capacity
+            ? s_exception_capacity * 2 : 256;
+        s_exceptions = xrealloc(s_exceptions,
+            sizeof(struct exception) * s_exception_capacity);
+    }
+    s_exceptions[s_exception_count++] = e;
+}
+
+static int
+exception_cmp(const void *a, const void *b)
+{
+    return strcmp(
+        (const char *)((const struct exception *)a)->word,
+        (const char *)((const struct exception *)b)->word);
+}
+
+/* Print a Latin-1 string as a C string literal */
+static void
+print_string(const uint8_t *s)
+{
+    putchar('"');
+    for (; *s; ++s)
+    {
+        if (*s < 0x80 && isalpha(*s)) putchar(*s);
+        else printf("\\%03o", *s);
+    }
+    putchar('"');
+}
+
+/* Make a C identifier out of a language name, e.g. "en-us" -> "EN_US" */
+static void
+lang_ident(const char *name, char *ident)
+{
+    for (int c = 0; (ident[c] = name[c]); ++c)
+    {
+        ident[c] = isalnum(ident[c]) ? toupper(ident[c]) : '_';
+    }
+}
+
+/* Compile one pattern file and print its tables */
+static void
+compile(const char *path, char *name, int *leftmin, int *rightmin)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        perror(path);
+        exit(-1);
+    }
+
+    s_node_count = 0;
+    s_value_count = 0;
+    s_exception_count = 0;
+    node_new(0);
+
+    enum { NONE, PATTERNS, EXCEPTIONS } section = NONE;
+    char line[512];
+    for (int line_no = 1; fgets(line, sizeof(line), fp); ++line_no)
+    {
+        // Strip comments and trailing whitespace
+        line[strcspn(line, "%")] = '\0';
+        char *end = line + strlen(line);
+        for (; end > line && isspace(end[-1]); --end);
+        *end = '\0';
+
+        char *tok = line;
+        for (; isspace(*tok); ++tok);
+        if (!*tok) continue;
+
+        if (sscanf(tok, "\\lefthyphenmin=%d", leftmin) == 1 ||
+            sscanf(tok, "\\righthyphenmin=%d", rightmin) == 1)
+        {
+            continue;
+        }
+        if (strcmp(tok, "\\patterns{") == 0) section = PATTERNS;
+        else if (strcmp(tok, "\\hyphenation{") == 0) section = EXCEPTIONS;
+        else if (strcmp(tok, "}") == 0) section = NONE;
+        else if (section == PATTERNS) add_pattern(tok, path, line_no);
+        else if (section == EXCEPTIONS) add_exception(tok, path, line_no);
+        else
+        {
+            fprintf(stderr, "%s:%d: unexpected '%s'\n", path, line_no, tok);
+            exit(-1);
+        }
+    }
+    fclose(fp);
+
+    // Lay nodes out breadth-first, so each node's children are contiguous
+    int *order = xrealloc(NULL, sizeof(int) * s_node_count);
+    int order_count = 1;
+    order[0] = 0;
+    for (int i = 0; i < order_count; ++i)
+    {
+        struct node *node = &s_nodes[order[i]];
+        node->packed_child = order_count;
+        for (int c = 0; c < node->child_count; ++c)
+        {
+            order[order_count++] = node->children[c];
+        }
+    }
+
+    printf("static const struct hyph_node HYPH_%s_NODES[] =\n{\n", name);
+    for (int i = 0; i < order_count; ++i)
+    {
+        const struct node *node = &s_nodes[order[i]];
+        printf("    { %d, %d, %d, %d },\n",
+            node->child_count ? node->packed_child : 0,
+            node->values + 1,
+            node->child_count,
+            node->ch);
+    }
+    printf("};\n\n");
+
+    // Values are offset by one so that 0 can mean "no pattern"
+    printf("static const uint8_t HYPH_%s_VALUES[] =\n{\n    0,", name);
+    for (int i = 0; i < s_value_count; ++i)
+    {
+        printf(i % 24 == 0 ? "\n    %d," : " %d,", s_values[i]);
+    }
+    printf("\n};\n\n");
+
+    qsort(s_exceptions, s_exception_count, sizeof(struct exception),
+        exception_cmp);
+    printf("static const struct hyph_exception HYPH_%s_EXCEPTIONS[] =\n{\n",
+        name);
+    for (int i = 0; i < s_exception_count; ++i)
+    {
+        printf("    { ");
+        print_string(s_exceptions[i].word);
+        printf(", 0x%llxull },\n",
+            (unsigned long long)s_exceptions[i].breaks);
+    }
+    if (!s_exception_count) printf("    { \"\", 0 },\n");
+    printf("};\n\n");
+
+    for (int i = 0; i < s_node_count; ++i) free(s_nodes[i].children);
+    free(order);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s pattern-file...\n", argv[0]);
+        return 1;
+    }
+
+    printf(
+        "#ifndef HYPHENATE_PATTERNS_H\n"
+        "#define HYPHENATE_PATTERNS_H\n\n"
+        "/*\n"
+        " * hyphenate_patterns.h\n"
+        " *\n"
+        " * Generated by tools/hyph_compile from hyphenation/; do not edit.\n"
+        " */\n\n"
+        "struct hyph_node\n{\n"
+        "    // Index of first child; children are contiguous and sorted\n"
+        "    uint32_t child;\n"
+        "    // Offset of pattern values in the values table (0 if none)\n"
+        "    uint32_t values;\n"
+        "    uint8_t child_count;\n"
+        "    // Letter (lowercase Latin-1) that leads to this node\n"
+        "    uint8_t ch;\n"
+        "};\n\n"
+        "struct hyph_exception\n{\n"
+        "    // Word as lowercase Latin-1\n"
+        "    const char *word;\n"
+        "    // Bit n set if the word may be broken before letter n\n"
+        "    uint64_t breaks;\n"
+        "};\n\n"
+        "struct hyph_lang\n{\n"
+        "    const char *name;\n"
+        "    int leftmin, rightmin;\n"
+        "    const struct hyph_node *nodes;\n"
+        "    const uint8_t *values;\n"
+        "    const struct hyph_exception *exceptions;\n"
+        "    int exception_count;\n"
+        "};\n\n");
+
+    char (*names)[32] = xrealloc(NULL, sizeof(*names) * argc);
+    int *leftmin = xrealloc(NULL, sizeof(int) * argc),
+        *rightmin = xrealloc(NULL, sizeof(int) * argc),
+        *exception_count = xrealloc(NULL, sizeof(int) * argc);
+    for (int i = 1; i < argc; ++i)
+    {
+        // Language name from the file's basename
+        const char *base = strrchr(argv[i], '/');
+        base = base ? base + 1 : argv[i];
+        snprintf(names[i], sizeof(names[i]), "%.*s",
+            (int)strcspn(base, "."), base);
+
+        char ident[32];
+        lang_ident(names[i], ident);
+
+        leftmin[i] = 2;
+        rightmin[i] = 3;
+        compile(argv[i], ident, &leftmin[i], &rightmin[i]);
+        exception_count[i] = s_exception_count;
+    }
+
+    printf("static const struct hyph_lang HYPH_LANGS[] =\n{\n");
+    for (int i = 1; i < argc; ++i)
+    {
+        char ident[32];
+        lang_ident(names[i], ident);
+        printf(
+            "    {\n"
+            "        .name = \"%s\",\n"
+            "        .leftmin = %d,\n"
+            "        .rightmin = %d,\n"
+            "        .nodes = HYPH_%s_NODES,\n"
+            "        .values = HYPH_%s_VALUES,\n"
+            "        .exceptions = HYPH_%s_EXCEPTIONS,\n"
+            "        .exception_count = %d,\n"
+            "    },\n",
+            names[i], leftmin[i], rightmin[i],
+            ident, ident, ident, exception_count[i]);
+    }
+    printf("};\n\n#endif\n");
+
+    free(names);
+    free(leftmin);
+    free(rightmin);
+    free(exception_count);
+    free(s_nodes);
+    free(s_values);
+    free(s_exceptions);
+    return 0;
+}
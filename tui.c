@@ -1,8 +1,12 @@
 #include "pch.h"
 #include "cache.h"
+#include "cache_index.h"
+#include "event.h"
 #include "favourites.h"
 #include "local.h"
+#include "page_pool.h"
 #include "pager.h"
+#include "perf.h"
 #include "sighandle.h"
 #include "state.h"
 #include "status_line.h"
@@ -15,6 +19,9 @@ struct tui_state *g_tui;
 static struct termios termios_initial;
 extern void program_exited(void);
 
+static void tui_output_flush(bool);
+static void tui_input_ready(int, short, void *);
+
 void
 tui_init(void)
 {
@@ -53,12 +60,34 @@ tui_init(void)
 
     tui_input_init();
 
+    // Wait for input in the event loop
+    event_fd_add(STDIN_FILENO, POLLIN, tui_input_ready, NULL);
+
+    tui_resized();
+}
+
+/*
+ * Set up without a terminal, with a fixed size.  Pages can still be loaded
+ * and typeset as normal, but nothing is written out
+ */
+void
+tui_init_headless(int w, int h)
+{
+    g_tui = &g_state.tui;
+    g_tui->headless = true;
+    g_tui->w = w;
+    g_tui->h = h;
+
+    tui_input_init();
+
     tui_resized();
 }
 
 void
 tui_cleanup(void)
 {
+    if (g_tui->headless) return;
+
     // Cleanup alternate buffer
     tui_say("\x1b[2J");
 
@@ -68,41 +97,71 @@ tui_cleanup(void)
     // Show cursor again
     tui_say("\x1b[?25h");
 
+    tui_flush();
+
     // Restore initial state
     tcsetattr(STDOUT_FILENO, TCSANOW, &termios_initial);
+
+#if TUI_OUTPUT_STATS
+    const struct tui_output *const out = &g_tui->out;
+    fprintf(stderr,
+        "output: %lu frames, %lu write syscalls, %lu bytes in total; "
+        "last frame %d syscalls, %zu bytes\n",
+        out->frames, out->syscalls, out->bytes,
+        out->frame_syscalls, out->frame_bytes);
+#endif
+
+    free(g_tui->out.b);
+    g_tui->out = (struct tui_output) { 0 };
+    tui_screen_deinit(&g_tui->screen);
 }
 
 int
 tui_update(void)
 {
-    ssize_t read_n = 0;
-    for (char buf[16] = { 0 };
-        !g_tui->did_quit;
-        read_n = read(STDOUT_FILENO, &buf, sizeof(buf)))
-    {
-        if (read_n < 0 || *buf == '\0')
-        {
-            // We need this sleep or else the program pins a core to 100%
-            // usage...
-            usleep(1);
-            continue;
-        }
+    // Anything that was written outside of a frame
+    if (g_tui->out.len) tui_flush();
+
+    // Sleep until there's input (or anything else) to handle
+    event_wait();
+
+    return g_tui->did_quit ? -1 : 0;
+}
 
+/* Terminal input is ready to be read */
+static void
+tui_input_ready(int fd, short revents, void *data)
+{
+    (void)revents;
+    (void)data;
+
+    char in[16];
+    const ssize_t read_n = read(fd, in, sizeof(in));
+    if (read_n > 0)
+    {
         // Handle input
-        if (tui_input_handle(buf, read_n) == TUI_QUIT) return -1;
+        if (tui_input_handle(in, read_n) == TUI_QUIT) g_tui->did_quit = true;
+        return;
     }
 
-    return g_tui->did_quit ? -1 : 0;
+    // Terminal has gone away
+    if (read_n == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+        g_tui->did_quit = true;
+    }
 }
 
 void
 tui_resized(void)
 {
     // Get new window size
-    struct winsize ws;
-    ioctl(1, TIOCGWINSZ, &ws);
-    g_tui->w = ws.ws_col;
-    g_tui->h = ws.ws_row;
+    if (!g_tui->headless)
+    {
+        struct winsize ws;
+        ioctl(1, TIOCGWINSZ, &ws);
+        g_tui->w = ws.ws_col;
+        g_tui->h = ws.ws_row;
+    }
 
     pager_resized();
 
@@ -110,18 +169,56 @@ tui_resized(void)
     tui_repaint(true);
 }
 
+/* Resize once the window size has settled */
+static void
+tui_resize_timer(void *data)
+{
+    (void)data;
+
+    event_timer_cancel(tui_resize_timer, NULL);
+    event_timer_cancel(tui_resize_timer, &g_tui->resize_pending);
+    g_tui->resize_pending = false;
+
+    tui_resized();
+}
+
+/*
+ * Window was resized.  Resizes come in bursts while the window is dragged, so
+ * wait for the size to settle rather than typesetting the page for every one
+ */
+void
+tui_resize_requested(void)
+{
+    event_timer_set(TUI_RESIZE_SETTLE_MS, tui_resize_timer, NULL);
+
+    // Don't leave the old layout up forever if it never settles though
+    if (!g_tui->resize_pending)
+    {
+        event_timer_set(
+            TUI_RESIZE_MAX_DELAY_MS, tui_resize_timer, &g_tui->resize_pending);
+        g_tui->resize_pending = true;
+    }
+}
+
 /* Repaint entire screen */
 void
 tui_repaint(bool clear)
 {
+    tui_frame_begin();
+
     tui_cursor_move(0, 0);
 
     if (clear) tui_say("\x1b[2J");
 
+    // Everything is painted again
+    g_pager->scroll_painted = -1;
+
     pager_paint(true);
     status_line_paint();
 
     tui_input_prompt_redraw_full();
+
+    tui_frame_end();
 }
 
 void
@@ -129,6 +226,8 @@ tui_invalidate(enum tui_invalidate_flags flags)
 {
     if (!flags) return;
 
+    tui_frame_begin();
+
     int cursor_x_prev = g_tui->cursor_x,
         cursor_y_prev = g_tui->cursor_y;
 
@@ -146,6 +245,152 @@ tui_invalidate(enum tui_invalidate_flags flags)
 
     // This stops cursor flying off all over the place when in link mode
     tui_cursor_move(cursor_x_prev, cursor_y_prev);
+
+    tui_frame_end();
+}
+
+/* Begin buffering output for a frame; frames may be nested */
+void
+tui_frame_begin(void)
+{
+    if (g_tui->out.depth++ == 0) perf_begin(PERF_FRAME);
+}
+
+/* Finish a frame, flushing it if it's the outermost one */
+void
+tui_frame_end(void)
+{
+    struct tui_output *const out = &g_tui->out;
+
+    if (!out->depth || --out->depth) return;
+
+    if (out->len)
+    {
+        const unsigned long syscalls = out->syscalls, bytes = out->bytes;
+        tui_output_flush(TUI_SYNCHRONIZED_UPDATE);
+
+        out->frame_syscalls = out->syscalls - syscalls;
+        out->frame_bytes = out->bytes - bytes;
+        ++out->frames;
+        perf_record(PERF_FRAME_BYTES, out->frame_bytes);
+    }
+
+    perf_end(PERF_FRAME);
+}
+
+/* Write out everything that has been buffered */
+void
+tui_flush(void)
+{
+    tui_output_flush(false);
+}
+
+/*
+ * Write out the output buffer, optionally wrapped in synchronized update
+ * escapes, retrying on partial writes
+ */
+static void
+tui_output_flush(bool sync)
+{
+    struct tui_output *const out = &g_tui->out;
+    if (!out->len) return;
+
+#if TUI_SCREEN_DIFF
+    // Only send what has changed on the screen
+    struct tui_screen *const screen = &g_tui->screen;
+    tui_screen_render(screen, g_tui->w, g_tui->h, out->b, out->len);
+    out->len = 0;
+    char *const data = screen->out;
+    const size_t data_len = screen->out_len;
+    if (!data_len) return;
+#else
+    char *const data = out->b;
+    const size_t data_len = out->len;
+    out->len = 0;
+#endif
+
+    static const char
+        SYNC_BEGIN[] = "\x1b[?2026h",
+        SYNC_END[] = "\x1b[?2026l";
+
+    struct iovec iov_buf[3], *iov = iov_buf;
+    int iov_count = 0;
+    if (sync)
+    {
+        iov[iov_count++] = (struct iovec)
+        {
+            .iov_base = (void *)SYNC_BEGIN,
+            .iov_len = sizeof(SYNC_BEGIN) - 1
+        };
+    }
+    iov[iov_count++] = (struct iovec)
+    {
+        .iov_base = data,
+        .iov_len = data_len
+    };
+    if (sync)
+    {
+        iov[iov_count++] = (struct iovec)
+        {
+            .iov_base = (void *)SYNC_END,
+            .iov_len = sizeof(SYNC_END) - 1
+        };
+    }
+
+    while (iov_count)
+    {
+        const ssize_t n = writev(STDOUT_FILENO, iov, iov_count);
+        ++out->syscalls;
+
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+
+            // Terminal is not keeping up (stdout is non-blocking); wait
+            struct pollfd pfd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        out->bytes += n;
+
+        // Skip past whatever was written
+        size_t written = n;
+        for (;
+            iov_count && written >= iov->iov_len;
+            written -= iov->iov_len, ++iov, --iov_count);
+        if (iov_count)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/* Write text to the terminal (buffered if inside a frame) */
+int
+tui_write(const char *s, int n)
+{
+    struct tui_output *const out = &g_tui->out;
+    if (n <= 0) return 0;
+    if (g_tui->headless) return n;
+
+    if (out->len + n > out->capacity)
+    {
+        out->capacity = max(out->capacity * 2, out->len + n + 4096);
+        out->b = realloc(out->b, out->capacity);
+        if (!out->b)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+    }
+    memcpy(out->b + out->len, s, n);
+    out->len += n;
+
+    if (!out->depth) tui_flush();
+
+    return n;
 }
 
 void
@@ -229,8 +474,9 @@ tui_follow_selected_link(void)
 {
     if (!pager_has_link()) return;
 
+    struct uri uri;
     tui_go_to_uri(
-        &g_pager->links[g_pager->link_index].uri,
+        pager_link_uri(g_pager->link_index, &uri),
         true,
         false);
 }
@@ -254,9 +500,10 @@ tui_update_link_peek(void)
     }
 
     // Convert selected URI to a string
+    struct uri uri;
     char uri_name[URI_STRING_MAX];
     uri_str(
-        &g_pager->links[g_pager->link_index].uri,
+        pager_link_uri(g_pager->link_index, &uri),
         uri_name,
         g_tui->w,
         URI_FLAGS_NONE);
@@ -272,6 +519,28 @@ end:
     tui_invalidate(INVALIDATE_PAGER_SELECTED_BIT);
 }
 
+/*
+ * Set the search query from the input buffer.  It has usually been searched
+ * for already as it was typed, in which case the matches are kept
+ */
+static bool
+tui_search_set_query(void)
+{
+    struct search *const s = &g_pager->search;
+
+    search_incremental_end(true);
+
+    if (!g_in->buffer_len) return false;
+    if (s->query_len == g_in->buffer_len &&
+        strncmp(s->query, g_in->buffer, s->query_len) == 0) return true;
+
+    s->query_len = g_in->buffer_len;
+    strncpy(s->query, g_in->buffer, sizeof(s->query));
+    s->query[s->query_len] = '\0';
+    s->invalidated = true;
+    return true;
+}
+
 /* Begin search in forward direction using input buffer text */
 void
 tui_search_start_forward(void)
@@ -279,12 +548,9 @@ tui_search_start_forward(void)
     struct search *const s = &g_pager->search;
     s->reverse = false;
 
-    s->query_len = g_in->buffer_len;
-    if (!s->query_len) return;
-    strncpy(s->query, g_in->buffer, sizeof(s->query));
-    s->query[s->query_len] = '\0';
+    if (!tui_search_set_query()) return;
 
-    search_perform();
+    if (s->invalidated) search_perform();
     search_next();
 }
 
@@ -295,13 +561,10 @@ tui_search_start_reverse(void)
     struct search *const s = &g_pager->search;
     s->reverse = true;
 
-    s->query_len = g_in->buffer_len;
-    if (!s->query_len) return;
-    strncpy(s->query, g_in->buffer, sizeof(s->query));
-    s->query[s->query_len] = '\0';
+    if (!tui_search_set_query()) return;
 
-    search_perform();
-    s->index = max(s->match_count - 1, 0);
+    if (s->invalidated) search_perform();
+    s->index = max((int)s->match_count - 1, 0);
     search_prev();
 }
 
@@ -359,7 +622,9 @@ tui_refresh_page(void)
     unsigned old_hash_len = 0;
 
     if (g_pager->cached_page &&
-        uri_cmp_notrailing(&g_pager->cached_page->uri, &g_state.uri) == 0)
+        uri_packed_cmp_notrailing(&g_pager->cached_page->uri,
+            &g_pager->cached_page->uri_strings,
+            &g_state.uri, uri_hash(&g_state.uri)) == 0)
     {
         old_hash_len = g_pager->cached_page->hash_len;
         memcpy(old_hash, g_pager->cached_page->hash, old_hash_len);
@@ -447,8 +712,9 @@ tui_favourite_delete_selected(void)
 {
     if (!pager_has_link()) return;
 
+    struct uri uri;
     struct fav_node *n =
-        favourites_find(&g_pager->links[g_pager->link_index].uri);
+        favourites_find(pager_link_uri(g_pager->link_index, &uri));
     if (!n) return;
 
     favourites_delete(n);
@@ -468,8 +734,9 @@ tui_favourite_title_edited(void)
 {
     if (!pager_has_link()) return;
 
+    struct uri uri;
     struct fav_node *n =
-        favourites_find(&g_pager->links[g_pager->link_index].uri);
+        favourites_find(pager_link_uri(g_pager->link_index, &uri));
     if (!n) return;
 
     favourites_update_title(n, g_in->buffer, g_in->buffer_len);
@@ -495,6 +762,16 @@ tui_favourite_push(void)
     tui_status_end();
 }
 
+/* Remember the selection/scroll of the page being left, if it's cached */
+static void
+tui_save_cached_session(void)
+{
+    if (!g_pager->cached_page) return;
+
+    g_pager->cached_page->session.last_sel = g_pager->link_index;
+    g_pager->cached_page->session.last_scroll = g_pager->scroll;
+}
+
 /* Goto a site */
 int
 tui_go_to_uri(
@@ -537,10 +814,38 @@ tui_go_to_uri(
         return -1;
     }
 
+    // Pages that were left recently are still typeset, so can be shown again
+    // as they were without loading or typesetting anything
+    if (!force_nocache && page_pool_has(uri_in))
+    {
+        tui_input_prompt_end(g_in->mode);
+        tui_save_cached_session();
+
+        page_pool_swap(uri_in);
+
+        if (push_hist)
+        {
+            history_push(&g_state.uri);
+        }
+
+        // The window may have been resized since the page was left
+        pager_resized();
+        tui_repaint(false);
+
+        tui_status_begin();
+        tui_printf("Restored page, ");
+        tui_print_size(g_recv->size);
+        tui_status_end();
+        return 0;
+    }
+
     int success;
     bool do_cache = false;
     struct cached_item *cache_item = NULL;
 
+    // The page being left stays intact while the new one is loaded
+    page_pool_load_begin();
+
     // Handle protocol/requests
     switch (uri.protocol)
     {
@@ -549,9 +854,11 @@ tui_go_to_uri(
         bool from_cache = !force_nocache && cache_find(uri_in, &cache_item);
         if (!from_cache)
         {
+            perf_begin(PERF_FETCH);
             success = uri.protocol == PROTOCOL_GEMINI
                 ? gemini_request(&uri)
                 : gopher_request(&uri);
+            perf_end(PERF_FETCH);
         }
         else
         {
@@ -633,6 +940,18 @@ tui_go_to_uri(
             // Load favourites page
             success = favourites_display();
         }
+        else if (strncmp(uri_in->hostname,
+            URI_INTERNAL_PERF_RAW, URI_HOSTNAME_MAX) == 0)
+        {
+            // Load performance counters page
+            success = perf_display();
+        }
+        else if (strncmp(uri_in->hostname,
+            URI_INTERNAL_SEARCH_RAW, URI_HOSTNAME_MAX) == 0)
+        {
+            // Load search results of the disk cache
+            success = cache_index_display(uri_in->query);
+        }
         else
         {
             success = -1;
@@ -648,16 +967,17 @@ tui_go_to_uri(
         break;
     }
 
+    page_pool_load_end(success == 0);
+
     if (success == 0)
     {
         tui_input_prompt_end(g_in->mode);
 
         // Update the last selection/scroll of last cached page
-        if (g_pager->cached_page)
-        {
-            g_pager->cached_page->session.last_sel = g_pager->link_index;
-            g_pager->cached_page->session.last_scroll = g_pager->scroll;
-        }
+        tui_save_cached_session();
+
+        // Keep the page being left for going back to it
+        page_pool_push_current();
 
         // Update current URI state
         memcpy(&g_state.uri, uri_in, sizeof(struct uri));
@@ -2,6 +2,7 @@
 #define TUI_H
 
 #include "tui_input.h"
+#include "tui_screen.h"
 
 struct uri;
 
@@ -26,6 +27,26 @@ enum tui_invalidate_flags
     INVALIDATE_STATUS_LINE_BIT = 4,
 };
 
+/*
+ * Output is buffered for each "frame" (e.g. a repaint) and flushed to the
+ * terminal in one go at the end of it, rather than a write per escape code
+ */
+struct tui_output
+{
+    char *b;
+    size_t len, capacity;
+
+    // Nesting depth of tui_frame_begin/tui_frame_end
+    int depth;
+
+    // Write syscalls and bytes used to flush the last frame
+    int frame_syscalls;
+    size_t frame_bytes;
+
+    // Totals since startup
+    unsigned long frames, syscalls, bytes;
+};
+
 struct tui_state
 {
     // Terminal width/height
@@ -37,19 +58,37 @@ struct tui_state
     // Input handler
     struct tui_input in;
 
+    // Output buffer
+    struct tui_output out;
+
+    // What's on the terminal
+    struct tui_screen screen;
+
     bool in_prompt;
 
+    // Whether a resize is waiting for the window size to settle
+    bool resize_pending;
+
     bool did_quit;
+
+    // Not attached to a terminal (--render); output is discarded
+    bool headless;
 };
 
 extern struct tui_state *g_tui;
 
 void tui_init(void);
+void tui_init_headless(int, int);
 void tui_cleanup(void);
 int  tui_update(void);
 void tui_resized(void);
+void tui_resize_requested(void);
 void tui_repaint(bool);
 void tui_invalidate(enum tui_invalidate_flags);
+void tui_frame_begin(void);
+void tui_frame_end(void);
+void tui_flush(void);
+int tui_write(const char *, int);
 int tui_go_to_uri(const struct uri *const, bool, bool);
 
 void tui_quit(void);
@@ -93,7 +132,7 @@ do \
         size = utf8_size_w_formats((x), l); \
         if (size < 1) break;\
     } \
-    l = write(STDOUT_FILENO, (x), size); \
+    l = tui_write((x), size); \
     if (g_tui->is_writing_status) \
         g_tui->cursor_x += utf8_width((x), l); \
 } while(0)
@@ -124,7 +163,7 @@ do \
         count = utf8_size_w_formats(buf, l); \
         if (count < 1) break; \
     } \
-    l = write(STDOUT_FILENO, buf, count); \
+    l = tui_write(buf, count); \
     if (g_tui->is_writing_status) \
         g_tui->cursor_x += utf8_width(buf, l); \
 } while(0)
@@ -152,6 +191,7 @@ tui_status_clear(void)
 static inline void
 tui_status_begin(void)
 {
+    tui_frame_begin();
     tui_status_clear();
     tui_cursor_move(0, g_tui->h);
     g_tui->is_writing_status = true;
@@ -161,6 +201,7 @@ tui_status_begin(void)
 static inline void
 tui_status_begin_soft(void)
 {
+    tui_frame_begin();
     g_tui->is_writing_status = true;
 }
 
@@ -169,6 +210,7 @@ static inline void
 tui_status_end(void)
 {
     g_tui->is_writing_status = false;
+    tui_frame_end();
 }
 
 #endif
@@ -1,7 +1,11 @@
 #include "pch.h"
 #include "favourites.h"
+#include "link_picker.h"
+#include "outline.h"
 #include "pager.h"
+#include "search.h"
 #include "state.h"
+#include "tabs.h"
 #include "tui.h"
 #include "tui_input.h"
 #include "tui_input_prompt.h"
@@ -15,6 +19,9 @@ struct tui_input *g_in;
 
 static enum tui_status tui_input_normal(const char *, const ssize_t);
 static enum tui_status tui_input_links(const char *, const ssize_t);
+static enum tui_status tui_input_search(const char *, const ssize_t);
+static enum tui_status tui_input_outline(const char *, const ssize_t);
+static enum tui_status tui_input_link_picker(const char *, const ssize_t);
 
 // Input handler list
 static const struct tui_input_handler
@@ -31,9 +38,11 @@ static const struct tui_input_handler
     [TUI_MODE_LINKS]         = { tui_input_links              },
     [TUI_MODE_MARK_SET]      = { tui_input_prompt_register    },
     [TUI_MODE_MARK_FOLLOW]   = { tui_input_prompt_register    },
-    [TUI_MODE_SEARCH]        = { tui_input_prompt_text        },
+    [TUI_MODE_SEARCH]        = { tui_input_search             },
     [TUI_MODE_YES_NO]        = { tui_input_prompt_yesno       },
     [TUI_MODE_YES_NO_CANCEL] = { tui_input_prompt_yesnocancel },
+    [TUI_MODE_OUTLINE]       = { tui_input_outline            },
+    [TUI_MODE_LINK_PICKER]   = { tui_input_link_picker        },
 };
 
 /* Special flags for movement functions */
@@ -148,6 +157,13 @@ tui_input_common(const char *buf, const ssize_t buf_len)
     // First handle escape inputs, which are multi-byte
     if (buf_len > 1)
     {
+        // Shift+Tab to go to the previous tab
+        if (buf_len == 3 && strncmp(buf, "\x1b[Z", 3) == 0)
+        {
+            tabs_switch(-1);
+            return TUI_OK;
+        }
+
         // Check if any escapes match this
         for (m.x = MOVEMENT_ESCAPES;
             m.x->esc;
@@ -230,7 +246,8 @@ tui_input_common(const char *buf, const ssize_t buf_len)
             tui_status_say("Already at oldest page");
             return TUI_OK;
         }
-        tui_go_to_uri(&item->uri, false, false);
+        struct uri uri;
+        tui_go_to_uri(history_item_uri(item, &uri), false, false);
     } return TUI_OK;
 
     // ';' history forward
@@ -243,7 +260,8 @@ tui_input_common(const char *buf, const ssize_t buf_len)
             tui_status_say("Already at latest page");
             return TUI_OK;
         }
-        tui_go_to_uri(&item->uri, false, false);
+        struct uri uri;
+        tui_go_to_uri(history_item_uri(item, &uri), false, false);
     } return TUI_OK;
 
     // 'm' mark set mode and apostrophe for mark follow
@@ -264,6 +282,7 @@ tui_input_common(const char *buf, const ssize_t buf_len)
 
     // '/' or '?' to enter search mode (latter for reverse)
     case '/':
+        search_incremental_begin(false);
         tui_input_prompt_begin(
             TUI_MODE_SEARCH,
             "/", 0,
@@ -271,6 +290,7 @@ tui_input_common(const char *buf, const ssize_t buf_len)
             tui_search_start_forward);
         return TUI_OK;
     case '?':
+        search_incremental_begin(true);
         tui_input_prompt_begin(
             TUI_MODE_SEARCH,
             "?", 0,
@@ -299,6 +319,62 @@ tui_input_common(const char *buf, const ssize_t buf_len)
         tui_go_to_uri(&uri, true, true);
     } return TUI_OK;
 
+    /* P to view performance counters */
+    case 'P':
+    {
+        struct uri uri = uri_parse(
+            URI_INTERNAL_PERF,
+            strlen(URI_INTERNAL_PERF));
+        tui_go_to_uri(&uri, true, true);
+    } return TUI_OK;
+
+    /* O to view the outline (table of contents) of the page */
+    case 'O':
+        outline_open();
+        return TUI_OK;
+
+    /* L to find a link by (part of) its label or URI */
+    case 'L':
+        link_picker_open();
+        return TUI_OK;
+
+    /* C to search the cached pages */
+    case 'C':
+    {
+        struct uri uri = uri_parse(
+            URI_INTERNAL_SEARCH,
+            strlen(URI_INTERNAL_SEARCH));
+        tui_go_to_uri(&uri, true, true);
+    } return TUI_OK;
+
+    /* Tab to go to the next tab */
+    case '\t':
+        tabs_switch(1);
+        return TUI_OK;
+
+    /* t to open a new tab (with the favourites page) */
+    case 't':
+    {
+        struct uri uri = uri_parse(
+            URI_INTERNAL_FAVOURITES,
+            strlen(URI_INTERNAL_FAVOURITES));
+        tabs_open(&uri);
+    } return TUI_OK;
+
+    /* T to open the selected link (or this page) in a new tab */
+    case 'T':
+    {
+        struct uri uri;
+        tabs_open(pager_has_link()
+            ? pager_link_uri(g_pager->link_index, &uri)
+            : &g_state.uri);
+    } return TUI_OK;
+
+    /* Ctrl+W to close the tab */
+    case (0100 ^ 'W'):
+        tabs_close();
+        return TUI_OK;
+
     /* F to toggle favourite */
     case 'F':
     {
@@ -388,7 +464,7 @@ tui_input_normal(const char *buf, const ssize_t buf_len)
     case 'e':
     {
         // Get URI to edit
-        struct uri *uri;
+        struct uri *uri, link_uri;
         if (!pager_has_link())
         {
             // Use current page URI
@@ -397,7 +473,7 @@ tui_input_normal(const char *buf, const ssize_t buf_len)
         else
         {
             // Use selected link URI
-            uri = &g_pager->links[g_pager->link_index].uri;
+            uri = pager_link_uri(g_pager->link_index, &link_uri);
         }
 
         char uristr[URI_STRING_MAX];
@@ -431,7 +507,8 @@ tui_input_normal(const char *buf, const ssize_t buf_len)
     case INCHAR_LINK_NEXT_ALT:
     case INCHAR_LINK_PREV_ALT:
         // Skip if no links in the page
-        if (!g_pager->link_count) return TUI_OK;
+        if (!g_pager->link_count &&
+            typeset_is_done(&g_pager->typeset)) return TUI_OK;
 
         bool is_digit =
             *buf != INCHAR_LINK_NEXT     && *buf != INCHAR_LINK_PREV &&
@@ -518,13 +595,13 @@ tui_input_links(const char *buf, const ssize_t buf_len)
     // 'e' to edit selected URI
     case 'e':
     {
-        struct uri *uri;
+        struct uri *uri, link_uri;
         if (!pager_has_link())
         {
             // No selected link
             return TUI_OK;
         }
-        uri = &g_pager->links[g_pager->link_index].uri;
+        uri = pager_link_uri(g_pager->link_index, &link_uri);
 
         char uristr[URI_STRING_MAX];
         uri_str(uri, uristr, sizeof(uristr), 0);
@@ -570,6 +647,12 @@ tui_input_links(const char *buf, const ssize_t buf_len)
     int sel;
     if (g_in->buffer_len)
     {
+        // Link may be further down in a partially-typeset document
+        sel = atoi(g_in->buffer);
+        while (sel >= g_pager->typeset.links_typeset &&
+            sel < g_pager->link_count &&
+            typeset_block(&g_pager->typeset, &g_pager->buffer));
+
         if ((sel = atoi(g_in->buffer)) < 0 ||
             sel >= g_pager->link_count)
         {
@@ -590,3 +673,134 @@ no_digit:
 
     return status;
 }
+
+// Handle search prompt input; the query is searched for as it's typed
+static enum tui_status
+tui_input_search(const char *buf, const ssize_t buf_len)
+{
+    const enum tui_status status = tui_input_prompt_text(buf, buf_len);
+
+    if (g_in->mode == TUI_MODE_SEARCH)
+    {
+        search_incremental(g_in->buffer, g_in->buffer_len);
+    }
+    else if (!g_in->buffer_len)
+    {
+        // Cancelled
+        search_incremental_end(false);
+    }
+
+    return status;
+}
+
+// Handle input while the outline is open
+static enum tui_status
+tui_input_outline(const char *buf, const ssize_t buf_len)
+{
+    // Escapes other than Esc itself aren't used here
+    if (buf_len > 1) return TUI_OK;
+
+    const int count = g_pager->typeset.heading_count;
+    switch (*buf)
+    {
+    /* j/k (Ctrl+N/Ctrl+P) to select the next/previous heading */
+    case 'j':
+    case (0100 ^ 'N'):
+        outline_move(1);
+        break;
+    case 'k':
+    case (0100 ^ 'P'):
+        outline_move(-1);
+        break;
+
+    /* d/u (Space) for half a page down/up */
+    case 'd':
+    case ' ':
+        outline_move(g_tui->h / 2);
+        break;
+    case 'u':
+        outline_move(-g_tui->h / 2);
+        break;
+
+    /* g/G for first/last heading */
+    case 'g': outline_move(-count); break;
+    case 'G': outline_move(count); break;
+
+    /* Enter or l to go to the heading */
+    case '\n':
+    case 'l':
+        outline_follow();
+        break;
+
+    /* Esc, q or O to close */
+    case '\x1b':
+    case 'q':
+    case 'O':
+        outline_close();
+        break;
+
+    default: break;
+    }
+
+    return TUI_OK;
+}
+
+// Handle link picker prompt input; the links are matched as it's typed
+static enum tui_status
+tui_input_link_picker(const char *buf, const ssize_t buf_len)
+{
+    if (buf_len == 1)
+    {
+        switch (*buf)
+        {
+        /* Ctrl+N/Ctrl+P to select the next/previous link in the list */
+        case (0100 ^ 'N'):
+            link_picker_move(1);
+            return TUI_OK;
+        case (0100 ^ 'P'):
+            link_picker_move(-1);
+            return TUI_OK;
+
+        /* Ret to pick the selected link, and prompt to follow it */
+        case '\n':
+        {
+            const bool chosen = link_picker_close(true);
+            tui_input_prompt_end(TUI_MODE_LINK_PICKER);
+            tui_invalidate(INVALIDATE_ALL);
+            if (!chosen) return TUI_OK;
+
+            char index[16];
+            snprintf(index, sizeof(index), "%d", g_pager->link_index);
+            tui_input_prompt_begin(
+                TUI_MODE_LINKS,
+                "follow link: ", 0,
+                index,
+                NULL);
+            tui_update_link_peek();
+        } return TUI_OK;
+
+        /* Esc to cancel */
+        case '\x1b':
+            link_picker_close(false);
+            break;
+
+        default: break;
+        }
+    }
+
+    const enum tui_status status = tui_input_prompt_text(buf, buf_len);
+
+    if (g_in->mode == TUI_MODE_LINK_PICKER)
+    {
+        link_picker_update(g_in->buffer, g_in->buffer_len);
+    }
+    else
+    {
+        // Cancelled
+        tui_status_begin();
+        tui_status_end();
+        tui_invalidate(INVALIDATE_ALL);
+    }
+
+    return status;
+}
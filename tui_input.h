@@ -54,6 +54,12 @@ enum tui_input_mode
     // Prompt: yes/no/cancel question (e.g. favourite toggle)
     TUI_MODE_YES_NO_CANCEL,
 
+    // Table of contents of the page, drawn over the pager
+    TUI_MODE_OUTLINE,
+
+    // Prompt: fuzzy finding a link, with the matches drawn over the pager
+    TUI_MODE_LINK_PICKER,
+
     TUI_MODE_COUNT
 };
 
@@ -0,0 +1,749 @@
+#include "pch.h"
+#include "tui_screen.h"
+
+enum tui_screen_parse_state
+{
+    PARSE_GROUND = 0,
+    PARSE_UTF8,
+    PARSE_ESC,
+    PARSE_CSI,
+    PARSE_OSC,
+    PARSE_OSC_ESC,
+};
+
+// Unchanged cells between two changed runs that are sent anyway, rather than
+// moving the cursor past them
+#define TUI_SCREEN_RUN_GAP 6
+
+// Changed rows needed before we look for scrolled content
+#define TUI_SCREEN_SCROLL_MIN_ROWS 3
+
+static const struct tui_cell CELL_BLANK = { .s = " ", .len = 1 };
+
+static void tui_screen_resize(struct tui_screen *, int, int);
+static void tui_screen_interpret(struct tui_screen *, const char *, size_t);
+static void tui_screen_diff(struct tui_screen *);
+static void tui_screen_scroll(struct tui_screen *, int, int, int);
+
+/* Free the screen buffers */
+void
+tui_screen_deinit(struct tui_screen *s)
+{
+    free(s->back);
+    free(s->front);
+    free(s->out);
+    *s = (struct tui_screen) { 0 };
+}
+
+/*
+ * Interpret output that was written for a frame, and leave the minimal output
+ * needed to update the terminal to match in the out buffer
+ */
+void
+tui_screen_render(struct tui_screen *s, int w, int h, const char *b, size_t n)
+{
+    s->out_len = 0;
+
+    if (s->w != w || s->h != h) tui_screen_resize(s, w, h);
+
+    tui_screen_interpret(s, b, n);
+    tui_screen_diff(s);
+}
+
+/* Append to output */
+static void
+out_append(struct tui_screen *s, const char *b, size_t n)
+{
+    if (s->out_len + n > s->out_capacity)
+    {
+        s->out_capacity = max(s->out_capacity * 2, s->out_len + n + 4096);
+        s->out = realloc(s->out, s->out_capacity);
+        if (!s->out)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+    }
+    memcpy(s->out + s->out_len, b, n);
+    s->out_len += n;
+}
+
+#define out_printf(s, ...) \
+do \
+{ \
+    char tmp[64]; \
+    const int count = snprintf(tmp, sizeof(tmp), __VA_ARGS__); \
+    out_append((s), tmp, min(count, (int)sizeof(tmp) - 1)); \
+} while(0)
+
+static inline bool
+pen_eq(const struct tui_pen *a, const struct tui_pen *b)
+{
+    return a->attr == b->attr && a->fg == b->fg && a->bg == b->bg;
+}
+
+static inline bool
+cell_eq(const struct tui_cell *a, const struct tui_cell *b)
+{
+    return a->len == b->len &&
+        pen_eq(&a->pen, &b->pen) &&
+        memcmp(a->s, b->s, a->len) == 0;
+}
+
+static inline bool
+cell_is_blank(const struct tui_cell *c)
+{
+    return cell_eq(c, &CELL_BLANK);
+}
+
+static void
+tui_screen_resize(struct tui_screen *s, int w, int h)
+{
+    s->w = max(w, 0);
+    s->h = max(h, 0);
+
+    const size_t count = (size_t)s->w * s->h;
+    free(s->back);
+    free(s->front);
+    s->back = malloc(max(count, 1) * sizeof(struct tui_cell));
+    s->front = malloc(max(count, 1) * sizeof(struct tui_cell));
+    if (!s->back || !s->front)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    for (size_t i = 0; i < count; ++i) s->back[i] = s->front[i] = CELL_BLANK;
+
+    // Whatever is on the terminal now has probably been reflowed
+    s->clear = true;
+    s->x = min(s->x, max(s->w - 1, 0));
+    s->y = min(s->y, max(s->h - 1, 0));
+    s->wrap_pending = false;
+}
+
+/* Fill a range of cells (within a row) with blanks in the current colour */
+static void
+tui_screen_erase(struct tui_screen *s, int y, int x0, int x1)
+{
+    struct tui_cell blank = CELL_BLANK;
+    blank.pen.bg = s->pen.bg;
+
+    struct tui_cell *row = &s->back[y * s->w];
+    for (int x = max(x0, 0); x < min(x1, s->w); ++x) row[x] = blank;
+
+    // Don't leave half of a wide character behind
+    if (x1 < s->w && row[x1].len == 0) row[x1] = blank;
+}
+
+/* Put a character at the cursor */
+static void
+tui_screen_put(struct tui_screen *s, const char *c, int len)
+{
+    if (!s->w || !s->h) return;
+
+    const int width =
+        (len == 1 && (uint8_t)*c < 0x80) ? 1 : (int)utf8_width(c, len);
+
+    // Combining characters are added to the previous cell
+    if (width == 0)
+    {
+        int x = s->wrap_pending ? s->x : s->x - 1;
+        if (x < 0 || s->y >= s->h) return;
+        struct tui_cell *cell = &s->back[s->y * s->w + x];
+        if (cell->len == 0 && x > 0) --cell;
+        if (cell->len + len <= TUI_CELL_BYTES)
+        {
+            memcpy(cell->s + cell->len, c, len);
+            cell->len += len;
+        }
+        return;
+    }
+
+    if (s->wrap_pending || s->x + width > s->w)
+    {
+        // Terminal would wrap to the next line
+        if (!s->wrap_pending) tui_screen_erase(s, s->y, s->x, s->w);
+        s->x = 0;
+        ++s->y;
+        s->wrap_pending = false;
+    }
+    if (s->y >= s->h || width > s->w) return;
+
+    struct tui_cell *const row = &s->back[s->y * s->w];
+
+    // Overwriting half of a wide character clears the other half
+    if (row[s->x].len == 0 && s->x > 0) row[s->x - 1] = CELL_BLANK;
+    if (s->x + width < s->w && row[s->x + width].len == 0)
+    {
+        row[s->x + width] = CELL_BLANK;
+    }
+
+    struct tui_cell *cell = &row[s->x];
+    memset(cell, 0, sizeof(*cell));
+    memcpy(cell->s, c, min(len, TUI_CELL_BYTES));
+    cell->len = min(len, TUI_CELL_BYTES);
+    cell->pen = s->pen;
+    if (width == 2)
+    {
+        cell[1] = (struct tui_cell) { .len = 0, .pen = s->pen };
+    }
+
+    s->x += width;
+    if (s->x >= s->w)
+    {
+        s->x = s->w - 1;
+        s->wrap_pending = true;
+    }
+}
+
+/* Parse numeric parameters of a CSI sequence */
+static int
+csi_params(const char *seq, int len, int *params, int max_params)
+{
+    int count = 0;
+    params[0] = 0;
+    for (int i = 0; i < len; ++i)
+    {
+        if (seq[i] >= '0' && seq[i] <= '9')
+        {
+            params[count] = params[count] * 10 + (seq[i] - '0');
+        }
+        else if ((seq[i] == ';' || seq[i] == ':') && count + 1 < max_params)
+        {
+            params[++count] = 0;
+        }
+    }
+    return count + 1;
+}
+
+/* Apply an SGR (colour/attribute) sequence to the pen */
+static void
+tui_screen_sgr(struct tui_screen *s, const int *p, int count)
+{
+    static const uint8_t ATTRS[10] =
+    {
+        [1] = TUI_ATTR_BOLD_BIT,
+        [2] = TUI_ATTR_DIM_BIT,
+        [3] = TUI_ATTR_ITALIC_BIT,
+        [4] = TUI_ATTR_UNDERLINE_BIT,
+        [5] = TUI_ATTR_BLINK_BIT,
+        [7] = TUI_ATTR_REVERSE_BIT,
+        [8] = TUI_ATTR_HIDDEN_BIT,
+        [9] = TUI_ATTR_STRIKE_BIT,
+    };
+
+    struct tui_pen *const pen = &s->pen;
+    for (int i = 0; i < count; ++i)
+    {
+        const int v = p[i];
+        if (v == 0) *pen = (struct tui_pen) { 0 };
+        else if (v < 10) pen->attr |= ATTRS[v];
+        else if (v == 22)
+        {
+            pen->attr &= ~(TUI_ATTR_BOLD_BIT | TUI_ATTR_DIM_BIT);
+        }
+        else if (v > 22 && v < 30) pen->attr &= ~ATTRS[v - 20];
+        else if (v >= 30 && v <= 37) pen->fg = TUI_COLOUR_INDEX(v - 30);
+        else if (v == 39) pen->fg = 0;
+        else if (v >= 40 && v <= 47) pen->bg = TUI_COLOUR_INDEX(v - 40);
+        else if (v == 49) pen->bg = 0;
+        else if (v >= 90 && v <= 97) pen->fg = TUI_COLOUR_INDEX(v - 90 + 8);
+        else if (v >= 100 && v <= 107)
+        {
+            pen->bg = TUI_COLOUR_INDEX(v - 100 + 8);
+        }
+        else if ((v == 38 || v == 48) && i + 2 < count && p[i + 1] == 5)
+        {
+            *(v == 38 ? &pen->fg : &pen->bg) =
+                TUI_COLOUR_INDEX(p[i + 2] & 0xff);
+            i += 2;
+        }
+        else if ((v == 38 || v == 48) && i + 4 < count && p[i + 1] == 2)
+        {
+            *(v == 38 ? &pen->fg : &pen->bg) = TUI_COLOUR_RGB(
+                p[i + 2] & 0xff, p[i + 3] & 0xff, p[i + 4] & 0xff);
+            i += 4;
+        }
+    }
+}
+
+/* Handle a complete CSI sequence */
+static void
+tui_screen_csi(struct tui_screen *s, char final)
+{
+    const char *seq = s->seq;
+    int len = s->seq_len;
+
+    // Private modes (alternate screen, cursor visibility, etc.) are passed
+    // straight through, once everything before them has been drawn
+    if (len && seq[0] == '?')
+    {
+        tui_screen_diff(s);
+        out_append(s, "\x1b[", 2);
+        out_append(s, seq, len);
+        out_append(s, &final, 1);
+
+        int params[4];
+        const int count = csi_params(seq + 1, len - 1, params, 4);
+        for (int i = 0; i < count; ++i)
+        {
+            if (params[i] == 25) s->cursor_visible = final == 'h';
+
+            // Alternate screen is clear when entered; and we don't care what
+            // is on the normal one
+            if (params[i] == 1049 || params[i] == 47 || params[i] == 1047)
+            {
+                for (int c = 0; c < s->w * s->h; ++c)
+                {
+                    s->back[c] = s->front[c] = CELL_BLANK;
+                }
+                s->term_x = s->term_y = -1;
+            }
+        }
+        return;
+    }
+
+    int p[16];
+    const int count = csi_params(seq, len, p, 16);
+    switch (final)
+    {
+    case 'H':
+    case 'f':
+        s->y = min(max(p[0], 1), max(s->h, 1)) - 1;
+        s->x = min(max(count > 1 ? p[1] : 1, 1), max(s->w, 1)) - 1;
+        s->wrap_pending = false;
+        break;
+    case 'm':
+        tui_screen_sgr(s, p, count);
+        break;
+    case 'K':
+        if (s->y >= s->h) break;
+        if (p[0] == 0) tui_screen_erase(s, s->y, s->x, s->w);
+        else if (p[0] == 1) tui_screen_erase(s, s->y, 0, s->x + 1);
+        else if (p[0] == 2) tui_screen_erase(s, s->y, 0, s->w);
+        break;
+    case 'J':
+        if (p[0] == 2 || p[0] == 3)
+        {
+            // Faster to clear the terminal too than to send all the blanks
+            for (int y = 0; y < s->h; ++y) tui_screen_erase(s, y, 0, s->w);
+            s->clear = true;
+            break;
+        }
+        for (int y = 0; y < s->h; ++y)
+        {
+            if (p[0] == 0 && y > s->y) tui_screen_erase(s, y, 0, s->w);
+            if (p[0] == 1 && y < s->y) tui_screen_erase(s, y, 0, s->w);
+        }
+        if (s->y < s->h)
+        {
+            if (p[0] == 0) tui_screen_erase(s, s->y, s->x, s->w);
+            if (p[0] == 1) tui_screen_erase(s, s->y, 0, s->x + 1);
+        }
+        break;
+    case 'r':
+        // Scroll region; only takes effect on the next scroll
+        s->region_top = max(p[0], 1) - 1;
+        s->region_bottom = count > 1 ? p[1] : 0;
+        s->x = s->y = 0;
+        s->wrap_pending = false;
+        break;
+    case 'S':
+    case 'T':
+    {
+        const int top = min(s->region_top, s->h),
+            bottom = s->region_bottom ? min(s->region_bottom, s->h) : s->h;
+        if (bottom - top < 1) break;
+
+        // Bring the terminal up to date, then scroll both it and what we
+        // want on it
+        tui_screen_diff(s);
+        const int n = min(max(p[0], 1), bottom - top);
+        tui_screen_scroll(s, top, bottom - 1, final == 'S' ? n : -n);
+        break;
+    }
+    default:
+        // Anything else (e.g. from page content) is dropped
+        break;
+    }
+}
+
+/* Interpret a chunk of output into the back buffer */
+static void
+tui_screen_interpret(struct tui_screen *s, const char *b, size_t n)
+{
+    for (const char *c = b; c < b + n; ++c)
+    {
+        const uint8_t ch = *c;
+        switch (s->state)
+        {
+        case PARSE_GROUND:
+            if (ch >= 0x20 && ch < 0x7f)
+            {
+                tui_screen_put(s, c, 1);
+            }
+            else if (ch >= 0xc0 && ch < 0xf8)
+            {
+                s->seq[0] = ch;
+                s->seq_len = 1;
+                s->seq_need = ch >= 0xf0 ? 4 : ch >= 0xe0 ? 3 : 2;
+                s->state = PARSE_UTF8;
+            }
+            else if (ch == '\x1b')
+            {
+                s->state = PARSE_ESC;
+            }
+            else if (ch == '\r')
+            {
+                s->x = 0;
+                s->wrap_pending = false;
+            }
+            else if (ch == '\n')
+            {
+                s->x = 0;
+                s->y = min(s->y + 1, max(s->h - 1, 0));
+                s->wrap_pending = false;
+            }
+            else if (ch == '\t')
+            {
+                s->x = min((s->x / 8 + 1) * 8, max(s->w - 1, 0));
+            }
+            // Other control characters and stray bytes are dropped
+            break;
+
+        case PARSE_UTF8:
+            if ((ch & 0xc0) != 0x80)
+            {
+                // Invalid sequence; start again with this byte
+                s->state = PARSE_GROUND;
+                --c;
+                break;
+            }
+            s->seq[s->seq_len++] = ch;
+            if (s->seq_len == s->seq_need)
+            {
+                tui_screen_put(s, s->seq, s->seq_len);
+                s->state = PARSE_GROUND;
+            }
+            break;
+
+        case PARSE_ESC:
+            if (ch == '[')
+            {
+                s->seq_len = 0;
+                s->state = PARSE_CSI;
+            }
+            else if (ch == ']')
+            {
+                s->state = PARSE_OSC;
+            }
+            else
+            {
+                s->state = PARSE_GROUND;
+            }
+            break;
+
+        case PARSE_CSI:
+            if (ch >= 0x40 && ch <= 0x7e)
+            {
+                s->state = PARSE_GROUND;
+                tui_screen_csi(s, ch);
+            }
+            else if (s->seq_len < (int)sizeof(s->seq))
+            {
+                s->seq[s->seq_len++] = ch;
+            }
+            break;
+
+        // Operating system commands (e.g. titles) are ignored
+        case PARSE_OSC:
+            if (ch == '\a') s->state = PARSE_GROUND;
+            else if (ch == '\x1b') s->state = PARSE_OSC_ESC;
+            break;
+        case PARSE_OSC_ESC:
+            s->state = ch == '\\' ? PARSE_GROUND : PARSE_OSC;
+            break;
+        }
+    }
+}
+
+/* Output SGR sequence to change the terminal's colours */
+static void
+tui_screen_set_pen(struct tui_screen *s, const struct tui_pen *pen)
+{
+    if (pen_eq(&s->term_pen, pen)) return;
+
+    char seq[64] = "\x1b[0";
+    int len = 3;
+    for (int i = 0; i < 8; ++i)
+    {
+        static const char CODES[8] = { 1, 2, 3, 4, 5, 7, 8, 9 };
+        if (pen->attr & (1 << i)) len += sprintf(seq + len, ";%d", CODES[i]);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        const uint32_t colour = i ? pen->bg : pen->fg;
+        const int base = i ? 40 : 30;
+        if (!colour) continue;
+        if (colour & 0x2000000u)
+        {
+            len += sprintf(seq + len, ";%d;2;%u;%u;%u", base + 8,
+                (colour >> 16) & 0xff, (colour >> 8) & 0xff, colour & 0xff);
+        }
+        else if ((colour & 0xff) < 8)
+        {
+            len += sprintf(seq + len, ";%d", base + (colour & 0xff));
+        }
+        else if ((colour & 0xff) < 16)
+        {
+            len += sprintf(seq + len, ";%d", base + 60 + (colour & 0xff) - 8);
+        }
+        else
+        {
+            len += sprintf(seq + len, ";%d;5;%u", base + 8, colour & 0xff);
+        }
+    }
+    seq[len++] = 'm';
+    out_append(s, seq, len);
+
+    s->term_pen = *pen;
+}
+
+/* Move the terminal's cursor */
+static void
+tui_screen_move(struct tui_screen *s, int x, int y)
+{
+    if (s->term_x == x && s->term_y == y) return;
+
+    if (s->term_y == y && s->term_x >= 0 && x == 0) out_append(s, "\r", 1);
+    else out_printf(s, "\x1b[%d;%dH", y + 1, x + 1);
+
+    s->term_x = x;
+    s->term_y = y;
+}
+
+/* Hash of a row of cells */
+static uint32_t
+row_hash(const struct tui_cell *row, int w)
+{
+    uint32_t hash = FNV1A_BASIS;
+    const struct tui_pen *pen = NULL;
+    for (int x = 0; x < w; ++x)
+    {
+        const struct tui_cell *const c = &row[x];
+        hash = fnv1a(hash, c->s, c->len);
+        hash = fnv1a(hash, &c->len, sizeof(c->len));
+
+        // Cells mostly come in runs with the same pen, so it's only hashed
+        // where it changes
+        if (pen && pen_eq(pen, &c->pen)) continue;
+        pen = &c->pen;
+        hash = fnv1a(hash, &pen->attr, sizeof(pen->attr));
+        hash = fnv1a(hash, &pen->fg, sizeof(pen->fg));
+        hash = fnv1a(hash, &pen->bg, sizeof(pen->bg));
+    }
+    return hash;
+}
+
+/* Shift rows top to bottom (inclusive) up by d rows (down if negative) */
+static void
+shift_rows(struct tui_cell *cells, int w, int top, int bottom, int d)
+{
+    const size_t row_size = w * sizeof(struct tui_cell);
+    if (d > 0)
+    {
+        memmove(&cells[top * w],
+            &cells[(top + d) * w],
+            (bottom - top + 1 - d) * row_size);
+        for (int c = (bottom + 1 - d) * w; c < (bottom + 1) * w; ++c)
+        {
+            cells[c] = CELL_BLANK;
+        }
+    }
+    else
+    {
+        memmove(&cells[(top - d) * w],
+            &cells[top * w],
+            (bottom - top + 1 + d) * row_size);
+        for (int c = top * w; c < (top - d) * w; ++c) cells[c] = CELL_BLANK;
+    }
+}
+
+/*
+ * Scroll rows top to bottom (inclusive) of the terminal up by d rows (down if
+ * negative), and shift the front buffer to match
+ */
+static void
+tui_screen_scroll_front(struct tui_screen *s, int top, int bottom, int d)
+{
+    // New lines are filled with the current background
+    const struct tui_pen pen_default = { 0 };
+    tui_screen_set_pen(s, &pen_default);
+
+    out_printf(s, "\x1b[%d;%dr", top + 1, bottom + 1);
+    if (d > 0) out_printf(s, "\x1b[%dS", d);
+    else out_printf(s, "\x1b[%dT", -d);
+    out_append(s, "\x1b[r", 3);
+    s->term_x = s->term_y = -1;
+
+    shift_rows(s->front, s->w, top, bottom, d);
+}
+
+/*
+ * Scroll requested by the output itself (e.g. the pager moving by a line);
+ * the back buffer is shifted too, so that only the rows drawn afterwards need
+ * to be compared
+ */
+static void
+tui_screen_scroll(struct tui_screen *s, int top, int bottom, int d)
+{
+    tui_screen_scroll_front(s, top, bottom, d);
+    shift_rows(s->back, s->w, top, bottom, d);
+}
+
+/*
+ * Look for content that has moved up or down (i.e. the page was scrolled),
+ * and if there's enough of it, shift it on the terminal with a scroll region
+ * rather than sending it all again
+ */
+static void
+tui_screen_find_scroll(struct tui_screen *s)
+{
+    const int w = s->w, h = s->h;
+    uint32_t back_hash[h], front_hash[h];
+    bool changed[h];
+    int changed_count = 0;
+    for (int y = 0; y < h; ++y)
+    {
+        back_hash[y] = row_hash(&s->back[y * w], w);
+        front_hash[y] = row_hash(&s->front[y * w], w);
+        changed[y] = back_hash[y] != front_hash[y];
+        changed_count += changed[y];
+    }
+    if (changed_count < TUI_SCREEN_SCROLL_MIN_ROWS) return;
+
+    // Find the shift that lets us reuse the most rows
+    int best = 0, best_count = 0, best_top = 0, best_bottom = 0;
+    for (int d = -(h - 1); d < h; ++d)
+    {
+        if (d == 0) continue;
+
+        int count = 0, top = h, bottom = -1;
+        for (int y = max(0, -d); y < min(h, h - d); ++y)
+        {
+            if (!changed[y] || back_hash[y] != front_hash[y + d]) continue;
+
+            ++count;
+            top = min(top, min(y, y + d));
+            bottom = max(bottom, max(y, y + d));
+        }
+        if (count > best_count)
+        {
+            best = d;
+            best_count = count;
+            best_top = top;
+            best_bottom = bottom;
+        }
+    }
+    if (best_count < TUI_SCREEN_SCROLL_MIN_ROWS) return;
+
+    tui_screen_scroll_front(s, best_top, best_bottom, best);
+}
+
+/* Send whatever differs between the back and front buffers */
+static void
+tui_screen_diff(struct tui_screen *s)
+{
+    const int w = s->w, h = s->h;
+
+    if (s->clear)
+    {
+        const struct tui_pen pen_default = { 0 };
+        tui_screen_set_pen(s, &pen_default);
+        out_append(s, "\x1b[2J", 4);
+        for (int c = 0; c < w * h; ++c) s->front[c] = CELL_BLANK;
+        s->clear = false;
+    }
+#if TUI_SCREEN_SCROLL
+    else if (w && h)
+    {
+        tui_screen_find_scroll(s);
+    }
+#endif
+
+    for (int y = 0; y < h; ++y)
+    {
+        struct tui_cell *const back = &s->back[y * w],
+                        *const front = &s->front[y * w];
+
+        // Anything after this is blank, so can be cleared with an erase
+        int blank_from = w;
+        for (; blank_from > 0 && cell_is_blank(&back[blank_from - 1]);
+            --blank_from);
+
+        for (int x = 0; x < w;)
+        {
+            if (cell_eq(&back[x], &front[x]))
+            {
+                ++x;
+                continue;
+            }
+
+            // Find the end of this run, including short gaps of unchanged
+            // cells
+            int start = x, end = x + 1;
+            if (back[start].len == 0 && start > 0) --start;
+            for (int gap = 0; end + gap < w && gap <= TUI_SCREEN_RUN_GAP;)
+            {
+                if (cell_eq(&back[end + gap], &front[end + gap]))
+                {
+                    ++gap;
+                    continue;
+                }
+                end += gap + 1;
+                gap = 0;
+            }
+            if (end < w && back[end].len == 0) ++end;
+
+            tui_screen_move(s, start, y);
+
+            int draw_end = end;
+            const bool erase = end > blank_from && w - blank_from > 3;
+            if (erase) draw_end = max(blank_from, start);
+
+            for (int c = start; c < draw_end; ++c)
+            {
+                if (back[c].len == 0) continue;
+                tui_screen_set_pen(s, &back[c].pen);
+                out_append(s, back[c].s, back[c].len);
+                front[c] = back[c];
+                if (c + 1 < w && back[c + 1].len == 0)
+                {
+                    front[c + 1] = back[c + 1];
+                    ++s->term_x;
+                }
+                ++s->term_x;
+            }
+
+            if (erase)
+            {
+                // Clear the rest of the row
+                const struct tui_pen pen_default = { 0 };
+                tui_screen_set_pen(s, &pen_default);
+                out_append(s, "\x1b[K", 3);
+                for (int c = draw_end; c < w; ++c) front[c] = CELL_BLANK;
+                break;
+            }
+
+            // The cursor stays on the last column after writing to it
+            if (s->term_x >= w) s->term_x = s->term_y = -1;
+            x = end;
+        }
+    }
+
+    // Leave the cursor where it was written to, if it can be seen
+    if (s->cursor_visible && w && h)
+    {
+        tui_screen_move(s, s->x, s->y);
+    }
+}
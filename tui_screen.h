@@ -0,0 +1,87 @@
+#ifndef TUI_SCREEN_H
+#define TUI_SCREEN_H
+
+/*
+ * tui_screen.h
+ *
+ * Virtual screen.  Rather than sending the output of each frame straight to
+ * the terminal, it's interpreted (cursor movement, colours, text, clears)
+ * into a grid of cells.  That grid is then compared with the one that is
+ * known to be on the terminal, and only the runs of cells that changed are
+ * sent.
+ */
+
+enum tui_cell_attr_bits
+{
+    TUI_ATTR_BOLD_BIT      = 1 << 0,
+    TUI_ATTR_DIM_BIT       = 1 << 1,
+    TUI_ATTR_ITALIC_BIT    = 1 << 2,
+    TUI_ATTR_UNDERLINE_BIT = 1 << 3,
+    TUI_ATTR_BLINK_BIT     = 1 << 4,
+    TUI_ATTR_REVERSE_BIT   = 1 << 5,
+    TUI_ATTR_HIDDEN_BIT    = 1 << 6,
+    TUI_ATTR_STRIKE_BIT    = 1 << 7,
+};
+
+// Colours are either default (0), a palette index or 24-bit RGB
+#define TUI_COLOUR_INDEX(i) (0x1000000u | (i))
+#define TUI_COLOUR_RGB(r, g, b) \
+    (0x2000000u | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (b))
+
+// Maximum bytes in a cell (a character plus any combining characters)
+#define TUI_CELL_BYTES 10
+
+struct tui_pen
+{
+    uint8_t attr;
+    uint32_t fg, bg;
+};
+
+struct tui_cell
+{
+    // UTF-8 bytes of the character.  Zero length means this is the right
+    // half of a wide character in the cell before it
+    char s[TUI_CELL_BYTES];
+    uint8_t len;
+
+    struct tui_pen pen;
+};
+
+struct tui_screen
+{
+    int w, h;
+
+    // Cells that we want on the terminal (back), and what is on it (front)
+    struct tui_cell *back, *front;
+
+    // Whether the front buffer is unknown, and the terminal should be
+    // cleared before drawing
+    bool clear;
+
+    // Interpreter state; cursor position, whether the next character wraps,
+    // current colours, and any partial escape/UTF-8 sequence
+    int x, y;
+    bool wrap_pending;
+    struct tui_pen pen;
+    int state;
+    char seq[64];
+    int seq_len, seq_need;
+
+    // Scroll region set by the output (bottom is exclusive, 0 for the bottom
+    // of the screen)
+    int region_top, region_bottom;
+
+    // Cursor and colours of the actual terminal (-1 position if unknown)
+    int term_x, term_y;
+    struct tui_pen term_pen;
+    bool cursor_visible;
+
+    // Output for the terminal
+    char *out;
+    size_t out_len, out_capacity;
+};
+
+void tui_screen_deinit(struct tui_screen *);
+void tui_screen_render(struct tui_screen *, int, int, const char *, size_t);
+
+#endif
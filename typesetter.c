@@ -1,8 +1,10 @@
 #include "pch.h"
 #include "gemini.h"
+#include "hyphenate_alg.h"
 #include "line_break_alg.h"
 #include "mime.h"
 #include "pager.h"
+#include "perf.h"
 #include "state.h"
 #include "tui.h"
 #include "typesetter.h"
@@ -10,15 +12,32 @@
 void
 typesetter_init(struct typesetter *t)
 {
-    line_break_init();
+    memset(t, 0, sizeof(struct typesetter));
 }
 
 void
 typesetter_deinit(struct typesetter *t)
 {
     if (t->raw_lines) free(t->raw_lines);
+    if (t->block_lines) free(t->block_lines);
+    if (t->headings) free(t->headings);
+    if (t->paragraphs) free(t->paragraphs);
+    t->raw_lines = NULL;
+    t->block_lines = NULL;
+    t->headings = NULL;
+    t->paragraphs = NULL;
+    t->heading_capacity = 0;
+    t->paragraph_capacity = 0;
+}
 
-    line_break_deinit();
+/* Point the raw lines into a copy of the raw buffer that they were in */
+void
+typesetter_rebase(struct typesetter *t, const char *from, const char *to)
+{
+    for (int i = 0; i < t->raw_line_count; ++i)
+    {
+        t->raw_lines[i].s = to + (t->raw_lines[i].s - from);
+    }
 }
 
 /* Initialise typesetter with raw content data */
@@ -27,18 +46,19 @@ typesetter_reinit(struct typesetter *t)
 {
     // Select the buffer (use alt if available)
     const char *rawbuf = g_recv->b_alt ? g_recv->b_alt : g_recv->b;
+    const char *const end = rawbuf + g_recv->size;
 
     // Count lines
     size_t old_line_count = t->raw_line_count;
     t->raw_line_count = 0;
-    for (int i = 0; i < g_recv->size; ++i)
-    {
-        if (rawbuf[i] == '\n' || i == g_recv->size - 1) ++t->raw_line_count;
-    }
+    for (const char *c = rawbuf;
+        c < end && (c = memchr(c, '\n', end - c)) != NULL;
+        ++c, ++t->raw_line_count);
+    if (g_recv->size && end[-1] != '\n') ++t->raw_line_count;
 
     // Allocate for lines
     const size_t lines_size =
-        sizeof(struct pager_buffer_line) * t->raw_line_count;
+        sizeof(struct typeset_raw_line) * t->raw_line_count;
     if (!t->raw_lines)
     {
         t->raw_lines = malloc(lines_size);
@@ -49,12 +69,30 @@ typesetter_reinit(struct typesetter *t)
         t->raw_lines = malloc(lines_size);
     }
 
-    // Set line points in raw buffer
-    const char *c, *end = rawbuf + g_recv->size, *start = rawbuf;
-    struct pager_buffer_line *line = t->raw_lines;
-    for (c = start; c < end; ++c)
+    // Allocate the coarse raw line to typeset line index (one entry per block
+    // of raw lines)
+    const int block_count =
+        t->raw_line_count / TYPESET_LAZY_BLOCK_LINES + 1;
+    if (block_count > t->block_capacity)
+    {
+        free(t->block_lines);
+        t->block_capacity = block_count;
+        t->block_lines = malloc(block_count * sizeof(int));
+    }
+    if (!t->raw_lines || !t->block_lines)
     {
-        if (*c != '\n' && c != end - 1) continue;
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+
+    // Set line points in raw buffer.  Note that we don't measure the width of
+    // the lines here, as it's too costly to do for huge documents which are
+    // only typeset as they are viewed
+    const char *c, *start = rawbuf;
+    struct typeset_raw_line *line = t->raw_lines;
+    for (start = rawbuf; start < end; start = c + 1, ++line)
+    {
+        if (!(c = memchr(start, '\n', end - start))) c = end;
 
         line->s = start;
         line->bytes = c - start;
@@ -62,12 +100,12 @@ typesetter_reinit(struct typesetter *t)
         for (const char *j = c - 1;
             j >= start && strchr("\r\n \t", *j) != NULL && line->bytes > 0;
             --j, --line->bytes);
-
-        line->len = utf8_width(line->s, line->bytes);
-
-        start = c + 1;
-        ++line;
     }
+
+    // Nothing to typeset until the page is typeset
+    t->raw_index_next = t->raw_line_count;
+    t->block_count = 0;
+    t->links_found = false;
 }
 
 /* Prepare buffers, etc. for typesetting */
@@ -79,19 +117,26 @@ typeset_start(
 {
     // Reset buffer state before we re-write it
     b->line_count = 0;
+    t->buffer_pos = 0;
+    t->raw_index_next = 0;
+    t->block_count = 0;
+    t->heading_count = 0;
+    t->paragraph_count = 0;
 
-    // TODO: don't re-parse links on every update?
-    g_pager->link_count = 0;
+    t->links_typeset = 0;
 
     // Avoid errors and memory issues by just not rendering at all if the width
     // is stupidly small
     if (width_total < 10) return false;
 
-    // Allocate space for buffer if needed
-    if (!b->b || b->size < g_recv->size)
+    // Allocate space for the buffer.  This is just an estimate of the typeset
+    // size (the raw text plus a bit for indents, prefixes and justification);
+    // the buffer grows as needed while typesetting
+    const size_t wanted_size = g_recv->size + g_recv->size / 4 + 4096;
+    if (!b->b || b->size < wanted_size)
     {
-        b->size = (g_recv->size * 10) / 2;
         if (b->b) free(b->b);
+        b->size = wanted_size;
         b->b = malloc(b->size);
     }
     if (!b->b)
@@ -100,57 +145,415 @@ typeset_start(
         exit(-1);
     }
 
-    // Allocate space for lines.  The number we compute assumes that EVERY line
-    // will be wrapped to the width (even though they aren't) and *should*
-    // guarantee a large enough buffer
-    size_t wanted_line_count = 0;
-    for (int raw_index = 0; raw_index < t->raw_line_count; ++raw_index)
+    // Allocate space for lines.  Again, this is only an estimate, assuming
+    // each raw line is wrapped as few times as possible
+    const int wanted_line_count =
+        t->raw_line_count + g_recv->size / width_total + 16;
+    if (!b->lines || b->lines_capacity < wanted_line_count)
     {
-        wanted_line_count += 1 +
-            ceil(t->raw_lines[raw_index].bytes / (float)width_total);
+        if (b->lines) free(b->lines);
+        if (b->line_pos) free(b->line_pos);
+        b->lines_capacity = wanted_line_count;
+        b->lines = malloc(b->lines_capacity * sizeof(struct pager_buffer_line));
+        b->line_pos =
+            malloc(b->lines_capacity * sizeof(struct pager_buffer_line_pos));
     }
-    const size_t wanted_lines_size =
-        wanted_line_count * sizeof(struct pager_buffer_line);
-    if (!wanted_lines_size) return false;
-    if (!b->lines)
+    if (!b->lines || !b->line_pos)
     {
-        b->lines = malloc(wanted_lines_size);
-        b->lines_capacity = wanted_lines_size;
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
     }
-    else if (b->lines_capacity < wanted_lines_size)
+
+    return true;
+}
+
+/* Grow the typeset buffer (if needed) so that it's at least n bytes */
+static void
+typeset_buffer_reserve(struct pager_buffer *b, size_t n)
+{
+    if (n < b->size) return;
+
+    size_t new_size = max(b->size, 4096);
+    while (new_size <= n) new_size = (new_size * 3) / 2;
+
+    char *tmp = realloc(b->b, new_size);
+    if (!tmp)
     {
-        if (b->lines) free(b->lines);
-        b->lines = malloc(wanted_lines_size);
-        b->lines_capacity = wanted_lines_size;
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    b->b = tmp;
+    b->size = new_size;
+}
+
+/* Grow the line buffer (if needed) so that there's room for another line */
+static void
+typeset_lines_reserve(struct pager_buffer *b)
+{
+    if (b->line_count + 1 < b->lines_capacity) return;
+
+    const int new_cap = max((b->lines_capacity * 3) / 2, 64);
+    void *tmp = realloc(b->lines, new_cap * sizeof(struct pager_buffer_line));
+    void *tmp_pos =
+        realloc(b->line_pos, new_cap * sizeof(struct pager_buffer_line_pos));
+    if (!tmp || !tmp_pos)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
     }
-    if (!b->lines) return false;
+    b->lines = tmp;
+    b->line_pos = tmp_pos;
+    b->lines_capacity = new_cap;
+}
+
+/* Grow an outline array (if needed) so that there's room for another entry */
+static void *
+typeset_outline_reserve(void *arr, int count, int *capacity, size_t size)
+{
+    if (count < *capacity) return arr;
+
+    const int new_cap = max((*capacity * 3) / 2, 64);
+    void *tmp = realloc(arr, new_cap * size);
+    if (!tmp)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    *capacity = new_cap;
+    return tmp;
+}
+
+/* Add a heading that begins on the line being typeset to the outline */
+static void
+typeset_outline_heading(
+    struct typesetter *t,
+    const struct pager_buffer *b,
+    int level)
+{
+    t->headings = typeset_outline_reserve(t->headings,
+        t->heading_count, &t->heading_capacity, sizeof(*t->headings));
+    t->headings[t->heading_count++] = (struct typeset_heading)
+    {
+        .line = b->line_count,
+        .level = level,
+    };
+}
+
+/*
+ * Add the line that was just typeset to the outline's paragraphs; either
+ * beginning one, or ending one if it's empty
+ */
+static void
+typeset_outline_line(struct typesetter *t, const struct pager_buffer *b)
+{
+    struct typeset_paragraph *const last = t->paragraph_count
+        ? &t->paragraphs[t->paragraph_count - 1]
+        : NULL;
+    const bool open = last && last->end == -1;
+
+    if (b->lines[b->line_count].bytes <= 1)
+    {
+        if (open) last->end = b->line_count;
+        return;
+    }
+    if (open) return;
+
+    t->paragraphs = typeset_outline_reserve(t->paragraphs,
+        t->paragraph_count, &t->paragraph_capacity, sizeof(*t->paragraphs));
+    t->paragraphs[t->paragraph_count++] = (struct typeset_paragraph)
+    {
+        .begin = b->line_count,
+        .end = -1,
+    };
+}
+
+/*
+ * Split a gemtext link line into its URI and its label (which is the URI if
+ * it doesn't have one)
+ */
+static void
+typeset_gemtext_link_split(
+    const struct typeset_raw_line *l,
+    const char **l_uri,
+    size_t *l_uri_len,
+    const char **l_title,
+    size_t *l_title_len)
+{
+    const char *const rawline_end = l->s + l->bytes;
+
+    /* Get URI. */
+    // Begins where there is no whitespace, and cannot begin with an '=' or
+    // '>'.  Ends at whitespace
+    *l_uri = l->s + strspn(l->s, "=> \t");
+    *l_uri_len = min(strcspn(*l_uri, "\t \n"), l->bytes);
+
+    /* Get optional human-friendly label. */
+    // Begins at first non-whitespace character after URI
+    bool has_title = false;
+    for (const char *i = *l_uri;
+        i < rawline_end && *i;
+        ++i)
+    {
+        if (*i == ' ' || *i == '\t')
+        {
+            has_title = true;
+            break;
+        }
+    }
+    if (has_title)
+    {
+        *l_title = *l_uri + *l_uri_len;
+        *l_title += strspn(*l_title, "\t ");
+        *l_title_len = max(rawline_end - *l_title, 0);
+    }
+    else
+    {
+        // Use URI as title
+        *l_title = *l_uri;
+        *l_title_len = *l_uri_len;
+    }
+}
+
+/* The fields of a gophermap item, each of which ends at a tab */
+struct gopher_item
+{
+    const char *display, *path, *hostname, *port;
+    size_t display_len, path_len, hostname_len;
+};
+
+/* Split a gophermap line into its fields.  Returns false if it's missing any */
+static bool
+typeset_gopher_item_split(
+    const struct typeset_raw_line *l,
+    struct gopher_item *item)
+{
+    const char *const rawline_end = l->s + l->bytes;
+    const char *tab;
+
+    // Display string follows the item type
+    item->display = l->s + 1;
+    if (!(tab = memchr(item->display, '\t', rawline_end - item->display)))
+    {
+        return false;
+    }
+    item->display_len = tab - item->display;
+
+    // Item path
+    item->path = tab + 1;
+    if (!(tab = memchr(item->path, '\t', rawline_end - item->path)))
+    {
+        return false;
+    }
+    item->path_len = tab - item->path;
+
+    // Item hostname, and the port after it
+    item->hostname = tab + 1;
+    tab = memchr(item->hostname, '\t', rawline_end - item->hostname);
+    if (!tab || tab + 1 >= rawline_end) return false;
+    item->hostname_len = tab - item->hostname;
+    item->port = tab + 1;
 
     return true;
 }
 
-/* Stuff run after typesetting document */
+/* Find the links of a gemtext document */
+static void
+typeset_links_gemtext(struct typesetter *t)
+{
+    bool verbatim = false;
+    for (int raw_index = 0; raw_index < t->raw_line_count; ++raw_index)
+    {
+        const struct typeset_raw_line *const l = &t->raw_lines[raw_index];
+
+        // Links in preformatted text are shown as they are
+        if (l->bytes >= strlen("```") &&
+            strncmp(l->s, "```", strlen("```")) == 0)
+        {
+            verbatim = !verbatim;
+            continue;
+        }
+        if (verbatim ||
+            l->bytes <= strlen("=>") ||
+            strncmp(l->s, "=>", strlen("=>")) != 0)
+        {
+            continue;
+        }
+
+        const char *l_uri, *l_title;
+        size_t l_uri_len, l_title_len;
+        typeset_gemtext_link_split(l, &l_uri, &l_uri_len,
+            &l_title, &l_title_len);
+
+        pager_check_link_capacity();
+        const int link_index = g_pager->link_count++;
+        struct pager_link *const link = &g_pager->links[link_index];
+        struct uri uri = uri_parse(l_uri, l_uri_len);
+        uri_abs(&g_state.uri, &uri);
+        uri_pack(&link->uri, &uri, &g_pager->link_uris);
+        link->raw_index = raw_index;
+        link->line_index = -1;
+        link->label = l_title - l->s;
+        link->label_len = l_title_len;
+    }
+}
+
+/* Find the links of a gophermap */
+static void
+typeset_links_gophermap(struct typesetter *t)
+{
+    struct uri uri;
+
+    // Set no query to the URI
+    uri.query[0] = '\0';
+
+    // Set URI protocol
+    uri.protocol = PROTOCOL_GOPHER;
+    strcpy(uri.protocol_str, "gopher");
+
+    for (int raw_index = 0; raw_index < t->raw_line_count; ++raw_index)
+    {
+        const struct typeset_raw_line *const l = &t->raw_lines[raw_index];
+        struct gopher_item item;
+        if (l->bytes < 1 || !typeset_gopher_item_split(l, &item)) continue;
+
+        // Check item type for selector
+        switch(*l->s)
+        {
+        // Informational message, and error code to indicate failure
+        case 'i':
+        case '3':
+            continue;
+
+        case '0': uri.gopher_item = GOPHER_ITEM_TEXT; break;
+        case '1': uri.gopher_item = GOPHER_ITEM_DIR; break;
+        case '7': uri.gopher_item = GOPHER_ITEM_SEARCH; break;
+
+        // Binary files
+        case '9':
+        case 'I':
+        case '2':
+            uri.gopher_item = GOPHER_ITEM_BIN;
+            break;
+
+        // Document, HTML file, sound file, and unknown/unsupported types
+        default: uri.gopher_item = GOPHER_ITEM_UNSUPPORTED; break;
+        }
+
+        const size_t path_len = min(item.path_len, URI_PATH_MAX - 1);
+        memcpy(uri.path, item.path, path_len);
+        uri.path[path_len] = '\0';
+        if (uri.gopher_item == GOPHER_ITEM_DIR &&
+            item.path[item.path_len] != '/' &&
+            path_len + 1 < URI_PATH_MAX)
+        {
+            strcat(uri.path, "/");
+        }
+
+        const size_t hostname_len =
+            min(item.hostname_len, URI_HOSTNAME_MAX - 1);
+        memcpy(uri.hostname, item.hostname, hostname_len);
+        uri.hostname[hostname_len] = '\0';
+
+        uri.port = atoi(item.port);
+
+        pager_check_link_capacity();
+        const int link_index = g_pager->link_count++;
+        struct pager_link *const link = &g_pager->links[link_index];
+        uri_pack(&link->uri, &uri, &g_pager->link_uris);
+        link->raw_index = raw_index;
+        link->line_index = -1;
+        link->label = item.display - l->s;
+        link->label_len = item.display_len;
+    }
+}
+
+/*
+ * Find the links of the document, which are kept for as long as the page is
+ * (rather than being found again each time it's typeset)
+ */
+static void
+typeset_links(struct typesetter *t)
+{
+    g_pager->link_count = 0;
+    g_pager->link_uris.len = 0;
+    g_pager->link_text_len = 0;
+
+    switch (t->doc)
+    {
+    case TYPESET_DOC_GEMTEXT: typeset_links_gemtext(t); break;
+    case TYPESET_DOC_GOPHERMAP: typeset_links_gophermap(t); break;
+    default: break;
+    }
+
+    t->links_found = true;
+}
+
+/*
+ * Attach the link on a raw line (if there is one) to the line being typeset.
+ * Returns the index of the link, or -1
+ */
+static int
+typeset_link_attach(
+    struct typesetter *t,
+    const struct pager_buffer *b,
+    int raw_index)
+{
+    if (t->links_typeset >= g_pager->link_count) return -1;
+
+    struct pager_link *const link = &g_pager->links[t->links_typeset];
+    if (link->raw_index != raw_index) return -1;
+
+    link->line_index = b->line_count;
+    return t->links_typeset++;
+}
+
+/*
+ * Helpers for the typesetting functions below.  These need to rebase any
+ * local pointers into the buffers as they may be reallocated
+ */
+#define BUFFER_RESERVE(x) \
+    if (buffer_pos + (x) >= buffer_end_pos) \
+    { \
+        const size_t pos = buffer_pos - b->b; \
+        typeset_buffer_reserve(b, pos + (x) + 1); \
+        buffer_pos = b->b + pos; \
+        buffer_end_pos = b->b + b->size; \
+    }
+#define LINE_NEXT() \
+    do \
+    { \
+        typeset_lines_reserve(b); \
+        typeset_outline_line(t, b); \
+        ++b->line_count; \
+        line = b->lines + b->line_count; \
+        pos = b->line_pos + b->line_count; \
+    } while(0)
+
+/* Stuff run after typesetting a block of the document */
 static void
 typeset_finish(
     struct pager_buffer *b,
-    size_t n_bytes)
+    size_t from,
+    size_t to)
 {
     // Replace all tabs with spaces, as we can't render them properly right now
     // (without really breaking the rendering code)
-    for (char *c = b->b; c < b->b + n_bytes; ++c)
+    for (char *c = b->b + from; c < b->b + to; ++c)
     {
         if (*c == '\t') *c = ' ';
     }
 }
 
-/* Typeset gemtext to a pager buffer */
-static size_t
+/* Typeset a block of gemtext raw lines to a pager buffer */
+static bool
 typeset_gemtext(
     struct typesetter *t,
     struct pager_buffer *b,
-    size_t width_total)
+    size_t width_total,
+    int raw_end)
 {
     // Position in buffer that we're up to
-    char *buffer_pos = b->b;
+    char *buffer_pos = b->b + t->buffer_pos;
 
     // Current gemtext parsing state
     struct gemtext_state
@@ -206,114 +609,72 @@ typeset_gemtext(
     } gemtext;
     memset(&gemtext, 0, sizeof(struct gemtext_state));
 
+    // Restore the state that carries over from the previous block
+    gemtext.mode = t->gemtext.mode;
+    gemtext.last_was_heading = t->gemtext.last_was_heading;
+    gemtext.link_maxidx_strlen = t->gemtext.link_maxidx_strlen;
+
     // The following macros operate on the current line (by appending to them).
     // They are here in hopes to massively reduce duplication of some hideous
     // code and hence hopefully make the rendering code a bit cleaner
-#define BUFFER_CHECK_SIZE(x) \
-    if (buffer_pos + (x) >= buffer_end_pos) \
-    { \
-        /*
-         * We just abort rendering if we exceed the maximum buffer size, as
-         * it's pretty tricky to perform the reallocation (as we use pointers
-         * to parts of the buffer so much).
-         *
-         * TODO solution (we can achieve it by using relative offsets rather
-         *      than pointers)
-         *
-         * The overflow would only occur (in rare cases with absolutely
-         * enormous files) if huge indent amounts or link/list prefixes, etc.
-         * add up.
-         */ \
-        tui_status_begin(); \
-        tui_printf("Aborting render (exceeded buffer size %.1f KiB).  FIXME", \
-            b->size / 1024.0f); \
-        tui_status_end(); \
-        return 0; \
-    }
 #define LINE_START() \
     do \
     { \
         if (line_started) break; \
         line_started = true; \
-        line->s = buffer_pos; \
-        line->raw_index = raw_index; \
-        line->raw_dist = 0; \
-        line->is_heading = false; \
-        line->is_hyphenated = false; \
+        line->off = buffer_pos - b->b; \
+        line->flags = 0; \
         line->prefix_len = 0; \
+        pos->raw_index = raw_index; \
+        pos->raw_dist = 0; \
     } while(0)
 #define LINE_FINISH() \
     do \
     { \
         if (!line_started) break; \
         line_started = false; \
-        line->bytes = buffer_pos - line->s; \
-        line->len = utf8_width(line->s, line->bytes); \
-        line->raw_dist = gemtext.raw_dist; \
+        line->bytes = buffer_pos - b->b - line->off; \
+        line->len = min(utf8_width(b->b + line->off, line->bytes), \
+            UINT16_MAX); \
+        pos->raw_dist = gemtext.raw_dist; \
         line->indent = gemtext.indent; \
         line->link_index = gemtext.link_index; \
-        if ((b->line_count + 1) * sizeof(struct pager_buffer_line) >= \
-            b->lines_capacity) \
-        { \
-            /* just abort if line count gets stupid (due to tiny widths) */ \
-            return 0; \
-        } \
-        ++b->line_count; \
-        ++line; \
+        LINE_NEXT(); \
     } while(0)
 #define LINE_STRNCPY(str, len) \
     do \
     { \
         const size_t n_bytes = (len); \
-        BUFFER_CHECK_SIZE(n_bytes); \
-        strncpy(buffer_pos, \
-            (str), \
-            min(n_bytes, buffer_end_pos - buffer_pos)); \
+        BUFFER_RESERVE(n_bytes); \
+        strncpy(buffer_pos, (str), n_bytes); \
         buffer_pos += n_bytes; \
         gemtext.raw_dist += n_bytes; \
     } while(0)
 #define LINE_STRNCPY_LIT(str) LINE_STRNCPY((str), strlen((str)))
 #define LINE_PRINTF(fmt, ...) \
+    BUFFER_RESERVE(snprintf(NULL, 0, (fmt), __VA_ARGS__)); \
     const size_t LINE_PRINTF_N_BYTES = \
         snprintf(buffer_pos, \
             buffer_end_pos - buffer_pos, \
             (fmt), \
             __VA_ARGS__); \
-    BUFFER_CHECK_SIZE(LINE_PRINTF_N_BYTES); \
     buffer_pos += LINE_PRINTF_N_BYTES; \
     gemtext.raw_dist += LINE_PRINTF_N_BYTES;
 
     int raw_index;
 
-    // Count links in the page
-    {
-        int maxidx = 0;
-        for (raw_index = 0;
-            raw_index < t->raw_line_count;
-            ++raw_index)
-        {
-            const struct pager_buffer_line *const
-                l = &t->raw_lines[raw_index];
-            if (l->bytes > strlen("=>") &&
-                strncmp(l->s, "=>", strlen("=>")) == 0)
-            {
-                ++maxidx;
-            }
-        }
-        gemtext.link_maxidx_strlen = snprintf(NULL, 0, "%d", maxidx);
-    }
-
-    // Iterate over each of the raw lines in the buffer
-    struct pager_buffer_line *line = b->lines;
-    const char *const buffer_end_pos = b->b + b->size;
+    // Iterate over each of the raw lines in the block
+    struct pager_buffer_line *line = b->lines + b->line_count;
+    struct pager_buffer_line_pos *pos = b->line_pos + b->line_count;
+    const char *buffer_end_pos = b->b + b->size;
     const char *rawline_end;
     bool line_started = false;
-    for (raw_index = 0;
-        raw_index < t->raw_line_count;
+    for (raw_index = t->raw_index_next;
+        raw_index < raw_end;
         ++raw_index)
     {
         // The current raw line that we are on
-        const struct pager_buffer_line *const
+        const struct typeset_raw_line *const
             rawline = &t->raw_lines[raw_index];
 
         gemtext.link = NULL;
@@ -354,9 +715,12 @@ typeset_gemtext(
         if (rawline->bytes >= strlen("```") &&
             strncmp(rawline->s, "```", strlen("```")) == 0)
         {
-            // Empty line
+            // Empty line.  The mode may be a list or quote, so it can't just
+            // be XORed with the verbatim flag
             LINE_FINISH();
-            gemtext.mode ^= PARSE_VERBATIM;
+            gemtext.mode = gemtext.mode == PARSE_VERBATIM
+                ? PARSE_PARAGRAPH
+                : PARSE_VERBATIM;
             continue;
         }
 
@@ -379,32 +743,32 @@ typeset_gemtext(
         switch(heading_level)
         {
         case 1:
-            gemtext.esc = buffer_pos;
-            LINE_STRNCPY_LIT(COLOUR_HEADING1);
-            gemtext.esc_len = buffer_pos - gemtext.esc;
+            gemtext.esc = COLOUR_HEADING1;
+            gemtext.esc_len = strlen(COLOUR_HEADING1);
+            LINE_STRNCPY(gemtext.esc, gemtext.esc_len);
             gemtext.raw_bytes_skip = 2;
             break;
 
         case 2:
-            gemtext.esc = buffer_pos;
-            LINE_STRNCPY_LIT(COLOUR_HEADING2);
-            gemtext.esc_len = buffer_pos - gemtext.esc;
+            gemtext.esc = COLOUR_HEADING2;
+            gemtext.esc_len = strlen(COLOUR_HEADING2);
+            LINE_STRNCPY(gemtext.esc, gemtext.esc_len);
             gemtext.raw_bytes_skip = 3;
             break;
 
         case 3:
-            gemtext.esc = buffer_pos;
-            LINE_STRNCPY_LIT(COLOUR_HEADING3);
-            gemtext.esc_len = buffer_pos - gemtext.esc;
+            gemtext.esc = COLOUR_HEADING3;
+            gemtext.esc_len = strlen(COLOUR_HEADING3);
+            LINE_STRNCPY(gemtext.esc, gemtext.esc_len);
             gemtext.raw_bytes_skip = 4;
             break;
 
         // Level 4 headings are non-standard, but we support them nevertheless
         // as there are some pages which decide to use them anyway.
         case 4:
-            gemtext.esc = buffer_pos;
-            LINE_STRNCPY_LIT(COLOUR_HEADING4);
-            gemtext.esc_len = buffer_pos - gemtext.esc;
+            gemtext.esc = COLOUR_HEADING4;
+            gemtext.esc_len = strlen(COLOUR_HEADING4);
+            LINE_STRNCPY(gemtext.esc, gemtext.esc_len);
             gemtext.raw_bytes_skip = 5;
             break;
 
@@ -438,7 +802,8 @@ typeset_gemtext(
                 }
             }
 
-            line->is_heading = true;
+            line->flags |= PAGER_LINE_HEADING_BIT;
+            typeset_outline_heading(t, b, heading_level);
             gemtext.indent = GEMTEXT_INDENT_HEADING;
             gemtext.indent_canon = 0;
             gemtext.last_was_heading = true;
@@ -448,51 +813,16 @@ typeset_gemtext(
             gemtext.last_was_heading = false;
         }
 
-        // Parse links
-        if (rawline->bytes > strlen("=>") &&
-            strncmp(rawline->s, "=>", strlen("=>")) == 0)
+        // Links (which were found when the page was loaded)
+        gemtext.link_index = typeset_link_attach(t, b, raw_index);
+        if (gemtext.link_index > -1)
         {
-            pager_check_link_capacity();
-            gemtext.link_index = g_pager->link_count++;
-
-            /* Get URI. */
-            // Begins where there is no whitespace, and cannot begin with an
-            // '=' or '>'.  Ends at whitespace
-            const char *l_uri =
-                rawline->s + strspn(rawline->s, "=> \t");
-            size_t l_uri_len = min(strcspn(l_uri, "\t \n"), rawline->bytes);
-
-            /* Get optional human-friendly label. */
-            // Begins at first non-whitespace character after URI
-            const char *l_title;
-            bool has_title = false;
-            for (const char *i = l_uri;
-                i < rawline_end && *i;
-                ++i)
-            {
-                if (*i == ' ' || *i == '\t')
-                {
-                    has_title = true;
-                    break;
-                }
-            }
-            if (has_title)
-            {
-                l_title = l_uri + l_uri_len;
-                l_title += strspn(l_title, "\t ");
-            }
-            else
-            {
-                // Use URI as title
-                l_title = l_uri;
-            }
-
-            // Add link to page state and set buffer location so we can
-            // highlight on selection
             gemtext.link = &g_pager->links[gemtext.link_index];
-            gemtext.link->uri = uri_parse(l_uri, l_uri_len);
-            uri_abs(&g_state.uri, &gemtext.link->uri);
-            gemtext.link->line_index = b->line_count;
+
+            const char *l_uri, *l_title;
+            size_t l_uri_len, l_title_len;
+            typeset_gemtext_link_split(rawline, &l_uri, &l_uri_len,
+                &l_title, &l_title_len);
 
             // This is so that text wrapping will work for the link title.  We
             // want to print from where the title string starts if it exists
@@ -564,10 +894,9 @@ typeset_gemtext(
             strncmp(rawline->s, ">", strlen(">")) == 0)
         {
             gemtext.mode = PARSE_BLOCKQUOTE;
-            gemtext.esc = buffer_pos;
-            const char *BLOCKQUOTE_ESC = "\x1b[2m";
-            LINE_STRNCPY_LIT(BLOCKQUOTE_ESC);
-            gemtext.esc_len = strlen(BLOCKQUOTE_ESC);
+            gemtext.esc = "\x1b[2m";
+            gemtext.esc_len = strlen(gemtext.esc);
+            LINE_STRNCPY(gemtext.esc, gemtext.esc_len);
 
             // Set blockquote prefix (for both the initial and wrapped lines)
             LINE_STRNCPY_LIT(BLOCKQUOTE_PREFIX);
@@ -615,7 +944,8 @@ typeset_gemtext(
         //   B/C: testing
         //   D:   This is aligned too.
         //
-        if (gemtext.mode == PARSE_PARAGRAPH && !line->is_heading)
+        if (gemtext.mode == PARSE_PARAGRAPH &&
+            (!line_started || !(line->flags & PAGER_LINE_HEADING_BIT)))
         {
             for (const char *i = rawline->s;
                 i <= rawline_end && *i;
@@ -646,6 +976,10 @@ typeset_gemtext(
         }
 
     wrap: ;
+        // Indents are kept in a byte, so the hang (e.g. after a very long key
+        // in a key/value line) mustn't take the wrapped lines' indent past it
+        gemtext.hang = min(gemtext.hang, max(UINT8_MAX - gemtext.indent, 0));
+
         // Margins are accounted for in "width total" here
         int width = width_total - gemtext.indent - gemtext.prefix_len;
 
@@ -660,22 +994,22 @@ typeset_gemtext(
             .hang = gemtext.hang,
             // A bit hacky; we need to skip over the inserted escape codes for
             // headings to wrap at correct point.
-            .skip = line->is_heading
+            .skip = !line_started || (line->flags & PAGER_LINE_HEADING_BIT)
                 ? 0
-                : utf8_width(line->s, buffer_pos - line->s),
+                : utf8_width(b->b + line->off,
+                    buffer_pos - b->b - line->off),
         };
+        const uint64_t lb_begin = perf_now();
         line_break_prepare(&pa);
     #if TYPESET_LINEBREAK_GREEDY
         line_break_compute_greedy();
     #else
         line_break_compute_knuth_plass();
     #endif
+        perf_accumulate(PERF_LINE_BREAK, perf_now() - lb_begin);
 
         gemtext.raw_bytes_skip = 0;
 
-        // TODO: buffer size check
-        //BUFFER_CHECK_SIZE(width * 4 * );
-
         int indent_no_hang = gemtext.indent;
 
         // Write the broken lines into the buffer
@@ -702,6 +1036,9 @@ typeset_gemtext(
                     line->prefix_len += gemtext.prefix_len;
                 }
             }
+            // A broken line is at most the rest of the raw line, plus
+            // spaces for justification and a hyphen
+            BUFFER_RESERVE((rawline_end - rawline->s) + 2 * width_total + 16);
             len = line_break_get(buffer_pos, buffer_end_pos - buffer_pos);
 
             buffer_pos += len;
@@ -713,7 +1050,12 @@ typeset_gemtext(
         LINE_FINISH();
     }
 
-    return buffer_pos - b->b;
+    // Save state for the next block
+    t->buffer_pos = buffer_pos - b->b;
+    t->gemtext.mode = gemtext.mode;
+    t->gemtext.last_was_heading = gemtext.last_was_heading;
+
+    return true;
 
 #undef LINE_START
 #undef LINE_FINISH
@@ -722,35 +1064,36 @@ typeset_gemtext(
 #undef LINE_PRINTF
 }
 
-/* Typeset plaintext to a pager buffer */
-static size_t
+/* Typeset a block of plaintext raw lines to a pager buffer */
+static bool
 typeset_plaintext(
     struct typesetter *t,
-    struct pager_buffer *b)
+    struct pager_buffer *b,
+    int raw_end)
 {
     // Position in buffer that we're up to
-    char *buffer_pos = b->b;
-
-    // Iterate over each of the raw lines in the buffer
-    struct pager_buffer_line *line = b->lines;
-    const char *const buffer_end_pos = b->b + b->size;
-    for (int raw_index = 0;
-        raw_index < t->raw_line_count;
+    char *buffer_pos = b->b + t->buffer_pos;
+
+    // Iterate over each of the raw lines in the block
+    struct pager_buffer_line *line = b->lines + b->line_count;
+    struct pager_buffer_line_pos *pos = b->line_pos + b->line_count;
+    const char *buffer_end_pos = b->b + b->size;
+    for (int raw_index = t->raw_index_next;
+        raw_index < raw_end;
         ++raw_index)
     {
         // The current raw line that we are on
-        const struct pager_buffer_line *const
+        const struct typeset_raw_line *const
             rawline = &t->raw_lines[raw_index];
 
         // Plaintext is always rendered verbatim
-        line->s = buffer_pos;
-        line->raw_index = raw_index;
-        line->raw_dist = 0;
-        line->is_heading = false;
-        line->is_hyphenated = false;
+        line->off = buffer_pos - b->b;
+        line->flags = 0;
         line->indent = 0;
         line->prefix_len = 0;
         line->link_index = -1;
+        pos->raw_index = raw_index;
+        pos->raw_dist = 0;
 
         if (rawline->bytes < 1)
         {
@@ -760,127 +1103,83 @@ typeset_plaintext(
         }
 
         const size_t n_bytes = rawline->bytes;
-        BUFFER_CHECK_SIZE(n_bytes);
-        strncpy(buffer_pos,
-            rawline->s,
-            min(n_bytes, buffer_end_pos - buffer_pos));
+        BUFFER_RESERVE(n_bytes);
+        memcpy(buffer_pos, rawline->s, n_bytes);
         buffer_pos += n_bytes;
 
         // Finish line
-        line->len = rawline->len;
+        line->len = min(utf8_width(b->b + line->off, n_bytes), UINT16_MAX);
         line->bytes = n_bytes;
 
     next_line:
-        if ((b->line_count + 1) * sizeof(struct pager_buffer_line) >=
-            b->lines_capacity)
-        {
-            return 0;
-        }
-        ++b->line_count;
-        ++line;
+        LINE_NEXT();
     }
 
-    return buffer_pos - b->b;
+    t->buffer_pos = buffer_pos - b->b;
+    return true;
 }
 
 
-/* Typeset a gophermap */
-static size_t
+/* Typeset a block of a gophermap */
+static bool
 typeset_gophermap(
     struct typesetter *t,
-    struct pager_buffer *b)
+    struct pager_buffer *b,
+    int raw_end)
 {
     // Position in buffer that we're up to
-    char *buffer_pos = b->b;
-
-    struct uri uri;
-
-    // Set no query to the URI
-    uri.query[0] = '\0';
-
-    // Set URI protocol
-    uri.protocol = PROTOCOL_GOPHER;
-    strcpy(uri.protocol_str, "gopher");
+    char *buffer_pos = b->b + t->buffer_pos;
 
     // Helper macros
 #define LINE_STRNCPY(str, len) \
     do \
     { \
         const size_t n_bytes = (len); \
-        BUFFER_CHECK_SIZE(n_bytes); \
-        strncpy(buffer_pos, \
-            (str), \
-            min(n_bytes, buffer_end_pos - buffer_pos)); \
+        BUFFER_RESERVE(n_bytes); \
+        strncpy(buffer_pos, (str), n_bytes); \
         line->bytes += n_bytes; \
         buffer_pos += n_bytes; \
     } while(0)
 #define LINE_STRNCPY_LIT(str) LINE_STRNCPY((str), strlen((str)))
 #define LINE_PRINTF(n_bytes, fmt, ...) \
+    BUFFER_RESERVE(snprintf(NULL, 0, (fmt), __VA_ARGS__)); \
     (n_bytes) = \
         snprintf(buffer_pos, \
             buffer_end_pos - buffer_pos, \
             (fmt), \
             __VA_ARGS__); \
-    BUFFER_CHECK_SIZE((n_bytes)); \
     line->bytes += (n_bytes); \
     buffer_pos += (n_bytes);
 #define ADD_LINK() \
-    {\
-        pager_check_link_capacity(); \
-        line->link_index = g_pager->link_count++; \
-        struct pager_link *link = &g_pager->links[line->link_index]; \
-        memcpy(&link->uri, &uri, sizeof(struct uri)); \
-        link->line_index = b->line_count; \
-    }
-
-    // Iterate over each of the raw lines in the buffer
-    struct pager_buffer_line *line = b->lines;
-    const char *const buffer_end_pos = b->b + b->size;
-    const char *rawline_end;
-    for (int raw_index = 0;
-        raw_index < t->raw_line_count;
+    line->link_index = typeset_link_attach(t, b, raw_index);
+
+    // Iterate over each of the raw lines in the block
+    struct pager_buffer_line *line = b->lines + b->line_count;
+    struct pager_buffer_line_pos *pos = b->line_pos + b->line_count;
+    const char *buffer_end_pos = b->b + b->size;
+    for (int raw_index = t->raw_index_next;
+        raw_index < raw_end;
         ++raw_index)
     {
         // The current raw line that we are on
-        const struct pager_buffer_line *const
+        const struct typeset_raw_line *const
             rawline = &t->raw_lines[raw_index];
 
         if (rawline->bytes < 1) continue;
 
-        line->s = buffer_pos;
+        line->off = buffer_pos - b->b;
         line->bytes = 0;
-        line->raw_index = raw_index;
-        line->raw_dist = 0;
-        line->is_heading = false;
-        line->is_hyphenated = false;
+        line->flags = 0;
         line->indent = 0;
         line->prefix_len = 0;
         line->link_index = -1;
-        rawline_end = rawline->s + rawline->bytes;
+        pos->raw_index = raw_index;
+        pos->raw_dist = 0;
 
-        // Write display string to the buffer
-        const char *item_display = rawline->s + 1;
-        // TODO dont use strcspn as it overreads
-        const size_t item_display_len = strcspn(item_display, "\t");
-        if (item_display + item_display_len >= rawline_end) continue;
-
-        // Get item path
-        const char *item_path = item_display + item_display_len + 1;
-        const size_t item_path_len = strcspn(item_path, "\t");
-        if (item_path + item_path_len >= rawline_end) continue;
-        strncpy(uri.path, item_path, min(item_path_len, URI_PATH_MAX));
-        uri.path[item_path_len] = '\0';
-
-        // Get item hostname
-        const char *item_hostname = item_path + item_path_len + 1;
-        const size_t item_hostname_len = strcspn(item_hostname, "\t");
-        if (item_hostname + item_hostname_len + 1 >= rawline_end) continue;
-        strncpy(uri.hostname, item_hostname,
-            min(item_hostname_len, URI_HOSTNAME_MAX));
-        uri.hostname[item_hostname_len] = '\0';
-
-        // Get item port
-        uri.port = atoi(item_hostname + item_hostname_len + 1);
+        // Lines without all of the fields aren't shown.  The link (and its
+        // URI) of each item was found when the page was loaded
+        struct gopher_item item;
+        if (!typeset_gopher_item_split(rawline, &item)) continue;
 
         size_t n_bytes;
 
@@ -899,7 +1198,6 @@ typeset_gophermap(
 
         // Document
         case 'd':
-            uri.gopher_item = GOPHER_ITEM_UNSUPPORTED;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d doc] ", line->link_index);
             line->proto_len = n_bytes;
@@ -907,7 +1205,6 @@ typeset_gophermap(
 
         // HTML file
         case 'h':
-            uri.gopher_item = GOPHER_ITEM_UNSUPPORTED;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d html] ", line->link_index);
             line->proto_len = n_bytes;
@@ -915,7 +1212,6 @@ typeset_gophermap(
 
         // Sound file
         case 's':
-            uri.gopher_item = GOPHER_ITEM_UNSUPPORTED;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d snd] ", line->link_index);
             line->proto_len = n_bytes;
@@ -923,7 +1219,6 @@ typeset_gophermap(
 
         // File (usually text)
         case '0':
-            uri.gopher_item = GOPHER_ITEM_TEXT;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d txt] ", line->link_index);
             line->proto_len = n_bytes;
@@ -931,12 +1226,6 @@ typeset_gophermap(
 
         // Directory
         case '1':
-            uri.gopher_item = GOPHER_ITEM_DIR;
-            if (item_path[item_path_len] != '/' &&
-                item_path_len + 1 < URI_PATH_MAX)
-            {
-                strcat(uri.path, "/");
-            }
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d dir] ", line->link_index);
             line->proto_len = n_bytes;
@@ -944,7 +1233,6 @@ typeset_gophermap(
 
         // Search
         case '7':
-            uri.gopher_item = GOPHER_ITEM_SEARCH;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d search] ", line->link_index);
             line->proto_len = n_bytes;
@@ -954,7 +1242,6 @@ typeset_gophermap(
         case '9':
         case 'I':
         case '2':
-            uri.gopher_item = GOPHER_ITEM_BIN;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d bin] ", line->link_index);
             line->proto_len = n_bytes;
@@ -962,7 +1249,6 @@ typeset_gophermap(
 
         // Unknown/unsupported item type
         default:
-            uri.gopher_item = GOPHER_ITEM_UNSUPPORTED;
             ADD_LINK();
             LINE_PRINTF(n_bytes, " [%d unsupported] ", line->link_index);
             line->proto_len = n_bytes;
@@ -970,20 +1256,15 @@ typeset_gophermap(
         }
 
         // Write display string
-        LINE_STRNCPY(item_display, item_display_len);
+        LINE_STRNCPY(item.display, item.display_len);
 
         // Finish line
-        line->len = utf8_width(line->s, line->bytes);
-        if ((b->line_count + 1) * sizeof(struct pager_buffer_line) >=
-            b->lines_capacity)
-        {
-            return 0;
-        }
-        ++b->line_count;
-        ++line;
+        line->len = min(utf8_width(b->b + line->off, line->bytes), UINT16_MAX);
+        LINE_NEXT();
     }
 
-    return buffer_pos - b->b;
+    t->buffer_pos = buffer_pos - b->b;
+    return true;
 
 #undef LINE_STRNCPY
 #undef LINE_STRNCPY_LIT
@@ -991,6 +1272,301 @@ typeset_gophermap(
 #undef ADD_LINK
 }
 
+/* Finish timing a typeset, along with the line breaking done during it */
+static inline void
+typeset_perf_end(void)
+{
+    if (perf_end(PERF_TYPESET)) perf_commit(PERF_LINE_BREAK);
+}
+
+/*
+ * Typeset the next block of raw lines.  Returns false if there was nothing
+ * left to typeset
+ */
+bool
+typeset_block(
+    struct typesetter *t,
+    struct pager_buffer *b)
+{
+    if (typeset_is_done(t)) return false;
+
+    perf_begin(PERF_TYPESET);
+
+    const int raw_begin = t->raw_index_next;
+    const int raw_end =
+        min(raw_begin + TYPESET_LAZY_BLOCK_LINES, t->raw_line_count);
+    const size_t pos_begin = t->buffer_pos;
+
+    // Blocks always begin on a multiple of the block size, so this is where
+    // the typeset lines of this block begin
+    t->block_lines[t->block_count++] = b->line_count;
+
+    bool success;
+    switch (t->doc)
+    {
+    case TYPESET_DOC_GEMTEXT:
+        success = typeset_gemtext(t, b, t->content_width, raw_end);
+        break;
+    case TYPESET_DOC_GOPHERMAP:
+        success = typeset_gophermap(t, b, raw_end);
+        break;
+    case TYPESET_DOC_PLAINTEXT:
+        success = typeset_plaintext(t, b, raw_end);
+        break;
+    default:
+        success = false;
+        break;
+    }
+
+    // Rendering was aborted; we just show whatever we got up to
+    if (!success)
+    {
+        t->raw_index_next = t->raw_line_count;
+        typeset_perf_end();
+        return false;
+    }
+
+    typeset_finish(b, pos_begin, t->buffer_pos);
+    t->raw_index_next = raw_end;
+
+    typeset_perf_end();
+    return true;
+}
+
+/* Make sure the given typeset line exists (if the document has it) */
+void
+typeset_until_line(
+    struct typesetter *t,
+    struct pager_buffer *b,
+    int line_index)
+{
+    while (b->line_count <= line_index && typeset_block(t, b));
+}
+
+/* Make sure all lines of the given raw line have been typeset */
+void
+typeset_until_raw(
+    struct typesetter *t,
+    struct pager_buffer *b,
+    int raw_index)
+{
+    while (t->raw_index_next <= raw_index && typeset_block(t, b));
+}
+
+/* Typeset everything that's left of the document */
+void
+typeset_all(
+    struct typesetter *t,
+    struct pager_buffer *b)
+{
+    while (typeset_block(t, b));
+}
+
+/* Get the first typeset line of a raw line (or the closest after it) */
+int
+typeset_raw_to_line(
+    struct typesetter *t,
+    struct pager_buffer *b,
+    int raw_index)
+{
+    raw_index = max(min(raw_index, t->raw_line_count - 1), 0);
+    typeset_until_raw(t, b, raw_index);
+
+    // Jump to the block using the coarse index, and search from there
+    const int block = raw_index / TYPESET_LAZY_BLOCK_LINES;
+    int r = block < t->block_count ? t->block_lines[block] : 0;
+    for (;
+        r < b->line_count - 1 && b->line_pos[r].raw_index < raw_index;
+        ++r);
+
+    return r;
+}
+
+/* Get the first heading in the outline on or after a line */
+static int
+typeset_heading_lower_bound(const struct typesetter *t, int line)
+{
+    int lo = 0, hi = t->heading_count;
+    while (lo < hi)
+    {
+        const int mid = lo + (hi - lo) / 2;
+        if (t->headings[mid].line < line) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Get the first heading on or after a line, typesetting more of the document
+ * if needed.  Returns -1 if there are none
+ */
+int
+typeset_heading_from(
+    struct typesetter *t,
+    struct pager_buffer *b,
+    int line)
+{
+    int i;
+    while ((i = typeset_heading_lower_bound(t, line)) >= t->heading_count)
+    {
+        if (!typeset_block(t, b)) return -1;
+    }
+    return i;
+}
+
+/* Get the last heading before a line, or -1 if there are none */
+int
+typeset_heading_before(const struct typesetter *t, int line)
+{
+    return typeset_heading_lower_bound(t, line) - 1;
+}
+
+/*
+ * Get the empty line after the first paragraph that hasn't ended by a line,
+ * typesetting more of the document if needed.  Returns the line count if the
+ * document ends first
+ */
+int
+typeset_paragraph_end_after(
+    struct typesetter *t,
+    struct pager_buffer *b,
+    int line)
+{
+    for (;;)
+    {
+        // Only the last paragraph can still be open, so the ends are in order
+        // with it at the end
+        int lo = 0, hi = t->paragraph_count;
+        while (lo < hi)
+        {
+            const int mid = lo + (hi - lo) / 2;
+            const int end = t->paragraphs[mid].end;
+            if (end != -1 && end <= line) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < t->paragraph_count && t->paragraphs[lo].end != -1)
+        {
+            return t->paragraphs[lo].end;
+        }
+        if (!typeset_block(t, b)) return b->line_count;
+    }
+}
+
+/*
+ * Get the first line of the last paragraph that begins on or before a line,
+ * or 0 if there are none
+ */
+int
+typeset_paragraph_begin_before(const struct typesetter *t, int line)
+{
+    int lo = 0, hi = t->paragraph_count;
+    while (lo < hi)
+    {
+        const int mid = lo + (hi - lo) / 2;
+        if (t->paragraphs[mid].begin <= line) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? t->paragraphs[lo - 1].begin : 0;
+}
+
+/*
+ * Get the part of a raw line that is shown as text once it's typeset (e.g.
+ * the label of a link, or the display string of a gophermap item), following
+ * the same rules as the typesetters.  verbatim is the gemtext preformatting
+ * state, which is updated as the lines are gone through in order.  Returns
+ * false if none of the line is shown
+ */
+bool
+typeset_raw_shown(
+    const struct typesetter *t,
+    int raw_index,
+    bool *verbatim,
+    const char **begin,
+    const char **end)
+{
+    const struct typeset_raw_line *const rawline = &t->raw_lines[raw_index];
+    const char *s = rawline->s, *const e = rawline->s + rawline->bytes;
+
+    *begin = s;
+    *end = e;
+    if (s >= e) return false;
+
+    switch (t->doc)
+    {
+    case TYPESET_DOC_GEMTEXT:
+    {
+        if (rawline->bytes >= strlen("```") &&
+            strncmp(s, "```", strlen("```")) == 0)
+        {
+            *verbatim = !*verbatim;
+            return false;
+        }
+        if (*verbatim) return true;
+
+        // Headings
+        int heading_level = 0;
+        for (; s + heading_level < e && s[heading_level] == '#';
+            ++heading_level);
+        if (heading_level >= 1 && heading_level <= 4)
+        {
+            *begin = s + min(heading_level + 1, e - s);
+            break;
+        }
+
+        // Links show their label, or the URI if there's no label
+        if (rawline->bytes > strlen("=>") &&
+            strncmp(s, "=>", strlen("=>")) == 0)
+        {
+            const char *c = s + strlen("=>");
+            for (; c < e && (*c == '=' || *c == '>' ||
+                *c == ' ' || *c == '\t'); ++c);
+            const char *const l_uri = c;
+            for (; c < e && *c != ' ' && *c != '\t'; ++c);
+            for (; c < e && (*c == ' ' || *c == '\t'); ++c);
+            *begin = c < e ? c : l_uri;
+            break;
+        }
+
+        // Lists and blockquotes
+        if (rawline->bytes > strlen("* ") &&
+            strncmp(s, "* ", strlen("* ")) == 0)
+        {
+            *begin = s + strlen("* ");
+        }
+        else if (*s == '>')
+        {
+            for (++s; s < e && *s == ' '; ++s);
+            *begin = s;
+        }
+        break;
+    }
+
+    case TYPESET_DOC_GOPHERMAP:
+    {
+        // The display string is between the item type and the first tab, and
+        // the item is only shown if it has a path, hostname and port too
+        const char *const display_end = memchr(s + 1, '\t', e - s - 1);
+        if (!display_end) return false;
+        const char *const path_end =
+            memchr(display_end + 1, '\t', e - display_end - 1);
+        if (!path_end) return false;
+        const char *const host_end =
+            memchr(path_end + 1, '\t', e - path_end - 1);
+        if (!host_end || host_end + 1 >= e) return false;
+
+        *begin = s + 1;
+        *end = display_end;
+        break;
+    }
+
+    case TYPESET_DOC_PLAINTEXT: break;
+
+    default: return false;
+    }
+
+    return *begin < *end;
+}
+
 bool
 typeset_page(
     struct typesetter *t,
@@ -998,36 +1574,58 @@ typeset_page(
     size_t w,
     struct mime *m)
 {
-    // Bytes written by typesetter
-    size_t n_bytes;
-
     t->content_width = w;
 
+    perf_begin(PERF_TYPESET);
+
+    // Hyphenate in the page's language, if it has told us
+    hyphenate_set_lang(m->lang);
+
     if (mime_eqs(m, MIME_GEMTEXT))
     {
-        // Typeset gemtext document
-        if (!typeset_start(t, b, w)) return false;
-        n_bytes = typeset_gemtext(t, b, w);
-        typeset_finish(b, n_bytes);
-        return true;
+        t->doc = TYPESET_DOC_GEMTEXT;
+    }
+    else if (mime_eqs(m, MIME_GOPHERMAP))
+    {
+        t->doc = TYPESET_DOC_GOPHERMAP;
+    }
+    else if (mime_eqs(m, MIME_PLAINTEXT))
+    {
+        t->doc = TYPESET_DOC_PLAINTEXT;
+    }
+    else
+    {
+        t->doc = TYPESET_DOC_NONE;
     }
 
-    if (mime_eqs(m, MIME_GOPHERMAP))
+    // Links are only found the first time the page is typeset
+    if (!t->links_found) typeset_links(t);
+
+    if (t->doc == TYPESET_DOC_NONE)
     {
-        if (!typeset_start(t, b, w)) return false;
-        n_bytes = typeset_gophermap(t, b);
-        typeset_finish(b, n_bytes);
-        return true;
+        t->raw_index_next = t->raw_line_count;
+        typeset_perf_end();
+        return false;
     }
 
-    if (mime_eqs(m, MIME_PLAINTEXT))
+    // Gemtext link prefixes are aligned to the width of the largest link index
+    memset(&t->gemtext, 0, sizeof(t->gemtext));
+    t->gemtext.link_maxidx_strlen =
+        snprintf(NULL, 0, "%d", g_pager->link_count);
+
+    if (!typeset_start(t, b, w))
     {
-        // Typeset plaintext document
-        if (!typeset_start(t, b, w)) return false;
-        n_bytes = typeset_plaintext(t, b);
-        typeset_finish(b, n_bytes);
+        t->raw_index_next = t->raw_line_count;
+        typeset_perf_end();
         return true;
     }
 
-    return false;
+    // Huge documents are only typeset as they are viewed, so just typeset the
+    // first block for now.  Everything else gets done up-front
+    t->is_lazy = TYPESET_LAZY && g_recv->size >= TYPESET_LAZY_THRESHOLD;
+    if (t->is_lazy) typeset_block(t, b);
+    else typeset_all(t, b);
+
+    typeset_perf_end();
+    return true;
 }
@@ -2,7 +2,6 @@
 #define TYPESETTER_H
 
 struct pager_buffer;
-struct pager_buffer_line;
 struct mime;
 
 /*
@@ -12,20 +11,108 @@ struct mime;
  * nicely display
  */
 
+/* A line in the raw (untypeset) document */
+struct typeset_raw_line
+{
+    // Points into the raw buffer itself
+    const char *s;
+    size_t bytes;
+};
+
+/* A heading in the outline of a document */
+struct typeset_heading
+{
+    // First typeset line of the heading, and its level (the number of '#')
+    int line;
+    int level;
+};
+
+/* A paragraph (run of non-empty lines) in the outline of a document */
+struct typeset_paragraph
+{
+    // First typeset line of the paragraph, and the empty line after it (or -1
+    // if the paragraph hasn't been typeset to the end yet)
+    int begin, end;
+};
+
 struct typesetter
 {
     // These lines point to the raw buffer itself
-    struct pager_buffer_line *raw_lines;
+    struct typeset_raw_line *raw_lines;
     int raw_line_count;
 
     // Current content width
     int content_width;
+
+    // Type of document being typeset
+    enum typeset_doc
+    {
+        TYPESET_DOC_NONE = 0,
+        TYPESET_DOC_GEMTEXT,
+        TYPESET_DOC_GOPHERMAP,
+        TYPESET_DOC_PLAINTEXT,
+    } doc;
+
+    // Whether the document is typeset lazily (only as much as is needed)
+    bool is_lazy;
+
+    // Whether the links of the document have been found.  They don't depend
+    // on the width, so this is only done once for each document
+    bool links_found;
+
+    // Number of links that have been typeset (the first lines of which are
+    // known), in order of line
+    int links_typeset;
+
+    // Next raw line to be typeset, and position in the pager buffer that it
+    // is written to
+    int raw_index_next;
+    size_t buffer_pos;
+
+    // Gemtext parsing state that carries over between blocks
+    struct
+    {
+        int mode;
+        bool last_was_heading;
+        int link_maxidx_strlen;
+    } gemtext;
+
+    // Index of the first typeset line of each block of raw lines
+    int *block_lines;
+    int block_count, block_capacity;
+
+    // Outline of the document, kept as it is typeset: the headings (of
+    // gemtext only) and the paragraphs, each in order of line
+    struct typeset_heading *headings;
+    int heading_count, heading_capacity;
+    struct typeset_paragraph *paragraphs;
+    int paragraph_count, paragraph_capacity;
 };
 
 void typesetter_init(struct typesetter *);
 void typesetter_deinit(struct typesetter *);
 void typesetter_reinit(struct typesetter *);
+void typesetter_rebase(struct typesetter *, const char *, const char *);
 bool typeset_page(struct typesetter *,
     struct pager_buffer *, size_t, struct mime *);
+bool typeset_block(struct typesetter *, struct pager_buffer *);
+void typeset_until_line(struct typesetter *, struct pager_buffer *, int);
+void typeset_until_raw(struct typesetter *, struct pager_buffer *, int);
+void typeset_all(struct typesetter *, struct pager_buffer *);
+int typeset_raw_to_line(struct typesetter *, struct pager_buffer *, int);
+bool typeset_raw_shown(const struct typesetter *,
+    int, bool *, const char **, const char **);
+int typeset_heading_from(struct typesetter *, struct pager_buffer *, int);
+int typeset_heading_before(const struct typesetter *, int);
+int typeset_paragraph_end_after(
+    struct typesetter *, struct pager_buffer *, int);
+int typeset_paragraph_begin_before(const struct typesetter *, int);
+
+/* Whether the entire document has been typeset */
+static inline bool
+typeset_is_done(const struct typesetter *t)
+{
+    return t->raw_index_next >= t->raw_line_count;
+}
 
 #endif
@@ -50,7 +50,10 @@ uri_parse(const char *uri_unsafe, int uri_len)
     if (protocol_name_len > 0)
     {
         for (path_pos = protocol_name_len;
-            path_pos < uri_len && uri[path_pos] != '/';
+            path_pos < uri_len &&
+                uri[path_pos] != '/' &&
+                uri[path_pos] != '?' &&
+                uri[path_pos] != '#';
             ++path_pos);
     }
 
@@ -107,7 +110,7 @@ uri_parse(const char *uri_unsafe, int uri_len)
     }
 
     // Get path
-    if (path_pos < uri_len)
+    if (path_pos < uri_len && path_len > 0)
     {
         strncpy(result.path, uri + path_pos, path_len);
     }
@@ -362,10 +365,232 @@ uri_encode(
         }
 
         // Percent-encode the character
-        o += snprintf(o, end - o, "%%%02X", *s);
+        o += snprintf(o, end - o, "%%%02X", (unsigned char)*s);
     }
 
     // Set null-terminator
     if (o >= end) *end = '\0';
     else *o = '\0';
 }
+
+/* Decode a percent-encoded URI component */
+void
+uri_decode(
+    char *restrict o,
+    const char *restrict s,
+    size_t n)
+{
+    char *const end = o + n - 1;
+    for (; *s && o < end; ++s)
+    {
+        if (*s == '%' &&
+            isxdigit((unsigned char)s[1]) &&
+            isxdigit((unsigned char)s[2]))
+        {
+            const char hex[3] = { s[1], s[2], '\0' };
+            *o++ = strtol(hex, NULL, 16);
+            s += 2;
+            continue;
+        }
+        *o++ = *s;
+    }
+    *o = '\0';
+}
+
+// Interned strings (hostnames and protocol names), in an open-addressed hash
+// table that's never shrunk; there are only so many hosts that get visited
+static struct
+{
+    char **table;
+    uint32_t count, capacity;
+} s_intern;
+
+/* Find the slot of a string in the intern table, or the empty one for it */
+static char **
+uri_intern_slot(char **table, uint32_t capacity, const char *s, size_t n)
+{
+    for (uint32_t i = fnv1a(FNV1A_BASIS, s, n) & (capacity - 1);;
+        i = (i + 1) & (capacity - 1))
+    {
+        if (!table[i] ||
+            (strncmp(table[i], s, n) == 0 && table[i][n] == '\0'))
+        {
+            return &table[i];
+        }
+    }
+}
+
+/*
+ * Get the one copy of a string that's kept for as long as the program runs,
+ * so that the same string is only stored once
+ */
+const char *
+uri_intern(const char *s, size_t n)
+{
+    n = strnlen(s, n);
+    if (s_intern.table)
+    {
+        char **const slot =
+            uri_intern_slot(s_intern.table, s_intern.capacity, s, n);
+        if (*slot) return *slot;
+    }
+
+    // Keep the table at most half full
+    if ((s_intern.count + 1) * 2 > s_intern.capacity)
+    {
+        const uint32_t new_capacity = max(s_intern.capacity * 2, 64);
+        char **const table = calloc(new_capacity, sizeof(char *));
+        if (!table)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        for (uint32_t i = 0; i < s_intern.capacity; ++i)
+        {
+            if (!s_intern.table[i]) continue;
+            *uri_intern_slot(table, new_capacity, s_intern.table[i],
+                strlen(s_intern.table[i])) = s_intern.table[i];
+        }
+        free(s_intern.table);
+        s_intern.table = table;
+        s_intern.capacity = new_capacity;
+    }
+
+    char **const slot =
+        uri_intern_slot(s_intern.table, s_intern.capacity, s, n);
+    if (!(*slot = strndup(s, n)))
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    ++s_intern.count;
+    return *slot;
+}
+
+void
+uri_intern_deinit(void)
+{
+    for (uint32_t i = 0; i < s_intern.capacity; ++i) free(s_intern.table[i]);
+    free(s_intern.table);
+    memset(&s_intern, 0, sizeof(s_intern));
+}
+
+/* Hash of a path, the same with or without a trailing slash */
+static inline uint32_t
+uri_hash_path(uint32_t h, const char *path, size_t len)
+{
+    if (len && path[len - 1] == '/') --len;
+    return fnv1a(h, path, len);
+}
+
+/*
+ * Hash a URI's protocol, hostname and path (ignoring any trailing slash).
+ * URIs that uri_cmp or uri_cmp_notrailing find the same have the same hash
+ */
+uint32_t
+uri_hash(const struct uri *uri)
+{
+    uint32_t h = fnv1a(FNV1A_BASIS, &uri->protocol, sizeof(uri->protocol));
+    h = fnv1a(h, uri->hostname, strnlen(uri->hostname, URI_HOSTNAME_MAX));
+    return uri_hash_path(h, uri->path, strnlen(uri->path, URI_PATH_MAX));
+}
+
+/* Pack a URI, adding its path and query to the given string buffer */
+void
+uri_pack(
+    struct uri_packed *restrict p,
+    const struct uri *restrict uri,
+    struct uri_strings *restrict strings)
+{
+    const size_t path_len = strnlen(uri->path, URI_PATH_MAX - 1),
+        query_len = strnlen(uri->query, URI_QUERY_MAX - 1),
+        n = path_len + 1 + query_len + 1;
+
+    if (strings->len + n > strings->capacity)
+    {
+        size_t new_cap = max(strings->capacity, 256);
+        while (new_cap < strings->len + n) new_cap = (new_cap * 3) / 2;
+
+        char *tmp = realloc(strings->b, new_cap);
+        if (!tmp)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        strings->b = tmp;
+        strings->capacity = new_cap;
+    }
+
+    char *const s = strings->b + strings->len;
+    memcpy(s, uri->path, path_len);
+    s[path_len] = '\0';
+    memcpy(s + path_len + 1, uri->query, query_len);
+    s[path_len + 1 + query_len] = '\0';
+
+    p->protocol_str = uri_intern(uri->protocol_str, PROTOCOL_NAME_MAX);
+    p->hostname = uri_intern(uri->hostname, URI_HOSTNAME_MAX);
+    p->s = strings->len;
+    p->path_len = path_len;
+    p->query_len = query_len;
+    p->hash = uri_hash(uri);
+    p->port = uri->port;
+    p->protocol = uri->protocol;
+    p->gopher_item = uri->gopher_item;
+
+    strings->len += n;
+}
+
+/* Unpack a URI that was packed into the given string buffer */
+void
+uri_unpack(
+    struct uri *restrict uri,
+    const struct uri_packed *restrict p,
+    const struct uri_strings *restrict strings)
+{
+    const char *const s = strings->b + p->s;
+
+    uri->protocol = p->protocol;
+    strncpy(uri->protocol_str, p->protocol_str, PROTOCOL_NAME_MAX - 1);
+    uri->protocol_str[PROTOCOL_NAME_MAX - 1] = '\0';
+    strncpy(uri->hostname, p->hostname, URI_HOSTNAME_MAX - 1);
+    uri->hostname[URI_HOSTNAME_MAX - 1] = '\0';
+    uri->port = p->port;
+    memcpy(uri->path, s, p->path_len + 1);
+    memcpy(uri->query, s + p->path_len + 1, p->query_len + 1);
+    uri->gopher_item = p->gopher_item;
+}
+
+/*
+ * Compare a packed URI with another (whose hash is given) in the same way as
+ * uri_cmp_notrailing.  Strings are only compared when the hashes match
+ */
+int
+uri_packed_cmp_notrailing(
+    const struct uri_packed *restrict a,
+    const struct uri_strings *restrict strings,
+    const struct uri *restrict b,
+    uint32_t b_hash)
+{
+    if (a->hash != b_hash || a->protocol != b->protocol) return -1;
+
+    const char *const path = strings->b + a->s;
+    const char *const query = path + a->path_len + 1;
+    size_t len_a = a->path_len, len_b = strnlen(b->path, URI_PATH_MAX);
+    if (len_a && path[len_a - 1] == '/') --len_a;
+    if (len_b && b->path[len_b - 1] == '/') --len_b;
+
+    return (
+        len_a == len_b &&
+        a->query_len == strnlen(b->query, URI_QUERY_MAX) &&
+        memcmp(path, b->path, len_a) == 0 &&
+        memcmp(query, b->query, a->query_len) == 0 &&
+        strncmp(a->hostname, b->hostname, URI_HOSTNAME_MAX) == 0) ? 0 : -1;
+}
+
+void
+uri_strings_free(struct uri_strings *strings)
+{
+    free(strings->b);
+    strings->b = NULL;
+    strings->len = strings->capacity = 0;
+}
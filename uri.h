@@ -15,10 +15,14 @@
 #define URI_INTERNAL_BLANK_RAW "blank"
 #define URI_INTERNAL_HISTORY_RAW "history"
 #define URI_INTERNAL_FAVOURITES_RAW "favourites"
+#define URI_INTERNAL_PERF_RAW "perf"
+#define URI_INTERNAL_SEARCH_RAW "search"
 #define URI_INTERNAL_PREFIX URI_INTERNAL_PREFIX_RAW ":"
 #define URI_INTERNAL_BLANK URI_INTERNAL_PREFIX URI_INTERNAL_BLANK_RAW
 #define URI_INTERNAL_HISTORY URI_INTERNAL_PREFIX URI_INTERNAL_HISTORY_RAW
 #define URI_INTERNAL_FAVOURITES URI_INTERNAL_PREFIX URI_INTERNAL_FAVOURITES_RAW
+#define URI_INTERNAL_PERF URI_INTERNAL_PREFIX URI_INTERNAL_PERF_RAW
+#define URI_INTERNAL_SEARCH URI_INTERNAL_PREFIX URI_INTERNAL_SEARCH_RAW
 
 enum uri_protocol
 {
@@ -123,6 +127,38 @@ struct uri
     enum gopher_item_type gopher_item;
 };
 
+/*
+ * Compact form of a URI, for where many are kept (the links of a page, the
+ * history, cached pages).  The protocol name and hostname are interned (see
+ * uri_intern), and the path and query are kept one after the other in a
+ * string buffer that belongs to the owner, so it takes a few dozen bytes
+ * rather than over a kilobyte.  The hash covers what uri_cmp and
+ * uri_cmp_notrailing look at, so URIs that differ can nearly always be told
+ * apart without comparing any strings
+ */
+struct uri_packed
+{
+    const char *protocol_str;
+    const char *hostname;
+
+    // Offset of the path in the string buffer (the query follows it, after
+    // the path's null-terminator), and their lengths
+    uint32_t s;
+    uint16_t path_len, query_len;
+
+    uint32_t hash;
+    int port;
+    uint8_t protocol;
+    uint8_t gopher_item;
+};
+
+/* String buffer that packed URIs keep their paths and queries in */
+struct uri_strings
+{
+    char *b;
+    size_t len, capacity;
+};
+
 struct uri uri_parse(const char *, int);
 
 size_t uri_str(
@@ -136,6 +172,25 @@ void uri_abs(struct uri *restrict, struct uri *restrict);
 void uri_set_query(struct uri *restrict, const char *restrict);
 
 void uri_encode(char *restrict, const char *restrict, size_t);
+void uri_decode(char *restrict, const char *restrict, size_t);
+
+const char *uri_intern(const char *, size_t);
+void uri_intern_deinit(void);
+uint32_t uri_hash(const struct uri *);
+void uri_pack(
+    struct uri_packed *restrict,
+    const struct uri *restrict,
+    struct uri_strings *restrict);
+void uri_unpack(
+    struct uri *restrict,
+    const struct uri_packed *restrict,
+    const struct uri_strings *restrict);
+int uri_packed_cmp_notrailing(
+    const struct uri_packed *restrict,
+    const struct uri_strings *restrict,
+    const struct uri *restrict,
+    uint32_t);
+void uri_strings_free(struct uri_strings *);
 
 static inline int
 uri_cmp(
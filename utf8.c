@@ -1,88 +1,178 @@
 #include "pch.h"
 #include "utf8.h"
+#include "utf8_width_table.h"
 
-static char *s_c;
-static wchar_t *s_wc;
-static size_t s_c_size, s_wc_size;
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
-void
-utf8_init(void)
+/* Number of printable ASCII bytes at the beginning of a string */
+static inline size_t
+utf8_ascii_run(const unsigned char *s, const unsigned char *end)
 {
-    s_c_size = 256;
-    s_wc_size = 512;
-    s_c = malloc(s_c_size * sizeof(char));
-    s_wc = malloc(s_wc_size * sizeof(wchar_t));
+    const unsigned char *const begin = s;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7f);
+    for (; end - s >= 16; s += 16)
+    {
+        // Signed comparison catches both control characters and non-ASCII
+        // bytes (which are negative)
+        const __m128i v = _mm_loadu_si128((const __m128i *)s);
+        const int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmplt_epi8(v, lo), _mm_cmpeq_epi8(v, del)));
+        if (mask) return (s - begin) + __builtin_ctz(mask);
+    }
+#else
+    // Check a word at a time for any bytes that are control characters,
+    // non-ASCII or DEL
+    const uint64_t ones = 0x0101010101010101ull,
+                   high = 0x8080808080808080ull;
+    for (; end - s >= 8; s += 8)
+    {
+        uint64_t w;
+        memcpy(&w, s, sizeof(w));
+        const uint64_t d = w ^ (ones * 0x7f);
+        const uint64_t ctrl = (w - ones * 0x20) & ~w & high;
+        if ((w & high) | ctrl | ((d - ones) & ~d & high)) break;
+    }
+#endif
+
+    for (; s < end && *s >= 0x20 && *s < 0x7f; ++s);
+
+    return s - begin;
 }
 
-void
-utf8_deinit(void)
+/* Check if a codepoint is in one of the (sorted) range tables */
+static bool
+utf8_in_table(uint32_t cp, const struct utf8_range *table, size_t n)
 {
-    free(s_c);
-    free(s_wc);
+    if (cp < table[0].first || cp > table[n - 1].last) return false;
+
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        const size_t mid = (lo + hi) / 2;
+        if (cp > table[mid].last) lo = mid + 1;
+        else if (cp < table[mid].first) hi = mid;
+        else return true;
+    }
+    return false;
 }
 
-/* Calculate width of a string with multi-byte sequences and escapes */
-size_t
-utf8_width(const char *s_in, size_t n)
+/* Display width of a (non-ASCII) codepoint */
+static int
+utf8_codepoint_width(uint32_t cp)
 {
-    if (!s_in || !n) return 0;
+    // C1 control characters
+    if (cp < 0xa0) return 0;
+
+    // Nothing before combining diacritics is zero-width or wide
+    if (cp < 0x300) return 1;
+
+    if (utf8_in_table(cp, UTF8_ZERO_WIDTH,
+        sizeof(UTF8_ZERO_WIDTH) / sizeof(UTF8_ZERO_WIDTH[0]))) return 0;
+    if (utf8_in_table(cp, UTF8_WIDE,
+        sizeof(UTF8_WIDE) / sizeof(UTF8_WIDE[0]))) return 2;
 
-    int width = 0;
+    return 1;
+}
 
-    // Check that we have enough space for a buffer
-    size_t needed_c = n + 1;
-    if (needed_c >= s_c_size)
+/*
+ * Decode a multi-byte sequence.  Invalid sequences decode to the replacement
+ * character, one byte at a time
+ */
+static uint32_t
+utf8_decode(const unsigned char *s, const unsigned char *end, int *len)
+{
+    uint32_t cp;
+    int n;
+    if      ((*s & 0xe0) == 0xc0) { cp = *s & 0x1f; n = 2; }
+    else if ((*s & 0xf0) == 0xe0) { cp = *s & 0x0f; n = 3; }
+    else if ((*s & 0xf8) == 0xf0) { cp = *s & 0x07; n = 4; }
+    else goto invalid;
+
+    if (end - s < n) goto invalid;
+    for (int i = 1; i < n; ++i)
     {
-        free(s_c);
-        s_c_size = (needed_c * 3) / 2;
-        s_c = malloc(s_c_size * sizeof(char));
-        if (!s_c) exit(-1);
+        if ((s[i] & 0xc0) != 0x80) goto invalid;
+        cp = (cp << 6) | (s[i] & 0x3f);
     }
 
-    // Copy the buffer, stripping escape codes and stripping certain characters
-    // that result in incorrect width (i.e. tabs)
-    bool is_escape = false;
-    const char *end = s_in + n;
-    char *s_cur = s_c;
-    for (; s_in < end && *s_in; ++s_in)
+    *len = n;
+    return cp;
+
+invalid:
+    *len = 1;
+    return 0xfffd;
+}
+
+/*
+ * Calculate width of a string with multi-byte sequences and escapes.  This is
+ * called for pretty much every line and word that is typeset, so it's done in
+ * a single pass without any allocations, with a fast path for plain ASCII
+ */
+size_t
+utf8_width(const char *s_in, size_t n)
+{
+    if (!s_in || !n) return 0;
+
+    const unsigned char *s = (const unsigned char *)s_in,
+                        *const end = s + n;
+    size_t width = 0;
+    while (s < end)
     {
-        // Detect escapes
-        if (is_escape && *s_in != 'm') continue;
-        if (*s_in == '\x1b')
+        // Printable ASCII is by far the most common case
+        const size_t run = utf8_ascii_run(s, end);
+        width += run;
+        s += run;
+        if (s >= end || *s == '\0') break;
+
+        // Skip over escape codes
+        if (*s == '\x1b')
         {
-            is_escape = true;
+            for (; s < end && *s != 'm'; ++s);
+            ++s;
             continue;
         }
-        if (is_escape && *s_in == 'm')
+
+        // Tabs are displayed as spaces, other control characters as nothing
+        if (*s < 0x80)
         {
-            is_escape = false;
+            width += *s == '\t';
+            ++s;
             continue;
         }
 
-        // Copy the character, though use space instead of tabs
-        if (*s_in == '\t') *s_cur = ' ';
-        else *s_cur = *s_in;
-        ++s_cur;
+        int len;
+        width += utf8_codepoint_width(utf8_decode(s, end, &len));
+        s += len;
     }
-    *s_cur = '\0';
 
-    // Check we have enough space for wide-string buffer
-    size_t needed_wc = mbstowcs(NULL, s_c, 0) + 1;
-    if (needed_wc >= s_wc_size)
+    return width;
+}
+
+/*
+ * Number of bytes at the start of a string (of n bytes, without escapes) that
+ * fit in the given width, cutting only between characters
+ */
+size_t
+utf8_size_w(const char *s_in, size_t n, size_t w)
+{
+    const unsigned char *s = (const unsigned char *)s_in,
+                        *const end = s + n;
+    size_t width = 0;
+    while (s < end)
     {
-        free(s_wc);
-        s_wc_size = (needed_wc * 3) / 2;
-        s_wc = malloc(s_wc_size * sizeof(wchar_t));
-        if (!s_wc) exit(-1);
+        int len = 1;
+        const size_t cw = *s < 0x80
+            ? ((*s >= 0x20 && *s < 0x7f) || *s == '\t')
+            : utf8_codepoint_width(utf8_decode(s, end, &len));
+        if (width + cw > w) break;
+        width += cw;
+        s += len;
     }
-
-    // Perform wide string conversion
-    if (mbstowcs(s_wc, s_c, needed_wc) == (size_t)-1) return 0;
-
-    // Measure width
-    width = wcswidth(s_wc, needed_wc);
-
-    return width;
+    return s - (const unsigned char *)s_in;
 }
 
 /* Number of bytes that exist in a length (inverse of above) */
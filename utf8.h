@@ -7,15 +7,15 @@
  * Code for handling multi-byte sequences
  */
 
-void utf8_init(void);
-void utf8_deinit(void);
-
 /* Calculate width of a string with multi-byte sequences */
 size_t utf8_width(const char *, size_t);
 
 /* Number of bytes that exist in a length (inverse of above) */
 size_t utf8_size_w_formats(const char *, size_t);
 
+/* Number of bytes of a string (without escapes) that fit in a width */
+size_t utf8_size_w(const char *, size_t, size_t);
+
 /*
  * Move to next character in a string that has escapes codes in it, while
  * ignoring escapes
@@ -1,4 +1,5 @@
 #include "pch.h"
+#include "event.h"
 #include "util.h"
 #include "tui.h"
 
@@ -120,9 +121,12 @@ connect_socket_to(const char *hostname, int port)
     struct addrinfo *res = NULL;
     getaddrinfo(hostname, port_str, &hints, &res);
 
-    // Connect to any of the addresses we can
+    // Connect to any of the addresses we can (unless e.g. the program is
+    // quitting)
     bool connected = false;
-    for (struct addrinfo *i = res; i != NULL; i = i->ai_next)
+    for (struct addrinfo *i = res;
+        i != NULL && !event_signal_interrupted();
+        i = i->ai_next)
     {
         // Create socket
         if ((sock = socket(
@@ -8,6 +8,21 @@
 #define sign(x) \
     ((x) > 0 ? 1 : -1)
 
+// Hash to start from, to hash something with fnv1a() from scratch
+#define FNV1A_BASIS 2166136261u
+
+/*
+ * FNV-1a hash of some bytes, carrying on from the given hash (so that several
+ * things can be hashed together)
+ */
+static inline uint32_t
+fnv1a(uint32_t h, const void *p, size_t n)
+{
+    const unsigned char *const s = p;
+    for (size_t i = 0; i < n; ++i) h = (h ^ s[i]) * 16777619u;
+    return h;
+}
+
 /* Normalises two paths */
 int path_normalise(const char *restrict, const char *restrict, char *restrict);
 